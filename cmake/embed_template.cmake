@@ -0,0 +1,61 @@
+# Write a driver template as the list of raw string literals that lemon.cpp
+# embeds, or with CHECK set, fail if OUTPUT is not what would be written.
+#
+#   cmake -DINPUT=lempar.c -DOUTPUT=lempar.inc -DKIND=default
+#         [-DCHECK=1] -P embed_template.cmake
+#
+# Each literal is less than 16KB, which is as long as a single string
+# literal may be with MSVC, and ends at the end of a line.  Line endings
+# are normalized to "\n", so that a checkout with CRLF gives the same
+# split.
+
+foreach(var INPUT OUTPUT KIND)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "embed_template.cmake: ${var} is not set")
+    endif()
+endforeach()
+set(max_literal 15999)
+
+get_filename_component(input_name "${INPUT}" NAME)
+get_filename_component(output_name "${OUTPUT}" NAME)
+file(READ "${INPUT}" rest)
+string(REPLACE "\r\n" "\n" rest "${rest}")
+
+set(text "/* The ${KIND} driver template.  This is the text of ${input_name}, split into
+** raw string literals of less than 16KB each, which is as long as a single
+** string literal may be with MSVC.  It is written by embed_template.cmake
+** whenever ${input_name} changes.  Do not edit it by hand.
+*/
+")
+string(LENGTH "${rest}" n)
+while(n GREATER 0)
+    if(n GREATER max_literal)
+        string(SUBSTRING "${rest}" 0 ${max_literal} chunk)
+        string(FIND "${chunk}" "\n" last REVERSE)
+        if(last LESS 0)
+            message(FATAL_ERROR "${input_name} has a line of 16KB or more")
+        endif()
+        math(EXPR len "${last} + 1")
+        string(SUBSTRING "${rest}" 0 ${len} chunk)
+        string(SUBSTRING "${rest}" ${len} -1 rest)
+    else()
+        set(chunk "${rest}")
+        set(rest "")
+    endif()
+    string(APPEND text "R\"lempar(${chunk})lempar\",\n")
+    string(LENGTH "${rest}" n)
+endwhile()
+
+if(CHECK)
+    set(old "")
+    if(EXISTS "${OUTPUT}")
+        file(READ "${OUTPUT}" old)
+        string(REPLACE "\r\n" "\n" old "${old}")
+    endif()
+    if(NOT old STREQUAL text)
+        message(FATAL_ERROR "${output_name} does not match ${input_name}.  "
+            "Copy it from the CMake build directory, where it is regenerated.")
+    endif()
+else()
+    file(WRITE "${OUTPUT}" "${text}")
+endif()
@@ -1,9 +1,10 @@
 ﻿
 /*
 ** This file contains all sources (including headers) to the LEMON
-** LALR(1) parser generator.  The sources have been combined into a
-** single file to make it easy to include LEMON in the source tree
-** and Makefile of another program.
+** LALR(1) parser generator, except for the command line program in
+** lemon_main.cpp.  The sources have been combined into a single file to
+** make it easy to include LEMON in the source tree and Makefile of
+** another program.
 **
 ** The author of this program disclaims copyright.
 */
@@ -19,6 +20,18 @@
 #include <stdlib.h>
 #include <assert.h>
 
+/* Vector extensions used by the set module, when the target has them */
+#if defined(__AVX2__)
+#   include <immintrin.h>
+#   define SET_AVX2
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#   include <emmintrin.h>
+#   define SET_SSE2
+#endif
+#if defined(_MSC_VER)
+#   include <intrin.h>
+#endif
+
 #define ISSPACE(X) isspace(static_cast<unsigned char>(X))
 #define ISDIGIT(X) isdigit(static_cast<unsigned char>(X))
 #define ISALNUM(X) isalnum(static_cast<unsigned char>(X))
@@ -41,8 +54,15 @@ extern "C" {
 #ifdef __cplusplus
 }
 #endif
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#define NOGDI
+#include <windows.h>
 #else
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #endif
 
 //C++ Headers
@@ -52,13 +72,23 @@ extern "C" {
 
 #include <iostream>
 #include <iomanip>
+#include <chrono>
+#include <cstddef>
 
 #include <map>
 #include <string>
 #include <string_view>
 #include <vector>
-#include <unordered_set>
+#include <deque>
+#include <memory>
+#include <list>
+#include <charconv>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
 #include <iterator>
+#include <random>
 
 /* #define PRIVATE static */
 #define PRIVATE
@@ -70,7 +100,6 @@ extern "C" {
 #endif
 
 extern void memory_error();
-static int showPrecedenceConflict = 0;
 static char* msort(char*, const char**, int(*)(const char*, const char*));
 
 /*
@@ -197,23 +226,6 @@ void FindActions(lemon&);
 /********* From the file "error.h" ***************************************/
 void ErrorMsg(const char*, int, const char*, ...);
 
-/****** From the file "option.h" ******************************************/
-enum option_type {
-    OPT_FLAG = 1, OPT_INT, OPT_DBL, OPT_STR,
-    OPT_FFLAG, OPT_FINT, OPT_FDBL, OPT_FSTR
-};
-struct s_options {
-    option_type type;
-    const char* label;
-    char* arg;
-    const char* message;
-};
-int    OptInit(char*&);
-int    OptNArgs();
-char* OptArg(int);
-void   OptErr(int);
-void   OptPrint();
-
 /******** From the file "parse.h" *****************************************/
 void Parse(lemon& lemp);
 
@@ -227,13 +239,21 @@ void ReportHeader(lemon&);
 void CompressTables(lemon&);
 void ResortStates(lemon&);
 
+/********** From the file "cache.h" **************************************/
+uint64_t Cache_key(const lemon&);     /* Hash of the structure of the grammar */
+int  Cache_load(lemon&);              /* Read the automaton.  True if found */
+void Cache_save(lemon&);              /* Write the automaton for the next run */
+
 /********** From the file "set.h" ****************************************/
-void  SetSize(int);             /* All sets will be of size N */
-char* SetNew();               /* A new set for element 0..N */
-void  SetFree(char*);             /* Deallocate a set */
-int SetAdd(char*, int);            /* Add element to a set */
-int SetUnion(char*, const char*);    /* A <- A U B, thru element N */
-#define SetFind(X,Y) (X[Y])       /* True if Y is in set X */
+void  SetSize(int);                   /* All sets will be of size N */
+setword* SetNew();                   /* A new set for element 0..N */
+void  SetFree(setword*);             /* Deallocate a set */
+int SetAdd(setword*, int);           /* Add element to a set */
+int SetUnion(setword*, const setword*);  /* A <- A U B, thru element N */
+int SetNext(const setword*, int);    /* First element >= N, or -1 */
+static int SetCtz(setword);          /* Lowest set bit of a non-zero word */
+static int SetPopcount(setword);     /* Number of set bits in a word */
+#define SetFind(X,Y) (((X)[(Y)>>6]>>((Y)&63))&1)  /* True if Y is in set X */
 
 /********** From the file "struct.h" *************************************/
 /*
@@ -262,8 +282,303 @@ int SetUnion(char*, const char*);    /* A <- A U B, thru element N */
 /* Routines for handling a strings */
 const char* Strsafe(std::string_view);
 void Strsafe_init(void);
-bool Strsafe_insert(std::string_view);
-std::string_view Strsafe_find(std::string_view);
+int Strsafe_id(std::string_view);
+int Strsafe_lookup(std::string_view);
+const char* Strsafe_str(int);
+uint64_t strhash(std::string_view);
+
+/********************** The generator context *******************************/
+/*
+** Everything that one run of the generator owns lives in a genctx, and
+** the modules below reach it through "genp", which points at the context
+** of the Generator running on the current thread.  The configuration
+** list builder and the free lists are kept per thread in a cfgbuilder,
+** so that states can be built on several threads at once.
+**
+** All memory for a generator comes from lemon_calloc() and friends.
+** Every block is linked into a list owned by the context, and all of it
+** is released when the Generator is destroyed.
+*/
+namespace State
+{
+struct s_x3;
+struct s_x4;
+}
+#define X3SHARDS 64                    /* Number of shards in the state table */
+
+/* One slot of the string table.  The hash and length of the string are
+** kept in the slot, so the bytes are only compared when both agree. */
+struct x1node {
+    uint64_t hash;                     /* Hash of the string */
+    int len;                           /* Length of the string */
+    int id;                            /* Id of the string, or -1 if empty */
+};
+
+/* A bump pool.  Objects of one kind are carved in turn from large
+** chunks, so objects that are made one after the other sit next to
+** each other in memory.  Pooled objects are never freed one at a time;
+** their chunks are released all at once with the generator.
+*/
+struct pool {
+    char* next = nullptr;              /* First free byte of the current chunk */
+    char* end = nullptr;               /* End of the current chunk */
+    size_t nobj = 0;                   /* Objects carved from the pool */
+    size_t nbyte = 0;                  /* Bytes carved from the pool */
+    size_t nchunk = 0;                 /* Chunks allocated */
+    size_t nchunkbyte = 0;             /* Bytes in those chunks */
+};
+#define POOLCHUNK (64 * 1024)          /* Bytes in a chunk of a pool */
+
+/* The pools of a cfgbuilder, one for each kind of object */
+enum e_pool {
+    POOL_CONFIG,                       /* Configurations, each with its follow set */
+    POOL_ACTION,                       /* Parser actions */
+    POOL_PLINK,                        /* Follow-set propagation links */
+    POOL_STATE,                        /* States */
+    POOL_SET,                          /* First sets and other loose sets */
+    NPOOL
+};
+
+struct cfgbuilder {
+    config* freelist = nullptr;        /* List of free configurations */
+    config* current = nullptr;         /* Top of list of configurations */
+    config** currentend = nullptr;     /* Last on list of configs */
+    config* basis = nullptr;           /* Top of list of basis configs */
+    config** basisend = nullptr;       /* End of list of basis configs */
+    State::s_x4* x4a = nullptr;        /* The configuration table */
+    plink* plinkfreelist = nullptr;    /* Free follow-set propagation links */
+    setword* setfreelist = nullptr;    /* Free sets, linked through word 0 */
+    pool pools[NPOOL];                 /* Where new objects come from */
+    workcount work;                    /* Work done on this builder */
+};
+
+/* Header of every block allocated by lemon_calloc() */
+union memhdr {
+    struct {
+        memhdr* prev;
+        memhdr* next;
+    } link;
+    std::max_align_t align;
+};
+
+/* An output file.  Its text is gathered in memory and, when the file is
+** closed, written with a single call unless the file already holds that
+** text, or kept in the outputs of the generator when it runs in memory.
+** The o*() routines append to it in place of fprintf() and friends.
+*/
+struct outfile {
+    std::string text;                  /* Everything written so far */
+    std::string name;                  /* Name of the file */
+};
+
+struct genctx {
+    lemon lem;                                          /* The state vector */
+    lemon::Generator::Options opt;                      /* Options of the run */
+    cfgbuilder builder;                                 /* Builder of the calling thread */
+    x1node* x1a = nullptr;                              /* Hash table of interned strings */
+    int x1size = 0;                                     /* Number of slots in x1a */
+    pool x1pool;                                        /* Bytes of the interned strings */
+    std::vector<const char*> x1str;                     /* Interned strings, by id */
+    std::vector<int> x1sym;                             /* Symbol of each string, or -1 */
+    std::deque<Symbol::symbol> x2a;                     /* The symbol table, in order found */
+    State::s_x3* x3a = nullptr;                         /* Shards of the state table */
+    std::mutex x3lock[X3SHARDS];                        /* The lock on each shard */
+    int setsize = 0;                                    /* Number of elements in a set */
+    int setwords = 0;                                   /* Number of setwords in a set */
+    char* zAppend = nullptr;                            /* The append_str() buffer */
+    int nAppendAlloc = 0;                               /* Bytes allocated for zAppend */
+    int nAppendUsed = 0;                                /* Bytes of zAppend in use */
+    std::mutex errorLock;                               /* Serializes errors from threads */
+    std::list<outfile> outfiles;                        /* Output files not yet closed */
+    uint64_t cacheKey = 0;                              /* Cache_key() of the grammar */
+    bool cached = false;                                /* The automaton came from the cache */
+    std::vector<int> packed;                            /* yy_action[] slots, for the cache */
+    std::map<std::string, std::string> outputs;         /* Finished in-memory outputs */
+    std::mutex memLock;                                 /* Guards the list of blocks */
+    memhdr* blocks = nullptr;                           /* Every block allocated */
+    pool retired[NPOOL];                                /* Pools of threads that are done */
+    workcount retiredWork;                              /* Work of threads that are done */
+    ~genctx();
+};
+
+static thread_local genctx* genp = nullptr;      /* Generator running on this thread */
+static thread_local cfgbuilder* bldp = nullptr;  /* Builder of this thread */
+
+/* Make a generator current on this thread for the life of the object */
+class genscope {
+public:
+    explicit genscope(genctx* ctx, cfgbuilder* bld = nullptr)
+        : oldGen(genp), oldBld(bldp) {
+        genp = ctx;
+        bldp = bld ? bld : &ctx->builder;
+    }
+    ~genscope() {
+        genp = oldGen;
+        bldp = oldBld;
+    }
+private:
+    genctx* oldGen;
+    cfgbuilder* oldBld;
+};
+
+/* Add the time from construction to the end of the scope to a step of
+** the run on this thread */
+class phasetimer {
+public:
+    explicit phasetimer(e_phase p)
+        : phase(p), start(std::chrono::steady_clock::now()) {}
+    ~phasetimer() {
+        genp->lem.phaseusec[(int)phase] += (int)std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+private:
+    e_phase phase;
+    std::chrono::steady_clock::time_point start;
+};
+
+/* Allocate zeroed memory owned by the current generator.  Return NULL
+** if out of memory. */
+static void* lemon_calloc(size_t n, size_t sz)
+{
+    memhdr* h;
+    assert(genp != nullptr);
+    h = (memhdr*)calloc(1, sizeof(memhdr) + n * sz);
+    if (h == nullptr) return nullptr;
+    std::lock_guard<std::mutex> lock(genp->memLock);
+    h->link.prev = nullptr;
+    h->link.next = genp->blocks;
+    if (genp->blocks) genp->blocks->link.prev = h;
+    genp->blocks = h;
+    return h + 1;
+}
+
+/* Release memory from lemon_calloc() before the generator is destroyed */
+static void lemon_free(void* p)
+{
+    memhdr* h;
+    if (p == nullptr) return;
+    h = (memhdr*)p - 1;
+    {
+        std::lock_guard<std::mutex> lock(genp->memLock);
+        if (h->link.prev) h->link.prev->link.next = h->link.next;
+        else genp->blocks = h->link.next;
+        if (h->link.next) h->link.next->link.prev = h->link.prev;
+    }
+    free(h);
+}
+
+/* Resize memory from lemon_calloc().  Any new space is not zeroed.
+** Return NULL if out of memory, leaving the old block in place. */
+static void* lemon_realloc(void* p, size_t sz)
+{
+    memhdr* h, * nh;
+    if (p == nullptr) return lemon_calloc(1, sz);
+    h = (memhdr*)p - 1;
+    std::lock_guard<std::mutex> lock(genp->memLock);
+    nh = (memhdr*)realloc(h, sizeof(memhdr) + sz);
+    if (nh == nullptr) return nullptr;
+    if (nh->link.prev) nh->link.prev->link.next = nh;
+    else genp->blocks = nh;
+    if (nh->link.next) nh->link.next->link.prev = nh;
+    return nh + 1;
+}
+
+/* Save a copy of a string in memory owned by the current generator */
+static char* lemon_strdup(const char* z)
+{
+    char* zCopy = (char*)lemon_calloc(strlen(z) + 1, 1);
+    if (zCopy == nullptr) memory_error();
+    memcpy(zCopy, z, strlen(z));
+    return zCopy;
+}
+
+/* Carve "sz" zeroed bytes from a pool.  An object too large to share a
+** chunk gets a chunk of its own. */
+static void* pool_alloc(pool& p, size_t sz)
+{
+    char* z;
+    sz = (sz + 7) & ~(size_t)7;
+    if (sz > (size_t)(p.end - p.next)) {
+        size_t n = sz > POOLCHUNK / 4 ? sz : POOLCHUNK;
+        z = (char*)lemon_calloc(n, 1);
+        if (z == nullptr) memory_error();
+        p.nchunk++;
+        p.nchunkbyte += n;
+        if (n == POOLCHUNK) {
+            p.next = z;
+            p.end = z + n;
+        }
+        else {
+            p.nobj++;
+            p.nbyte += sz;
+            return z;
+        }
+    }
+    z = p.next;
+    p.next += sz;
+    p.nobj++;
+    p.nbyte += sz;
+    return z;
+}
+
+/* Add the work counted in one workcount to another */
+static void work_add(workcount& to, const workcount& from)
+{
+    to.nconfig += from.nconfig;
+    to.nplink += from.nplink;
+    to.nunion += from.nunion;
+    to.nunionChanged += from.nunionChanged;
+    to.nfirstComp += from.nfirstComp;
+    to.nfollowComp += from.nfollowComp;
+    to.nstateProbe += from.nstateProbe;
+    to.nconfigProbe += from.nconfigProbe;
+    to.nactOffset += from.nactOffset;
+}
+
+/* Add the pool counts and the work of a builder that is going away to
+** the totals of the generator */
+static void pool_retire(const cfgbuilder& b)
+{
+    std::lock_guard<std::mutex> lock(genp->memLock);
+    for (int i = 0; i < NPOOL; i++) {
+        genp->retired[i].nobj += b.pools[i].nobj;
+        genp->retired[i].nbyte += b.pools[i].nbyte;
+        genp->retired[i].nchunk += b.pools[i].nchunk;
+        genp->retired[i].nchunkbyte += b.pools[i].nchunkbyte;
+    }
+    work_add(genp->retiredWork, b.work);
+}
+
+/* Record the use of all pools, and the work of all builders, in the
+** state vector, for "-s" and "-J" */
+static void pool_stats(lemon& lemp)
+{
+    size_t nobj = 0, nbyte = 0, nchunk = 0, nchunkbyte = 0;
+    for (int i = 0; i < NPOOL; i++) {
+        const pool& p = genp->builder.pools[i];
+        const pool& r = genp->retired[i];
+        nobj += p.nobj + r.nobj;
+        nbyte += p.nbyte + r.nbyte;
+        nchunk += p.nchunk + r.nchunk;
+        nchunkbyte += p.nchunkbyte + r.nchunkbyte;
+    }
+    lemp.nArenaObj = (int)nobj;
+    lemp.nArenaChunk = (int)nchunk;
+    lemp.arenaKB = (int)(nchunkbyte / 1024);
+    lemp.arenaUsedKB = (int)(nbyte / 1024);
+    lemp.work = genp->retiredWork;
+    work_add(lemp.work, genp->builder.work);
+}
+
+/* Release everything the generator allocated */
+genctx::~genctx()
+{
+    memhdr* h, * next;
+    for (h = blocks; h; h = next) {
+        next = h->link.next;
+        free(h);
+    }
+}
 
 namespace Action
 {
@@ -274,23 +589,7 @@ namespace Action
 
 /* Allocate a new parser action */
 static action* Action_new(void) {
-    static action* actionfreelist = nullptr;
-    action* newaction;
-
-    if (actionfreelist == nullptr) {
-        int i;
-        int amt = 100;
-        actionfreelist = (action*)calloc(amt, sizeof(action));
-        if (actionfreelist == nullptr) {
-            fprintf(stderr, "Unable to allocate memory for a new parser action.");
-            exit(1);
-        }
-        for (i = 0; i < amt - 1; i++) actionfreelist[i].next = &actionfreelist[i + 1];
-        actionfreelist[amt - 1].next = nullptr;
-    }
-    newaction = actionfreelist;
-    actionfreelist = actionfreelist->next;
-    return newaction;
+    return (action*)pool_alloc(bldp->pools[POOL_ACTION], sizeof(action));
 }
 
 /* Compare two actions for sorting purposes.  Return negative, zero, or
@@ -306,9 +605,14 @@ static int actioncmp(
     if (rc == 0) {
         rc = (int)ap1->type - (int)ap2->type;
     }
-    if (rc == 0 && (ap1->type == e_action::REDUCE || ap1->type == e_action::SHIFTREDUCE)) {
+    if (rc == 0 && (ap1->type == e_action::REDUCE || ap1->type == e_action::SHIFTREDUCE
+        || ap1->type == e_action::RD_RESOLVED || ap1->type == e_action::SRCONFLICT
+        || ap1->type == e_action::RRCONFLICT)) {
         rc = ap1->x.rp->index - ap2->x.rp->index;
     }
+    if (rc == 0 && (ap1->type == e_action::SHIFT || ap1->type == e_action::SSCONFLICT)) {
+        rc = ap1->x.stp->statenum - ap2->x.stp->statenum;
+    }
     if (rc == 0) {
         rc = (int)(ap2 - ap1);
     }
@@ -373,6 +677,13 @@ namespace acctab
 ** array with a single call to acttab_insert().  The acttab_insert() call
 ** also resets the aLookahead[] array in preparation for the next
 ** state number.
+**
+** To find a place for a transaction quickly, the table also keeps a
+** bitmap of the used slots of aAction[], a list of the slots that hold
+** each lookahead value, and for every distance d the number of used
+** slots k with k-aAction[k].lookahead==d.  A transaction placed with its
+** first lookahead at slot i puts all of its entries at distance
+** i-mnLookahead.
 */
 struct lookahead_action {
     int lookahead;             /* Value of the lookahead token */
@@ -392,6 +703,12 @@ struct acttab {
     int nLookaheadAlloc;         /* Slots allocated in aLookahead[] */
     int nterminal;               /* Number of terminal symbols */
     int nsymbol;                 /* total number of symbols */
+    int bestFit;                 /* Take the tightest hole, not the first */
+    setword* aUsed;              /* Bit k is set if aAction[k] is used */
+    setword* aPattern;           /* Bit k set if mnLookahead+k is in aLookahead[] */
+    int* aFirstSlot;             /* First slot holding each lookahead, or -1 */
+    int* aNextSlot;              /* Next slot holding the same lookahead, or -1 */
+    int* aDistance;              /* Used slots at each distance, from -nsymbol */
 };
 
 /* Return the number of entries in the yy_action table */
@@ -405,14 +722,19 @@ struct acttab {
 
 /* Free all memory associated with the given acttab */
 void acttab_free(acttab* p) {
-    delete p->aAction;
-    delete p->aLookahead;
-    delete p;
+    lemon_free(p->aAction);
+    lemon_free(p->aLookahead);
+    lemon_free(p->aUsed);
+    lemon_free(p->aPattern);
+    lemon_free(p->aFirstSlot);
+    lemon_free(p->aNextSlot);
+    lemon_free(p->aDistance);
+    lemon_free(p);
 }
 
 /* Allocate a new acttab structure */
 acttab* acttab_alloc(int nsymbol, int nterminal) {
-    acttab* p = (acttab*)calloc(1, sizeof(*p));
+    acttab* p = (acttab*)lemon_calloc(1, sizeof(*p));
     if (p == nullptr) {
         fprintf(stderr, "Unable to allocate memory for a new acttab.");
         exit(1);
@@ -420,9 +742,57 @@ acttab* acttab_alloc(int nsymbol, int nterminal) {
     memset(p, 0, sizeof(*p));
     p->nsymbol = nsymbol;
     p->nterminal = nterminal;
+    p->aPattern = (setword*)lemon_calloc(nsymbol / 64 + 2, sizeof(setword));
+    p->aFirstSlot = (int*)lemon_calloc(nsymbol + 1, sizeof(int));
+    if (p->aPattern == nullptr || p->aFirstSlot == nullptr) {
+        fprintf(stderr, "Unable to allocate memory for a new acttab.");
+        exit(1);
+    }
+    memset(p->aFirstSlot, -1, (nsymbol + 1) * sizeof(int));
+    return p;
+}
+
+/* Make an acttab that holds the given yy_action[] slots, as pairs of a
+** lookahead and an action, such as were saved in the cache */
+acttab* acttab_restore(int nsymbol, int nterminal, const std::vector<int>& slots) {
+    acttab* p = acttab_alloc(nsymbol, nterminal);
+    int i, n = (int)slots.size() / 2;
+    p->aAction = (lookahead_action*)lemon_calloc(n + 1, sizeof(p->aAction[0]));
+    MemoryCheck(p->aAction);
+    for (i = 0; i < n; i++) {
+        p->aAction[i].lookahead = slots[i * 2];
+        p->aAction[i].action = slots[i * 2 + 1];
+    }
+    p->nAction = p->nActionAlloc = n;
     return p;
 }
 
+/* Return the 64 bits of the used-slot bitmap that begin at slot k */
+static setword acttab_used(const acttab* p, int k)
+{
+    const setword* w = &p->aUsed[k >> 6];
+    const int shift = k & 63;
+    return shift ? (w[0] >> shift) | (w[1] << (64 - shift)) : w[0];
+}
+
+/* Return the number of used slots among the n slots that begin at k */
+static int acttab_nused(const acttab* p, int k, int n)
+{
+    int cnt = 0;
+    for (; n >= 64; k += 64, n -= 64) cnt += SetPopcount(acttab_used(p, k));
+    if (n > 0) cnt += SetPopcount(acttab_used(p, k) & ((setword{ 1 } << n) - 1));
+    return cnt;
+}
+
+/* Return the first slot at or after k that is not used */
+static int acttab_nextfree(const acttab* p, int k)
+{
+    int i = k >> 6;
+    setword w = ~p->aUsed[i] & (~setword{ 0 } << (k & 63));
+    while (w == 0) w = ~p->aUsed[++i];
+    return (i << 6) + SetCtz(w);
+}
+
 /* Add a new action to the current transaction set.
 **
 ** This routine is called once for each lookahead for a particular
@@ -431,7 +801,7 @@ acttab* acttab_alloc(int nsymbol, int nterminal) {
 void acttab_action(acttab* p, int lookahead, int action) {
     if (p->nLookahead >= p->nLookaheadAlloc) {
         p->nLookaheadAlloc += 25;
-        p->aLookahead = (lookahead_action*)realloc(p->aLookahead,
+        p->aLookahead = (lookahead_action*)lemon_realloc(p->aLookahead,
             sizeof(p->aLookahead[0]) * p->nLookaheadAlloc);
         if (p->aLookahead == nullptr) {
             fprintf(stderr, "malloc failed\n");
@@ -471,7 +841,8 @@ void acttab_action(acttab* p, int lookahead, int action) {
 ** makeItSafe can be false.
 */
 int acttab_insert(acttab* p, int makeItSafe) {
-    int i, j, k, n, end;
+    int i, j, k, n, end, nword;
+    int best, nBestUsed;
     assert(p->nLookahead > 0);
 
     /* Make sure we have enough space to hold the expanded action table
@@ -481,10 +852,20 @@ int acttab_insert(acttab* p, int makeItSafe) {
     n = p->nsymbol + 1;
     if (p->nAction + n >= p->nActionAlloc) {
         const int oldAlloc = p->nActionAlloc;
+        const int oldWords = oldAlloc ? (oldAlloc >> 6) + 2 : 0;
+        const int oldDistances = oldAlloc ? oldAlloc + n : 0;
+        int nWords, nDistances;
         p->nActionAlloc = p->nAction + n + p->nActionAlloc + 20;
-        p->aAction = (lookahead_action*)realloc(p->aAction,
+        nWords = (p->nActionAlloc >> 6) + 2;
+        nDistances = p->nActionAlloc + n;
+        p->aAction = (lookahead_action*)lemon_realloc(p->aAction,
             sizeof(p->aAction[0]) * p->nActionAlloc);
-        if (p->aAction == nullptr) {
+        p->aUsed = (setword*)lemon_realloc(p->aUsed, sizeof(setword) * nWords);
+        p->aNextSlot = (int*)lemon_realloc(p->aNextSlot,
+            sizeof(int) * p->nActionAlloc);
+        p->aDistance = (int*)lemon_realloc(p->aDistance, sizeof(int) * nDistances);
+        if (p->aAction == nullptr || p->aUsed == nullptr
+            || p->aNextSlot == nullptr || p->aDistance == nullptr) {
             fprintf(stderr, "malloc failed\n");
             exit(1);
         }
@@ -492,39 +873,36 @@ int acttab_insert(acttab* p, int makeItSafe) {
             p->aAction[i].lookahead = -1;
             p->aAction[i].action = -1;
         }
+        memset(&p->aUsed[oldWords], 0, sizeof(setword) * (nWords - oldWords));
+        memset(&p->aDistance[oldDistances], 0, sizeof(int) * (nDistances - oldDistances));
     }
 
     /* Scan the existing action table looking for an offset that is a
-    ** duplicate of the current transaction set.  Fall out of the loop
-    ** if and when the duplicate is found.
+    ** duplicate of the current transaction set.  Only slots that hold
+    ** p->mnLookahead are candidates, and the largest matching one wins.
     **
     ** i is the index in p->aAction[] where p->mnLookahead is inserted.
     */
     end = makeItSafe ? p->mnLookahead : 0;
-    for (i = p->nAction - 1; i >= end; i--) {
-        if (p->aAction[i].lookahead == p->mnLookahead) {
-            /* All lookaheads and actions in the aLookahead[] transaction
-            ** must match against the candidate aAction[i] entry. */
-            if (p->aAction[i].action != p->mnAction) continue;
-            for (j = 0; j < p->nLookahead; j++) {
-                k = p->aLookahead[j].lookahead - p->mnLookahead + i;
-                if (k < 0 || k >= p->nAction) break;
-                if (p->aLookahead[j].lookahead != p->aAction[k].lookahead) break;
-                if (p->aLookahead[j].action != p->aAction[k].action) break;
-            }
-            if (j < p->nLookahead) continue;
-
-            /* No possible lookahead value that is not in the aLookahead[]
-            ** transaction is allowed to match aAction[i] */
-            n = 0;
-            for (j = 0; j < p->nAction; j++) {
-                if (p->aAction[j].lookahead < 0) continue;
-                if (p->aAction[j].lookahead == j + p->mnLookahead - i) n++;
-            }
-            if (n == p->nLookahead) {
-                break;  /* An exact match is found at offset i */
-            }
+    i = end - 1;
+    for (k = p->aFirstSlot[p->mnLookahead]; k >= 0; k = p->aNextSlot[k]) {
+        if (k <= i) continue;
+        bldp->work.nactOffset++;
+        if (p->aAction[k].action != p->mnAction) continue;
+
+        /* No possible lookahead value that is not in the aLookahead[]
+        ** transaction is allowed to match aAction[k] */
+        if (p->aDistance[k - p->mnLookahead + p->nsymbol] != p->nLookahead) continue;
+
+        /* All lookaheads and actions in the aLookahead[] transaction
+        ** must match against the candidate aAction[k] entry. */
+        for (j = 0; j < p->nLookahead; j++) {
+            n = p->aLookahead[j].lookahead - p->mnLookahead + k;
+            if (n >= p->nAction) break;
+            if (p->aLookahead[j].lookahead != p->aAction[n].lookahead) break;
+            if (p->aLookahead[j].action != p->aAction[n].action) break;
         }
+        if (j == p->nLookahead) i = k;  /* An exact match is found at offset k */
     }
 
     /* If no existing offsets exactly match the current transaction, find an
@@ -534,25 +912,49 @@ int acttab_insert(acttab* p, int makeItSafe) {
     if (i < end) {
         /* Look for holes in the aAction[] table that fit the current
         ** aLookahead[] transaction.  Leave i set to the offset of the hole.
-        ** If no holes are found, i is left at p->nAction, which means the
-        ** transaction will be appended. */
-        i = makeItSafe ? p->mnLookahead : 0;
-        for (; i < p->nActionAlloc - p->mxLookahead; i++) {
-            if (p->aAction[i].lookahead < 0) {
-                for (j = 0; j < p->nLookahead; j++) {
-                    k = p->aLookahead[j].lookahead - p->mnLookahead + i;
-                    if (k < 0) break;
-                    if (p->aAction[k].lookahead >= 0) break;
-                }
-                if (j < p->nLookahead) continue;
-                for (j = 0; j < p->nAction; j++) {
-                    if (p->aAction[j].lookahead == j + p->mnLookahead - i) break;
-                }
-                if (j == p->nAction) {
-                    break;  /* Fits in empty slots */
-                }
+        ** The transaction fits at i if no used slot is at its distance, and
+        ** if its bit pattern, shifted to i, misses every used slot.
+        **
+        ** With p->bestFit, take the hole inside the table whose span has
+        ** the most used slots, and only grow the table if there is none. */
+        nword = (p->mxLookahead - p->mnLookahead) / 64 + 1;
+        for (j = 0; j < p->nLookahead; j++) {
+            k = p->aLookahead[j].lookahead - p->mnLookahead;
+            p->aPattern[k >> 6] |= setword{ 1 } << (k & 63);
+        }
+        end = p->nActionAlloc - p->mxLookahead;
+        best = -1;
+        nBestUsed = -1;
+        for (i = makeItSafe ? p->mnLookahead : 0; i < end; i++) {
+            i = acttab_nextfree(p, i);
+            if (i >= end) {
+                i = end;
+                break;
+            }
+            bldp->work.nactOffset++;
+            if (p->aDistance[i - p->mnLookahead + p->nsymbol] != 0) continue;
+            /* An unused slot holds lookahead -1, so it is at distance
+            ** i-mnLookahead when it is slot i-mnLookahead-1 */
+            j = i - p->mnLookahead - 1;
+            if (j >= 0 && j < p->nAction && p->aAction[j].lookahead < 0) continue;
+            for (k = 0; k < nword; k++) {
+                if (acttab_used(p, i + 64 * k) & p->aPattern[k]) break;
+            }
+            if (k < nword) continue;
+            if (!p->bestFit) break;  /* Fits in empty slots */
+            if (i + p->mxLookahead - p->mnLookahead >= p->nAction
+                || (makeItSafe && i + p->nterminal >= p->nAction)) {
+                if (best < 0) best = i;
+                break;  /* Every later hole grows the table too */
+            }
+            n = acttab_nused(p, i, p->mxLookahead - p->mnLookahead + 1);
+            if (n > nBestUsed) {
+                best = i;
+                nBestUsed = n;
             }
         }
+        if (best >= 0) i = best;
+        memset(p->aPattern, 0, sizeof(setword) * nword);
     }
     /* Insert transaction set at index i. */
 #if 0
@@ -564,6 +966,13 @@ int acttab_insert(acttab* p, int makeItSafe) {
 #endif
     for (j = 0; j < p->nLookahead; j++) {
         k = p->aLookahead[j].lookahead - p->mnLookahead + i;
+        if (p->aAction[k].lookahead < 0) {
+            n = p->aLookahead[j].lookahead;
+            p->aUsed[k >> 6] |= setword{ 1 } << (k & 63);
+            p->aNextSlot[k] = p->aFirstSlot[n];
+            p->aFirstSlot[n] = k;
+            p->aDistance[k - n + p->nsymbol]++;
+        }
         p->aAction[k] = p->aLookahead[j];
         if (k >= p->nAction) p->nAction = k + 1;
     }
@@ -594,6 +1003,65 @@ using namespace acctab;
 ** parser generator.
 */
 
+/* Find the strongly connected components of a directed graph on the
+** vertices 0..n-1.  The edges leaving vertex v are adj[first[v]]
+** through adj[first[v+1]-1].  On return comp[v] is the component that
+** holds v, and the number of components is returned.
+**
+** Components are numbered in reverse topological order: an edge never
+** leads to a component with a larger number than its source.  This is
+** Tarjan's algorithm, run with an explicit stack so that long chains
+** in large grammars cannot overflow the C stack.
+*/
+static int FindComponents(
+    int n,
+    const std::vector<int>& first,
+    const std::vector<int>& adj,
+    std::vector<int>& comp
+) {
+    std::vector<int> num(n, -1), low(n), edge(n), stack, call;
+    int counter = 0, ncomp = 0;
+    int root, v, w;
+
+    comp.assign(n, -1);
+    for (root = 0; root < n; root++) {
+        if (num[root] >= 0) continue;
+        num[root] = low[root] = counter++;
+        edge[root] = first[root];
+        stack.push_back(root);
+        call.push_back(root);
+        while (!call.empty()) {
+            v = call.back();
+            if (edge[v] < first[v + 1]) {
+                w = adj[edge[v]++];
+                if (num[w] < 0) {
+                    num[w] = low[w] = counter++;
+                    edge[w] = first[w];
+                    stack.push_back(w);
+                    call.push_back(w);
+                }
+                else if (comp[w] < 0 && num[w] < low[v]) {
+                    low[v] = num[w];      /* w is still on the stack */
+                }
+                continue;
+            }
+            call.pop_back();
+            if (low[v] == num[v]) {
+                do {
+                    w = stack.back();
+                    stack.pop_back();
+                    comp[w] = ncomp;
+                } while (w != v);
+                ncomp++;
+            }
+            if (!call.empty() && low[v] < low[call.back()]) {
+                low[call.back()] = low[v];
+            }
+        }
+    }
+    return ncomp;
+}
+
 /* Find a precedence symbol of every rule in the grammar.
 **
 ** Those rules which have a precedence symbol coded in the input
@@ -632,12 +1100,21 @@ void FindRulePrecedences(lemon& xp)
 ** Then go back and compute the first sets of every nonterminal.
 ** The first set is the set of all terminal symbols which can begin
 ** a string generated by that nonterminal.
+**
+** Both computations work on the dependency graph between nonterminals
+** rather than iterating over the rules until nothing changes.  Every
+** rule keeps a count of the RHS symbols not yet known to generate the
+** empty string; when the count reaches zero the LHS is a lambda.  First
+** sets are then gathered one strongly connected component at a time,
+** dependencies first, with one union per edge of the graph.
 */
 void FindFirstSets(lemon& lemp)
 {
-    int i, j;
+    int i, j, k, n, ncomp, c;
     rule* rp;
-    int progress;
+    symbol* s1, * s2;
+    std::vector<rule*> rules;
+    std::vector<int> pending, ofirst, occur, queue, first, adj, comp, cstart, members;
 
     for (i = 0; i < lemp.nsymbol; i++) {
         lemp.symbols[i]->lambda = Boolean::LEMON_FALSE;
@@ -645,52 +1122,111 @@ void FindFirstSets(lemon& lemp)
     for (i = lemp.nterminal; i < lemp.nsymbol; i++) {
         lemp.symbols[i]->firstset = SetNew();
     }
+    n = lemp.nsymbol - lemp.nterminal;
+    for (rp = lemp.rule; rp; rp = rp->next) rules.push_back(rp);
 
-    /* First compute all lambdas */
-    do {
-        progress = 0;
-        for (rp = lemp.rule; rp; rp = rp->next) {
-            if (rp->lhs->lambda == Boolean::LEMON_TRUE) continue;
-            for (i = 0; i < rp->nrhs; i++) {
-                const symbol* sp = rp->rhs[i];
-                assert(sp->type == symbol_type::NONTERMINAL || sp->lambda == Boolean::LEMON_FALSE);
-                if (sp->lambda == Boolean::LEMON_FALSE) break;
-            }
-            if (i == rp->nrhs) {
-                rp->lhs->lambda = Boolean::LEMON_TRUE;
-                progress = 1;
-            }
-        }
-    } while (progress);
-
-    /* Now compute all first sets */
-    do {
-        symbol* s1, * s2;
-        progress = 0;
-        for (rp = lemp.rule; rp; rp = rp->next) {
-            s1 = rp->lhs;
-            for (i = 0; i < rp->nrhs; i++) {
-                s2 = rp->rhs[i];
-                if (s2->type == symbol_type::TERMINAL) {
-                    progress += SetAdd(s1->firstset, s2->index);
-                    break;
-                }
-                else if (s2->type == symbol_type::MULTITERMINAL) {
-                    for (j = 0; j < s2->nsubsym; j++) {
-                        progress += SetAdd(s1->firstset, s2->subsym[j]->index);
-                    }
-                    break;
-                }
-                else if (s1 == s2) {
-                    if (s1->lambda == Boolean::LEMON_FALSE) break;
-                }
-                else {
-                    progress += SetUnion(s1->firstset, s2->firstset);
-                    if (s2->lambda == Boolean::LEMON_FALSE) break;
+    /* First compute all lambdas.  occur[] lists, for every nonterminal,
+    ** the rules in which it appears on the RHS, once per appearance. */
+    pending.assign(rules.size(), 0);
+    ofirst.assign(n + 1, 0);
+    for (k = 0; k < (int)rules.size(); k++) {
+        rp = rules[k];
+        for (i = 0; i < rp->nrhs; i++) {
+            if (rp->rhs[i]->type != symbol_type::NONTERMINAL) break;
+        }
+        if (i < rp->nrhs) {
+            pending[k] = -1;            /* Has a terminal.  Never empty */
+            continue;
+        }
+        pending[k] = rp->nrhs;
+        for (i = 0; i < rp->nrhs; i++) ofirst[rp->rhs[i]->index - lemp.nterminal + 1]++;
+    }
+    for (i = 0; i < n; i++) ofirst[i + 1] += ofirst[i];
+    occur.resize(ofirst[n]);
+    {
+        std::vector<int> fill(ofirst.begin(), ofirst.end() - 1);
+        for (k = 0; k < (int)rules.size(); k++) {
+            if (pending[k] < 0) continue;
+            rp = rules[k];
+            for (i = 0; i < rp->nrhs; i++) occur[fill[rp->rhs[i]->index - lemp.nterminal]++] = k;
+        }
+    }
+    for (k = 0; k < (int)rules.size(); k++) {
+        if (pending[k] == 0 && rules[k]->lhs->lambda == Boolean::LEMON_FALSE) {
+            rules[k]->lhs->lambda = Boolean::LEMON_TRUE;
+            queue.push_back(rules[k]->lhs->index - lemp.nterminal);
+        }
+    }
+    for (j = 0; j < (int)queue.size(); j++) {
+        for (i = ofirst[queue[j]]; i < ofirst[queue[j] + 1]; i++) {
+            k = occur[i];
+            if (--pending[k] == 0 && rules[k]->lhs->lambda == Boolean::LEMON_FALSE) {
+                rules[k]->lhs->lambda = Boolean::LEMON_TRUE;
+                queue.push_back(rules[k]->lhs->index - lemp.nterminal);
+            }
+        }
+    }
+
+    /* Add the terminals which directly begin each rule, and record an
+    ** edge s1->s2 whenever the first set of s2 flows into that of s1 */
+    std::vector<std::vector<int>> deps(n);
+    for (rp = lemp.rule; rp; rp = rp->next) {
+        s1 = rp->lhs;
+        for (i = 0; i < rp->nrhs; i++) {
+            s2 = rp->rhs[i];
+            if (s2->type == symbol_type::TERMINAL) {
+                SetAdd(s1->firstset, s2->index);
+                break;
+            }
+            else if (s2->type == symbol_type::MULTITERMINAL) {
+                for (j = 0; j < s2->nsubsym; j++) {
+                    SetAdd(s1->firstset, s2->subsym[j]->index);
                 }
+                break;
             }
+            else if (s1 == s2) {
+                if (s1->lambda == Boolean::LEMON_FALSE) break;
+            }
+            else {
+                deps[s1->index - lemp.nterminal].push_back(s2->index - lemp.nterminal);
+                if (s2->lambda == Boolean::LEMON_FALSE) break;
+            }
+        }
+    }
+    for (i = 0; i < n; i++) {
+        first.push_back((int)adj.size());
+        adj.insert(adj.end(), deps[i].begin(), deps[i].end());
+    }
+    first.push_back((int)adj.size());
+    ncomp = FindComponents(n, first, adj, comp);
+    bldp->work.nfirstComp += ncomp;
+
+    /* Bucket the nonterminals by component */
+    cstart.assign(ncomp + 1, 0);
+    for (i = 0; i < n; i++) cstart[comp[i] + 1]++;
+    for (c = 0; c < ncomp; c++) cstart[c + 1] += cstart[c];
+    members.resize(n);
+    {
+        std::vector<int> fill(cstart.begin(), cstart.end() - 1);
+        for (i = 0; i < n; i++) members[fill[comp[i]]++] = i;
+    }
+
+    /* Now compute all first sets.  The components are numbered so that
+    ** every edge leads to a component that has already been finished. */
+    for (c = 0; c < ncomp; c++) {
+        setword* set = lemp.symbols[lemp.nterminal + members[cstart[c]]]->firstset;
+        for (k = cstart[c]; k < cstart[c + 1]; k++) {
+            s1 = lemp.symbols[lemp.nterminal + members[k]];
+            for (i = first[members[k]]; i < first[members[k] + 1]; i++) {
+                if (comp[adj[i]] == c) continue;
+                SetUnion(s1->firstset, lemp.symbols[lemp.nterminal + adj[i]]->firstset);
+            }
+            if (k > cstart[c]) SetUnion(set, s1->firstset);
+        }
+        for (k = cstart[c] + 1; k < cstart[c + 1]; k++) {
+            SetUnion(lemp.symbols[lemp.nterminal + members[k]]->firstset, set);
         }
-    } while (progress);
+    }
     return;
 }
 
@@ -698,11 +1234,33 @@ void FindFirstSets(lemon& lemp)
 ** are added to between some states so that the LR(1) follow sets
 ** can be computed later.
 */
-PRIVATE state* getstate(lemon&);  /* forward reference */
+PRIVATE state* getstate(lemon&, std::atomic<int>&, int*);  /* forward reference */
+PRIVATE symbol* buildbasis(config**);   /* forward reference */
+PRIVATE void addshift(state*, symbol*, state*);  /* forward reference */
+PRIVATE void FindStatesParallel(lemon&, state*, std::atomic<int>&);
+
+/* A state on the explicit stack of FindStates.  The successors of "stp"
+** have been built for every configuration before "cfp".  "from" and
+** "sp" give the shift that first reached "stp".  That shift action is
+** added once "stp" is finished, in the same order as a depth-first
+** recursion would add it.
+*/
+struct shiftframe {
+    state* stp;      /* The state whose successors are being built */
+    config* cfp;     /* The next configuration of "stp" to look at */
+    state* from;     /* The state that shifts into "stp", or NULL */
+    symbol* sp;      /* The symbol shifted from "from" into "stp" */
+};
+
 void FindStates(lemon& lemp)
 {
     symbol* sp;
     rule* rp;
+    state* stp;
+    state* from;
+    int isNew;
+    std::vector<shiftframe> stack;
+    std::atomic<int> nstate(0);
 
     Configlist_init();
 
@@ -748,21 +1306,162 @@ void FindStates(lemon& lemp)
         SetAdd(newcfp->fws, 0);
     }
 
-    /* Compute the first state.  All other states will be
-    ** computed automatically during the computation of the first one.
-    ** The returned pointer to the first state is not used. */
-    (void)getstate(lemp);
+    /* Compute the first state, then every state reachable from it.
+    ** States are expanded depth-first from an explicit stack so that
+    ** deep grammars do not exhaust the native stack.  States receive
+    ** their numbers in the order in which they are first reached. */
+    stp = getstate(lemp, nstate, &isNew);
+    if (lemp.nthread > 1) {
+        FindStatesParallel(lemp, stp, nstate);
+        lemp.nstate = nstate;
+        return;
+    }
+    stack.push_back({ stp, stp->cfp, nullptr, nullptr });
+    while (!stack.empty()) {
+        shiftframe& top = stack.back();
+        sp = buildbasis(&top.cfp);
+        if (sp == nullptr) {
+            /* All successors of this state are done */
+            if (top.from) addshift(top.from, top.sp, top.stp);
+            stack.pop_back();
+            continue;
+        }
+        from = top.stp;
+        stp = getstate(lemp, nstate, &isNew);
+        if (isNew) {
+            stack.push_back({ stp, stp->cfp, from, sp });
+        }
+        else {
+            addshift(from, sp, stp);
+        }
+    }
+    lemp.nstate = nstate;
     return;
 }
 
+/* States waiting to be expanded by the threads of FindStatesParallel */
+struct statequeue {
+    std::mutex mutex;
+    std::condition_variable ready;   /* Signalled when work is added or done */
+    std::vector<state*> pending;     /* States whose successors are not built */
+    int busy = 0;                    /* Threads expanding a state right now */
+};
+
+/* The body of each thread of FindStatesParallel.  Take states off the
+** queue and build their successors until no thread has work left.
+** Each thread builds configurations with its own cfgbuilder.
+*/
+PRIVATE void expandstates(genctx* ctx, statequeue& q, std::atomic<int>& nstate)
+{
+    cfgbuilder builder;
+    genscope scope(ctx, &builder);
+    lemon& lemp = ctx->lem;
+    std::vector<state*> found;
+    state* stp, * newstp;
+    config* cfp;
+    symbol* sp;
+    int isNew;
+
+    Configlist_init();
+    std::unique_lock<std::mutex> lock(q.mutex);
+    for (;;) {
+        while (q.pending.empty() && q.busy > 0) q.ready.wait(lock);
+        if (q.pending.empty()) break;
+        stp = q.pending.back();
+        q.pending.pop_back();
+        q.busy++;
+        lock.unlock();
+
+        for (cfp = stp->cfp; (sp = buildbasis(&cfp)) != nullptr; ) {
+            newstp = getstate(lemp, nstate, &isNew);
+            addshift(stp, sp, newstp);
+            if (isNew) found.push_back(newstp);
+        }
+
+        lock.lock();
+        q.busy--;
+        q.pending.insert(q.pending.end(), found.rbegin(), found.rend());
+        if (!found.empty() || q.busy == 0) q.ready.notify_all();
+        found.clear();
+    }
+    lock.unlock();
+    pool_retire(builder);
+}
+
+/* Build every state reachable from "first" on lemp.nthread threads.
+**
+** The threads number states in whatever order they happen to create
+** them, so the states are renumbered afterwards into the order that the
+** serial depth-first construction would have used.  That order is
+** recovered from the shift actions: each thread adds them in the order
+** in which the successors were built.
+*/
+PRIVATE void FindStatesParallel(lemon& lemp, state* first, std::atomic<int>& nstate)
+{
+    statequeue q;
+    std::vector<std::thread> pool;
+    std::vector<std::pair<state*, std::vector<state*>>> stack;
+    state** all;
+    action* ap;
+    int i, n, num;
+
+    q.pending.push_back(first);
+    for (i = 0; i < lemp.nthread; i++) {
+        pool.emplace_back(expandstates, genp, std::ref(q), std::ref(nstate));
+    }
+    for (auto& t : pool) t.join();
+
+    /* Renumber the states in depth-first preorder.  The action list of a
+    ** state holds its shifts newest first, with one action for each
+    ** subsymbol of a multiterminal. */
+    n = nstate;
+    all = State_arrayof();
+    MemoryCheck(all);
+    for (i = 0; i < n; i++) all[i]->statenum = -1;
+    lemon_free(all);
+    num = 0;
+    first->statenum = num++;
+    stack.emplace_back(first, std::vector<state*>());
+    for (ap = first->ap; ap; ap = ap->next) {
+        if (stack.back().second.empty() || stack.back().second.back() != ap->x.stp) {
+            stack.back().second.push_back(ap->x.stp);
+        }
+    }
+    while (!stack.empty()) {
+        state* stp;
+        if (stack.back().second.empty()) {
+            stack.pop_back();
+            continue;
+        }
+        stp = stack.back().second.back();
+        stack.back().second.pop_back();
+        if (stp->statenum >= 0) continue;
+        stp->statenum = num++;
+        stack.emplace_back(stp, std::vector<state*>());
+        for (ap = stp->ap; ap; ap = ap->next) {
+            if (stack.back().second.empty() || stack.back().second.back() != ap->x.stp) {
+                stack.back().second.push_back(ap->x.stp);
+            }
+        }
+    }
+    assert(num == n);
+}
+
 /* Return a pointer to a state which is described by the configuration
-** list which has been built from calls to Configlist_add.
+** list which has been built from calls to Configlist_add.  *pIsNew is
+** set to true if the state did not exist before.  The successors of a
+** new state are not computed here; see FindStates.
+**
+** This may be called from several threads at once.  The state table
+** is locked while the state is looked up and, if it is new, inserted.
+** The closure of a new state is then computed without the lock; other
+** threads only touch the basis of a state once it is in the table.
 */
-PRIVATE void buildshifts(lemon&, state*); /* Forwd ref */
-PRIVATE state* getstate(lemon& lemp)
+PRIVATE state* getstate(lemon& lemp, std::atomic<int>& nstate, int* pIsNew)
 {
     config* cfp, * bp;
     state* stp;
+    uint64_t fp;
 
     /* Extract the sorted basis of the new state.  The basis was constructed
     ** by prior calls to "Configlist_addbasis()". */
@@ -770,33 +1469,48 @@ PRIVATE state* getstate(lemon& lemp)
     bp = Configlist_basis();
 
     /* Get a state with the same basis */
-    stp = State_find(bp);
-    if (stp) {
-        /* A state with the same basis already exists!  Copy all the follow-set
-        ** propagation links from the state under construction into the
-        ** preexisting state, then return a pointer to the preexisting state */
-        config* x, * y;
-        for (x = bp, y = stp->bp; x && y; x = x->bp, y = y->bp) {
-            Plink_copy(&y->bplp, x->bplp);
-            Plink_delete(x->fplp);
-            x->fplp = x->bplp = nullptr;
+    fp = State_fingerprint(bp);
+    {
+        std::lock_guard<std::mutex> lock(State_lock(fp));
+        stp = State_find(bp, fp);
+        if (stp) {
+            /* A state with the same basis already exists!  Copy all the follow-set
+            ** propagation links from the state under construction into the
+            ** preexisting state, then return a pointer to the preexisting state */
+            config* x, * y;
+            for (x = bp, y = stp->bp; x && y; x = x->bp, y = y->bp) {
+                Plink_copy(&y->bplp, x->bplp);
+                Plink_delete(x->fplp);
+                x->fplp = x->bplp = nullptr;
+            }
+        }
+        else {
+            /* This really is a new state.  Enter it in the table */
+            stp = State_new();           /* A new state structure */
+            MemoryCheck(stp);
+            stp->bp = bp;                /* Remember the configuration basis */
+            stp->statenum = nstate++;    /* Every state gets a sequence number */
+            stp->ap = nullptr;           /* No actions, yet. */
+            stp->fingerprint = fp;       /* Remember the basis hash */
+            State_insert(stp);           /* Add to the state table */
         }
+    }
+    if (stp->bp != bp) {
         cfp = Configlist_return();
         Configlist_eat(cfp);
+        *pIsNew = 0;
     }
     else {
-        /* This really is a new state.  Construct all the details */
+        /* Construct all the details of the new state */
         Configlist_closure(lemp);    /* Compute the configuration closure */
         Configlist_sort();           /* Sort the configuration closure */
         cfp = Configlist_return();   /* Get a pointer to the config list */
-        stp = State_new();           /* A new state structure */
-        MemoryCheck(stp);
-        stp->bp = bp;                /* Remember the configuration basis */
         stp->cfp = cfp;              /* Remember the configuration closure */
-        stp->statenum = lemp.nstate++; /* Every state gets a sequence number */
-        stp->ap = nullptr;                 /* No actions, yet. */
-        State_insert(stp, stp->bp);   /* Add to the state table */
-        buildshifts(lemp, stp);       /* Recursively compute successor states */
+
+        /* Each configuration becomes complete after it contributes to a
+        ** successor state.  Initially, all configurations are incomplete */
+        for (cfp = stp->cfp; cfp; cfp = cfp->next) cfp->status = cfgstatus::INCOMPLETE;
+        *pIsNew = 1;
     }
     return stp;
 }
@@ -817,30 +1531,27 @@ int same_symbol(const symbol& a, const symbol& b)
     return 1;
 }
 
-/* Construct all successor states to the given state.  A "successor"
-** state is any state which can be reached by a shift action.
+/* Build the basis of the next successor of a state.  *pcfp is the next
+** configuration of the state to look at.  The basis is constructed with
+** calls to Configlist_addbasis(), and the symbol shifted to reach the
+** successor is returned.  *pcfp is advanced past the configuration used.
+** NULL is returned when the state has no more successors.
 */
-PRIVATE void buildshifts(lemon& lemp, state* stp)
+PRIVATE symbol* buildbasis(config** pcfp)
 {
-    config* cfp;  /* For looping thru the config closure of "stp" */
-    config* bcfp; /* For the inner loop on config closure of "stp" */
+    config* cfp;  /* For looping thru the config closure of the state */
+    config* bcfp; /* For the inner loop on config closure of the state */
     config* newcfg;  /* */
     symbol* sp;   /* Symbol following the dot in configuration "cfp" */
     symbol* bsp;  /* Symbol following the dot in configuration "bcfp" */
-    state* newstp; /* A pointer to a successor state */
-
-    /* Each configuration becomes complete after it contributes to a successor
-    ** state.  Initially, all configurations are incomplete */
-    for (cfp = stp->cfp; cfp; cfp = cfp->next) cfp->status = cfgstatus::INCOMPLETE;
 
-    /* Loop through all configurations of the state "stp" */
-    for (cfp = stp->cfp; cfp; cfp = cfp->next) {
+    for (cfp = *pcfp; cfp; cfp = cfp->next) {
         if (cfp->status == cfgstatus::COMPLETE) continue; /* Already used by inner loop */
         if (cfp->dot >= cfp->rp->nrhs) continue;          /* Can't shift this config */
         Configlist_reset();                               /* Reset the new config set */
         sp = cfp->rp->rhs[cfp->dot];                      /* Symbol after the dot */
 
-        /* For every configuration in the state "stp" which has the symbol "sp"
+        /* For every configuration in the state which has the symbol "sp"
         ** following its dot, add the same configuration to the basis set under
         ** construction but with the dot shifted one symbol to the right. */
         for (bcfp = cfp; bcfp; bcfp = bcfp->next) {
@@ -852,23 +1563,27 @@ PRIVATE void buildshifts(lemon& lemp, state* stp)
             newcfg = Configlist_addbasis(bcfp->rp, bcfp->dot + 1);
             Plink_add(&newcfg->bplp, bcfp);
         }
+        *pcfp = cfp->next;
+        return sp;
+    }
+    *pcfp = nullptr;
+    return nullptr;
+}
 
-        /* Get a pointer to the state described by the basis configuration set
-        ** constructed in the preceding loop */
-        newstp = getstate(lemp);
-
-        /* The state "newstp" is reached from the state "stp" by a shift action
-        ** on the symbol "sp" */
-        if (sp->type == symbol_type::MULTITERMINAL) {
-            int i;
-            for (i = 0; i < sp->nsubsym; i++) {
-                Action_add(&stp->ap, e_action::SHIFT, sp->subsym[i], (char*)newstp);
-            }
-        }
-        else {
-            Action_add(&stp->ap, e_action::SHIFT, sp, (char*)newstp);
+/* The state "newstp" is reached from the state "stp" by a shift action
+** on the symbol "sp".  Record that action.
+*/
+PRIVATE void addshift(state* stp, symbol* sp, state* newstp)
+{
+    if (sp->type == symbol_type::MULTITERMINAL) {
+        int i;
+        for (i = 0; i < sp->nsubsym; i++) {
+            Action_add(&stp->ap, e_action::SHIFT, sp->subsym[i], (char*)newstp);
         }
     }
+    else {
+        Action_add(&stp->ap, e_action::SHIFT, sp, (char*)newstp);
+    }
 }
 
 /*
@@ -908,37 +1623,66 @@ void FindLinks(lemon& lemp)
 **
 ** A followset is the set of all symbols which can come immediately
 ** after a configuration.
+**
+** Follow-sets flow along the forward propagation links.  Every config
+** in a strongly connected component of the link graph ends up with
+** the same follow-set, so each component is collapsed to a single set
+** first.  Components are then visited in topological order, and each
+** link between components is followed exactly once.
 */
 void FindFollowSets(lemon& lemp)
 {
-    int i;
+    std::vector<config*> cfgs;
+    std::vector<int> first, adj, comp, cstart, members;
+    int i, n, ncomp, c, k, v;
     config* cfp;
     plink* plp;
-    int progress;
-    int change;
 
     for (i = 0; i < lemp.nstate; i++) {
         for (cfp = lemp.sorted[i]->cfp; cfp; cfp = cfp->next) {
-            cfp->status = cfgstatus::INCOMPLETE;
+            cfp->index = (int)cfgs.size();
+            cfgs.push_back(cfp);
         }
     }
+    n = (int)cfgs.size();
+    first.reserve(n + 1);
+    for (v = 0; v < n; v++) {
+        first.push_back((int)adj.size());
+        for (plp = cfgs[v]->fplp; plp; plp = plp->next) {
+            adj.push_back(plp->cfp->index);
+        }
+    }
+    first.push_back((int)adj.size());
+    ncomp = FindComponents(n, first, adj, comp);
+    bldp->work.nfollowComp += ncomp;
 
-    do {
-        progress = 0;
-        for (i = 0; i < lemp.nstate; i++) {
-            for (cfp = lemp.sorted[i]->cfp; cfp; cfp = cfp->next) {
-                if (cfp->status == cfgstatus::COMPLETE) continue;
-                for (plp = cfp->fplp; plp; plp = plp->next) {
-                    change = SetUnion(plp->cfp->fws, cfp->fws);
-                    if (change) {
-                        plp->cfp->status = cfgstatus::INCOMPLETE;
-                        progress = 1;
-                    }
-                }
-                cfp->status = cfgstatus::COMPLETE;
+    /* Bucket the configs by component */
+    cstart.assign(ncomp + 1, 0);
+    for (v = 0; v < n; v++) cstart[comp[v] + 1]++;
+    for (c = 0; c < ncomp; c++) cstart[c + 1] += cstart[c];
+    members.resize(n);
+    {
+        std::vector<int> fill(cstart.begin(), cstart.end() - 1);
+        for (v = 0; v < n; v++) members[fill[comp[v]]++] = v;
+    }
+
+    for (c = ncomp - 1; c >= 0; c--) {
+        setword* fws = cfgs[members[cstart[c]]]->fws;
+        if (cstart[c + 1] - cstart[c] > 1) {
+            for (k = cstart[c] + 1; k < cstart[c + 1]; k++) {
+                SetUnion(fws, cfgs[members[k]]->fws);
+            }
+            for (k = cstart[c] + 1; k < cstart[c + 1]; k++) {
+                SetUnion(cfgs[members[k]]->fws, fws);
             }
         }
-    } while (progress);
+        for (k = cstart[c]; k < cstart[c + 1]; k++) {
+            v = members[k];
+            for (i = first[v]; i < first[v + 1]; i++) {
+                if (comp[adj[i]] != c) SetUnion(cfgs[adj[i]]->fws, fws);
+            }
+        }
+    }
 }
 
 static int resolve_conflict(action*, action*);
@@ -961,12 +1705,10 @@ void FindActions(lemon& lemp)
         stp = lemp.sorted[i];
         for (cfp = stp->cfp; cfp; cfp = cfp->next) {  /* Loop over all configurations */
             if (cfp->rp->nrhs == cfp->dot) {        /* Is dot at extreme right? */
-                for (j = 0; j < lemp.nterminal; j++) {
-                    if (SetFind(cfp->fws, j)) {
-                        /* Add a reduce action to the state "stp" which will reduce by the
-                        ** rule "cfp->rp" if the lookahead symbol is "lemp.symbols[j]" */
-                        Action_add(&stp->ap, e_action::REDUCE, lemp.symbols[j], (char*)cfp->rp);
-                    }
+                for (j = SetNext(cfp->fws, 0); j >= 0 && j < lemp.nterminal; j = SetNext(cfp->fws, j + 1)) {
+                    /* Add a reduce action to the state "stp" which will reduce by the
+                    ** rule "cfp->rp" if the lookahead symbol is "lemp.symbols[j]" */
+                    Action_add(&stp->ap, e_action::REDUCE, lemp.symbols[j], (char*)cfp->rp);
                 }
             }
         }
@@ -1104,28 +1846,28 @@ static int resolve_conflict(
 ** in the LEMON parser generator.
 */
 
-static config* freelist = nullptr;      /* List of free configurations */
-static config* current = nullptr;       /* Top of list of configurations */
-static config** currentend = nullptr;   /* Last on list of configs */
-static config* basis = nullptr;         /* Top of list of basis configs */
-static config** basisend = nullptr;     /* End of list of basis configs */
+/* The configuration list builder lives in the cfgbuilder of the current
+** thread.  These name its fields. */
+#define freelist   (bldp->freelist)
+#define current    (bldp->current)
+#define currentend (bldp->currentend)
+#define basis      (bldp->basis)
+#define basisend   (bldp->basisend)
 
 /* Return a pointer to a new configuration */
 PRIVATE config* newconfig(void) {
     config* newcfg;
+    bldp->work.nconfig++;
     if (freelist == nullptr) {
-        int i;
-        int amt = 3;
-        freelist = (config*)calloc(amt, sizeof(config));
-        if (freelist == nullptr) {
-            fprintf(stderr, "Unable to allocate memory for a new configuration.");
-            exit(1);
-        }
-        for (i = 0; i < amt - 1; i++) freelist[i].next = &freelist[i + 1];
-        freelist[amt - 1].next = nullptr;
+        /* The follow set of a configuration is placed right after it */
+        newcfg = (config*)pool_alloc(bldp->pools[POOL_CONFIG],
+            sizeof(config) + genp->setwords * sizeof(setword));
+        newcfg->fws = (setword*)&newcfg[1];
+        return newcfg;
     }
     newcfg = freelist;
     freelist = freelist->next;
+    memset(newcfg->fws, 0, genp->setwords * sizeof(setword));
     return newcfg;
 }
 
@@ -1173,7 +1915,6 @@ config* Configlist_add(
         cfp = newconfig();
         cfp->rp = rp;
         cfp->dot = dot;
-        cfp->fws = SetNew();
         cfp->stp = nullptr;
         cfp->fplp = cfp->bplp = nullptr;
         cfp->next = nullptr;
@@ -1199,7 +1940,6 @@ config* Configlist_addbasis(Rule::rule* rp, int dot)
         cfp = newconfig();
         cfp->rp = rp;
         cfp->dot = dot;
-        cfp->fws = SetNew();
         cfp->stp = nullptr;
         cfp->fplp = cfp->bplp = nullptr;
         cfp->next = nullptr;
@@ -1229,6 +1969,7 @@ void Configlist_closure(lemon& lemp)
         sp = rp->rhs[dot];
         if (sp->type == symbol_type::NONTERMINAL) {
             if (sp->rule == nullptr && sp != lemp.errsym) {
+                std::lock_guard<std::mutex> lock(genp->errorLock);
                 ErrorMsg(lemp.filename, rp->line, "Nonterminal \"%s\" has no rules.",
                     sp->name);
                 lemp.errorcnt++;
@@ -1304,12 +2045,16 @@ void Configlist_eat(config* cfp)
         nextcfp = cfp->next;
         assert(cfp->fplp == nullptr);
         assert(cfp->bplp == nullptr);
-        if (cfp->fws) SetFree(cfp->fws);
         deleteconfig(cfp);
     }
     return;
 }
 }
+#undef freelist
+#undef current
+#undef currentend
+#undef basis
+#undef basisend
 /***************** From the file "error.c" *********************************/
 /*
 ** Code for printing error message.
@@ -1325,7 +2070,8 @@ void ErrorMsg(const char* filename, int lineno, const char* format, ...) {
 }
 /**************** From the file "main.c" ************************************/
 /*
-** Main program file for the LEMON parser generator.
+** The library interface of the LEMON parser generator.  The command
+** line program that drives it is in lemon_main.cpp.
 */
 
 /* Report an out-of-memory condition and abort.  This function
@@ -1336,52 +2082,6 @@ void memory_error(void) {
     exit(1);
 }
 
-static int nDefine = 0;      /* Number of -D options on the command line */
-static char** azDefine = nullptr;  /* Name of the -D macros */
-
-/* This routine is called with the argument to each -D command-line option.
-** Add the macro defined to the azDefine array.
-*/
-static void handle_D_option(char* z) {
-    char** paz;
-    nDefine++;
-    azDefine = (char**)realloc(azDefine, sizeof(azDefine[0]) * nDefine);
-    if (azDefine == nullptr) {
-        fprintf(stderr, "out of memory\n");
-        exit(1);
-    }
-    paz = &azDefine[nDefine - 1];
-    *paz = new char[lemonStrlen(z) + 1];
-    if (*paz == nullptr) {
-        fprintf(stderr, "out of memory\n");
-        exit(1);
-    }
-    lemon_strcpy(*paz, z);
-    for (z = *paz; *z && *z != '='; z++) {}
-    *z = 0;
-}
-
-/* Rember the name of the output directory
-*/
-static char* outputDir = NULL;
-static void handle_d_option(const char* z) {
-    outputDir = new char[lemonStrlen(z) + 1]; //std::string or std::string_view
-    if (outputDir == nullptr) {
-        fprintf(stderr, "out of memory\n");
-        exit(1);
-    }
-    lemon_strcpy(outputDir, z);
-}
-
-static char* user_templatename = NULL;
-static void handle_T_option(const char* z) {
-    user_templatename = new char[lemonStrlen(z) + 1];
-    if (user_templatename == nullptr) {
-        memory_error();
-    }
-    lemon_strcpy(user_templatename, z);
-}
-
 /* Merge together to lists of rules ordered by rule.iRule */
 static rule* Rule_merge(rule* pA, rule* pB) {
     rule* pFirst = nullptr;
@@ -1435,93 +2135,57 @@ static rule* Rule_sort(rule* rp) {
 /* forward reference */
 static const char* minimum_size_type(int lwr, int upr, int* pnByte);
 
-/* Print a single line of the "Parser Stats" output
-*/
-static void stats_line(const char* zLabel, int iValue) {
-    const int nLabel = lemonStrlen(zLabel);
-    printf("  %s%.*s %5d\n", zLabel,
-        35 - nLabel, "................................",
-        iValue);
-}
-
-static char** g_argv;
-static std::vector<s_options> op;
-static FILE* errstream;
-
-
-/* The main program.  Parse the command line and do it... */
-int main(int argc, char** argv) {
-    static int version = 0;
-    static int rpflag = 0;
-    static int basisflag = 0;
-    static int compress = 0;
-    static int quiet = 0;
-    static int statistics = 0;
-    static int mhflag = 0;
-    static int nolinenosflag = 0;
-    static int noResort = 0;
-    static int sqlFlag = 0;
-    static int printPP = 0;
-
-    op = {
-      {OPT_FLAG, "b", (char*)&basisflag, "Print only the basis in report."},
-      {OPT_FLAG, "c", (char*)&compress, "Don't compress the action table."},
-      {OPT_FSTR, "d", (char*)&handle_d_option, "Output directory.  Default '.'"},
-      {OPT_FSTR, "D", (char*)handle_D_option, "Define an %ifdef macro."},
-      {OPT_FLAG, "E", (char*)&printPP, "Print input file after preprocessing."},
-      {OPT_FSTR, "f", 0, "Ignored.  (Placeholder for -f compiler options.)"},
-      {OPT_FLAG, "g", (char*)&rpflag, "Print grammar without actions."},
-      {OPT_FSTR, "I", 0, "Ignored.  (Placeholder for '-I' compiler options.)"},
-      {OPT_FLAG, "m", (char*)&mhflag, "Output a makeheaders compatible file."},
-      {OPT_FLAG, "l", (char*)&nolinenosflag, "Do not print #line statements."},
-      {OPT_FSTR, "O", 0, "Ignored.  (Placeholder for '-O' compiler options.)"},
-      {OPT_FLAG, "p", (char*)&showPrecedenceConflict,
-                      "Show conflicts resolved by precedence rules"},
-      {OPT_FLAG, "q", (char*)&quiet, "(Quiet) Don't print the report file."},
-      {OPT_FLAG, "r", (char*)&noResort, "Do not sort or renumber states"},
-      {OPT_FLAG, "s", (char*)&statistics,
-                                     "Print parser stats to standard output."},
-      {OPT_FLAG, "S", (char*)&sqlFlag,
-                      "Generate the *.sql file describing the parser tables."},
-      {OPT_FLAG, "x", (char*)&version, "Print the version number."},
-      {OPT_FSTR, "T", (char*)handle_T_option, "Specify a template file."},
-      {OPT_FSTR, "W", 0, "Ignored.  (Placeholder for '-W' compiler options.)"}
-    };
-    int i;
-    int exitcode;
-    lemon lem;
-    rule* rp;
+/* Create a generator with the given options.  Nothing is read or
+** written until the phases are run. */
+lemon::Generator::Generator(const Options& options)
+    : ctx(new genctx)
+{
+    genscope scope(ctx);
+    lemon& lem = ctx->lem;
 
-    (void)argc;
-    OptInit(*argv);
-    if (version) {
-        printf("Lemon version 1.0\n");
-        exit(0);
-    }
-    if (OptNArgs() != 1) {
-        fprintf(stderr, "Exactly one filename argument is required.\n");
-        exit(1);
+    ctx->opt = options;
+    for (auto& zDef : ctx->opt.defines) {
+        auto eq = zDef.find('=');
+        if (eq != std::string::npos) zDef.resize(eq);
     }
-    memset(&lem, 0, sizeof(lem));
-    lem.errorcnt = 0;
 
     /* Initialize the machine */
     Strsafe_init();
     Symbol_init();
     State_init();
-    lem.argv0 = argv[0];
-    lem.filename = OptArg(0);
-    lem.basisflag = basisflag;
-    lem.nolinenosflag = nolinenosflag;
-    lem.printPreprocessed = printPP;
-    Symbol_new("$");
+    lem.argv0 = lemon_strdup(ctx->opt.argv0.c_str());
+    lem.basisflag = ctx->opt.basisOnly;
+    lem.nolinenosflag = ctx->opt.noLineNumbers;
+    lem.printPreprocessed = ctx->opt.printPreprocessed;
+    lem.nthread = ctx->opt.nthread > 0 ? ctx->opt.nthread : 1;
+}
+
+lemon::Generator::~Generator()
+{
+    delete ctx;
+}
+
+/* Read the grammar in the file "filename", then number its symbols
+** and rules. */
+int lemon::Generator::parse(const char* filename)
+{
+    genscope scope(ctx);
+    lemon& lem = ctx->lem;
+    Rule::rule* rp;
+    int i;
+
+    lem.filename = lemon_strdup(filename);
+    Symbol_new("$");
 
     /* Parse the input file */
-    Parse(lem);
-    if (lem.printPreprocessed || lem.errorcnt) exit(lem.errorcnt);
+    {
+        phasetimer timer(e_phase::PARSE);
+        Parse(lem);
+    }
+    if (lem.printPreprocessed || lem.errorcnt) return lem.errorcnt;
     if (lem.nrule == 0) {
         fprintf(stderr, "Empty grammar.\n");
-        exit(1);
+        return ++lem.errorcnt;
     }
     lem.errsym = Symbol_find("error");
 
@@ -1564,77 +2228,147 @@ int main(int argc, char** argv) {
     }
     lem.startRule = lem.rule;
     lem.rule = Rule_sort(lem.rule);
+    return lem.errorcnt;
+}
+
+/* Print the grammar without its actions on standard output */
+void lemon::Generator::reprint()
+{
+    genscope scope(ctx);
+    Reprint(ctx->lem);
+}
 
-    /* Generate a reprint of the grammar, if requested on the command line */
-    if (rpflag) {
-        Reprint(lem);
+/* Build the LR(0) automaton, the follow-sets and the actions */
+int lemon::Generator::analyse()
+{
+    genscope scope(ctx);
+    lemon& lem = ctx->lem;
+
+    /* Initialize the size for all follow and first sets */
+    SetSize(lem.nterminal + 1);
+
+    /* With -K, take the automaton from the cache if the structure of the
+    ** grammar is the same as when the cache was written */
+    if (ctx->opt.cache && !ctx->opt.inMemory) {
+        ctx->cacheKey = Cache_key(lem);
+        ctx->cached = Cache_load(lem) != 0;
+        if (ctx->cached) {
+            pool_stats(lem);
+            return lem.errorcnt;
+        }
     }
-    else {
-        /* Initialize the size for all follow and first sets */
-        SetSize(lem.nterminal + 1);
 
-        /* Find the precedence for every production rule (that has one) */
-        FindRulePrecedences(lem);
+    /* Find the precedence for every production rule (that has one) */
+    FindRulePrecedences(lem);
 
-        /* Compute the lambda-nonterminals and the first-sets for every
-        ** nonterminal */
+    /* Compute the lambda-nonterminals and the first-sets for every
+    ** nonterminal */
+    {
+        phasetimer timer(e_phase::FIRST_SETS);
         FindFirstSets(lem);
+    }
+    lem.firstsetusec = lem.phaseusec[(int)e_phase::FIRST_SETS];
 
-        /* Compute all LR(0) states.  Also record follow-set propagation
-        ** links so that the follow-set can be computed later */
+    /* Compute all LR(0) states.  Also record follow-set propagation
+    ** links so that the follow-set can be computed later */
+    {
+        phasetimer timer(e_phase::STATES);
         lem.nstate = 0;
         FindStates(lem);
         lem.sorted = State_arrayof();
+    }
 
-        /* Tie up loose ends on the propagation links */
+    /* Tie up loose ends on the propagation links */
+    {
+        phasetimer timer(e_phase::LINKS);
         FindLinks(lem);
+    }
 
-        /* Compute the follow set of every reducible configuration */
+    /* Compute the follow set of every reducible configuration */
+    {
+        phasetimer timer(e_phase::FOLLOW_SETS);
         FindFollowSets(lem);
+    }
 
-        /* Compute the action tables */
+    /* Compute the action tables */
+    {
+        phasetimer timer(e_phase::ACTIONS);
         FindActions(lem);
+    }
+    pool_stats(lem);
+    return lem.errorcnt;
+}
 
-        /* Compress the action tables */
-        if (compress == 0) CompressTables(lem);
+/* Compress the action tables, then reorder and renumber the states */
+int lemon::Generator::compress()
+{
+    genscope scope(ctx);
+    lemon& lem = ctx->lem;
+
+    /* A cached automaton was saved after these steps */
+    if (ctx->cached) return lem.errorcnt;
+
+    /* Compress the action tables */
+    if (!ctx->opt.noCompress) {
+        phasetimer timer(e_phase::COMPRESS);
+        CompressTables(lem);
+    }
 
-        /* Reorder and renumber the states so that states with fewer choices
-        ** occur at the end.  This is an optimization that helps make the
-        ** generated parser tables smaller. */
-        if (noResort == 0) ResortStates(lem);
+    /* Reorder and renumber the states so that states with fewer choices
+    ** occur at the end.  This is an optimization that helps make the
+    ** generated parser tables smaller. */
+    if (!ctx->opt.noResort) {
+        phasetimer timer(e_phase::RESORT);
+        ResortStates(lem);
+    }
+    return lem.errorcnt;
+}
 
-        /* Generate a report of the parser generated.  (the "y.output" file) */
-        if (!quiet) ReportOutput(lem);
+/* Write the report, the parser and its header */
+int lemon::Generator::emit()
+{
+    genscope scope(ctx);
+    lemon& lem = ctx->lem;
 
-        /* Generate the source code for the parser */
-        ReportTable(lem, mhflag, sqlFlag);
+    /* Generate a report of the parser generated.  (the "y.output" file) */
+    if (!ctx->opt.quiet) {
+        phasetimer timer(e_phase::REPORT_OUTPUT);
+        ReportOutput(lem);
+    }
 
-        /* Produce a header file for use by the scanner.  (This step is
-        ** omitted if the "-m" option is used because makeheaders will
-        ** generate the file for us.) */
-        if (!mhflag) ReportHeader(lem);
+    /* Generate the source code for the parser */
+    {
+        phasetimer timer(e_phase::REPORT_TABLE);
+        ReportTable(lem, ctx->opt.makeHeaders, ctx->opt.sql);
     }
-    if (statistics) {
-        printf("Parser statistics:\n");
-        stats_line("terminal symbols", lem.nterminal);
-        stats_line("non-terminal symbols", lem.nsymbol - lem.nterminal);
-        stats_line("total symbols", lem.nsymbol);
-        stats_line("rules", lem.nrule);
-        stats_line("states", lem.nxstate);
-        stats_line("conflicts", lem.nconflict);
-        stats_line("action table entries", lem.nactiontab);
-        stats_line("lookahead table entries", lem.nlookaheadtab);
-        stats_line("total table size (bytes)", lem.tablesize);
+
+    /* Produce a header file for use by the scanner.  (This step is
+    ** omitted if the "-m" option is used because makeheaders will
+    ** generate the file for us.) */
+    if (!ctx->opt.makeHeaders) {
+        phasetimer timer(e_phase::REPORT_HEADER);
+        ReportHeader(lem);
     }
-    if (lem.nconflict > 0) {
-        fprintf(stderr, "%d parsing conflicts.\n", lem.nconflict);
+    pool_stats(lem);
+
+    /* Keep the automaton for the next run, if it is free of problems */
+    if (ctx->opt.cache && !ctx->opt.inMemory && !ctx->cached
+        && lem.errorcnt == 0 && lem.nconflict == 0) {
+        Cache_save(lem);
     }
+    return lem.errorcnt;
+}
 
-    /* return 0 on success, 1 on failure. */
-    exitcode = ((lem.errorcnt > 0) || (lem.nconflict > 0)) ? 1 : 0;
-    exit(exitcode);
-    return (exitcode);
+const lemon& lemon::Generator::result() const
+{
+    return ctx->lem;
+}
+
+const std::map<std::string, std::string>& lemon::Generator::outputs() const
+{
+    return ctx->outputs;
 }
+
 /******************** From the file "msort.c" *******************************/
 /*
 ** A generic merge-sort program.
@@ -1760,265 +2494,6 @@ static char* msort(
     for (i = 0; i < LISTSIZE; i++) if (set[i]) ep = merge(set[i], ep, cmp, offset);
     return ep;
 }
-/************************ From the file "option.c" **************************/
-
-
-#define ISOPT(X) ((X)[0]=='-'||(X)[0]=='+'||strchr((X),'=')!=0)
-
-/*
-** Print the command line with a carrot pointing to the k-th character
-** of the n-th field.
-*/
-static void errline(int n, int k)
-{
-    int spcnt, i;
-    if (g_argv[0])
-    {
-        std::cerr << g_argv[0];
-    }
-    spcnt = lemonStrlen(g_argv[0]) + 1;
-    for (i = 1; i < n && g_argv[i]; i++) {
-        std::cerr << " " << g_argv[i];
-        spcnt += lemonStrlen(g_argv[i]) + 1;
-    }
-    spcnt += k;
-    for (; g_argv[i]; i++)
-    {
-        std::cerr << " " << g_argv[i];
-    }
-    if (spcnt < 20) {
-        std::cerr << "\n" << std::setw(spcnt) << "" << "^-- here\n";
-    }
-    else {
-        std::cerr << "\n" << std::setw(spcnt - 7) << "" << "here --^\n";
-    }
-}
-
-/*
-** Return the index of the N-th non-switch argument.  Return -1
-** if N is out of range.
-*/
-static int argindex(int n)
-{
-    int i;
-    int dashdash = 0;
-    if (g_argv != nullptr && *g_argv != nullptr) {
-        for (i = 1; g_argv[i]; i++) {
-            if (dashdash || !ISOPT(g_argv[i])) {
-                if (n == 0) return i;
-                n--;
-            }
-            if (strcmp(g_argv[i], "--") == 0) dashdash = 1;
-        }
-    }
-    return -1;
-}
-
-static char emsg[] = "Command line syntax error: ";
-
-/*
-** Process a flag command line argument.
-*/
-static int handleflags(int i)
-{
-    int v;
-    int errcnt = 0;
-    int j;
-    for (j = 0; j < op.size(); j++) {
-        if (strncmp(&g_argv[i][1], op[j].label, lemonStrlen(op[j].label)) == 0) break;
-    }
-    v = g_argv[i][0] == '-' ? 1 : 0;
-    if (op[j].label == nullptr) {
-        std::cerr << emsg << "undefined option.\n";
-        errline(i, 1);
-        errcnt++;
-    }
-    else if (op[j].arg == nullptr) {
-        /* Ignore this option */
-    }
-    else if (op[j].type == OPT_FLAG) {
-        *((int*)op[j].arg) = v;
-    }
-    else if (op[j].type == OPT_FFLAG) {
-        (*(void(*)(int))(op[j].arg))(v);
-    }
-    else if (op[j].type == OPT_FSTR) {
-        (*(void(*)(char*))(op[j].arg))(&g_argv[i][2]);
-    }
-    else {
-        std::cerr << emsg << "missing argument on switch.\n";
-        errline(i, 1);
-
-        errcnt++;
-    }
-    return errcnt;
-}
-
-/*
-** Process a command line switch which has an argument.
-*/
-static int handleswitch(int i)
-{
-    int lv = 0;
-    double dv = 0.0;
-    char* sv = nullptr, * end;
-    char* cp;
-    int j;
-    int errcnt = 0;
-    cp = strchr(g_argv[i], '=');
-    assert(cp != nullptr);
-    *cp = 0;
-    for (j = 0; j < op.size(); j++) {
-        if (strcmp(g_argv[i], op[j].label) == 0) break;
-    }
-    *cp = '=';
-    if (op[j].label == nullptr) {
-        std::cerr << emsg << "undefined option.\n";
-        errline(i, 0);
-
-        errcnt++;
-    }
-    else {
-        cp++;
-        switch (op[j].type) {
-        case OPT_FLAG:
-        case OPT_FFLAG:
-            std::cerr << emsg << "option requires an argument.\n";
-            errline(i, 0);
-
-            errcnt++;
-            break;
-        case OPT_DBL:
-        case OPT_FDBL:
-            dv = strtod(cp, &end);
-            if (*end) {
-                std::cerr << emsg << "illegal character in floating-point argument.\n";
-                errline(i, (int)((char*)end - (char*)g_argv[i]));
-
-                errcnt++;
-            }
-            break;
-        case OPT_INT:
-        case OPT_FINT:
-            lv = strtol(cp, &end, 0);
-            if (*end) {
-
-                    std::cerr << emsg << "illegal character in integer argument.\n";
-                    errline(i, (int)((char*)end - (char*)g_argv[i]));
-                errcnt++;
-            }
-            break;
-        case OPT_STR:
-        case OPT_FSTR:
-            sv = cp;
-            break;
-        }
-        switch (op[j].type) {
-        case OPT_FLAG:
-        case OPT_FFLAG:
-            break;
-        case OPT_DBL:
-            *(double*)(op[j].arg) = dv;
-            break;
-        case OPT_FDBL:
-            (*(void(*)(double))(op[j].arg))(dv);
-            break;
-        case OPT_INT:
-            *(int*)(op[j].arg) = lv;
-            break;
-        case OPT_FINT:
-            (*(void(*)(int))(op[j].arg))((int)lv);
-            break;
-        case OPT_STR:
-            *(char**)(op[j].arg) = sv;
-            break;
-        case OPT_FSTR:
-            (*(void(*)(char*))(op[j].arg))(sv);
-            break;
-        }
-    }
-    return errcnt;
-}
-
-int OptInit(char*& a)
-{
-    int errcnt = 0;
-    g_argv = &a;
-    if (g_argv && *g_argv) {
-        int i;
-        for (i = 1; g_argv[i]; i++) {
-            if (g_argv[i][0] == '+' || g_argv[i][0] == '-') {
-                errcnt += handleflags(i);
-            }
-            else if (strchr(g_argv[i], '=')) {
-                errcnt += handleswitch(i);
-            }
-        }
-    }
-    if (errcnt > 0) {
-        std::cerr << "Valid command line options for \"" << a << "\" are:\n";
-        OptPrint();
-        exit(1);
-    }
-    return 0;
-}
-
-int OptNArgs(void) {
-    int cnt = 0;
-    int dashdash = 0;
-    int i;
-    if (g_argv != nullptr && g_argv[0] != nullptr) {
-        for (i = 1; g_argv[i]; i++) {
-            if (dashdash || !ISOPT(g_argv[i])) cnt++;
-            if (strcmp(g_argv[i], "--") == 0) dashdash = 1;
-        }
-    }
-    return cnt;
-}
-
-char* OptArg(int n)
-{
-    int i;
-    i = argindex(n);
-    return i >= 0 ? g_argv[i] : nullptr;
-}
-
-void OptErr(int n)
-{
-    int i;
-    i = argindex(n);
-    if (i >= 0) errline(i, 0);
-}
-
-void OptPrint() {
-
-    auto type_name = [](auto type) {
-        switch (type) {
-        case OPT_FLAG:
-        case OPT_FFLAG:
-            return "";
-        //case OPT_INT:
-        //case OPT_FINT:
-        //    return "<integer>";
-        //case OPT_DBL:
-        //case OPT_FDBL:
-        //    return "<real>";
-        case OPT_STR:
-        case OPT_FSTR:
-            return "<string>";
-        }
-
-        return "";
-    };
-
-    size_t max = std::transform_reduce(op.begin(), op.end(), 0u, [](auto x, auto y) { return std::max(x, y); }, [&](const auto& e) {
-            return strlen(e.label) + strlen(type_name(e.type));
-        });
-
-    std::for_each(op.begin(), op.end(), [&](const auto& e) {
-        std::cerr << "  -" << e.label << std::setw(max - strlen(e.label)) << type_name(e.type) << "   " << e.message << "\n";
-    });
-}
 /*********************** From the file "parse.c" ****************************/
 /*
 ** Input file parser for the LEMON parser generator.
@@ -2054,7 +2529,8 @@ struct pstate {
     char* filename;       /* Name of the input file */
     int tokenlineno;      /* Linenumber at which current token starts */
     int errorcnt;         /* Number of errors so far */
-    char* tokenstart;     /* Text of current token */
+    std::string_view token; /* Text of current token */
+    int tokenid;          /* Interned id of the text of the current token */
     lemon* gp;     /* Global state vector */
     e_state state;        /* The state of the parser */
     symbol* fallback;   /* The fallback token */
@@ -2079,7 +2555,7 @@ struct pstate {
 static void parseonetoken(pstate* psp)
 {
     const char* x;
-    x = Strsafe(psp->tokenstart);     /* Save the token permanently */
+    x = Strsafe_str(psp->tokenid);    /* The token, saved permanently */
 #if 0
     printf("%s:%d: Token=[%s] state=%d\n", psp->filename, psp->tokenlineno,
         x, psp->state);
@@ -2096,7 +2572,7 @@ static void parseonetoken(pstate* psp)
             psp->state = e_state::WAITING_FOR_DECL_KEYWORD;
         }
         else if (ISLOWER(x[0])) {
-            psp->lhs = Symbol_new(x);
+            psp->lhs = Symbol_fromid(psp->tokenid);
             psp->nrhs = 0;
             psp->lhsalias = nullptr;
             psp->state = e_state::WAITING_FOR_ARROW;
@@ -2151,7 +2627,7 @@ static void parseonetoken(pstate* psp)
             psp->errorcnt++;
         }
         else {
-            psp->prevrule->precsym = Symbol_new(x);
+            psp->prevrule->precsym = Symbol_fromid(psp->tokenid);
         }
         psp->state = e_state::PRECEDENCE_MARK_2;
         break;
@@ -2217,7 +2693,7 @@ static void parseonetoken(pstate* psp)
     case e_state::IN_RHS:
         if (x[0] == '.') {
             rule* rp;
-            rp = (rule*)calloc(sizeof(rule) +
+            rp = (rule*)lemon_calloc(sizeof(rule) +
                 sizeof(symbol*) * psp->nrhs + sizeof(char*) * psp->nrhs, 1);
             if (rp == nullptr) {
                 ErrorMsg(psp->filename, psp->tokenlineno,
@@ -2265,7 +2741,7 @@ static void parseonetoken(pstate* psp)
                 psp->state = e_state::RESYNC_AFTER_RULE_ERROR;
             }
             else {
-                psp->rhs[psp->nrhs] = Symbol_new(x);
+                psp->rhs[psp->nrhs] = Symbol_fromid(psp->tokenid);
                 psp->alias[psp->nrhs] = 0;
                 psp->nrhs++;
             }
@@ -2274,17 +2750,17 @@ static void parseonetoken(pstate* psp)
             symbol* msp = psp->rhs[psp->nrhs - 1];
             if (msp->type != symbol_type::MULTITERMINAL) {
                 symbol* origsp = msp;
-                msp = (symbol*)calloc(1, sizeof(*msp));
+                msp = (symbol*)lemon_calloc(1, sizeof(*msp));
                 memset(msp, 0, sizeof(*msp));
                 msp->type = symbol_type::MULTITERMINAL;
                 msp->nsubsym = 1;
-                msp->subsym = (symbol**)calloc(1, sizeof(symbol*));
+                msp->subsym = (symbol**)lemon_calloc(1, sizeof(symbol*));
                 msp->subsym[0] = origsp;
                 msp->name = origsp->name;
                 psp->rhs[psp->nrhs - 1] = msp;
             }
             msp->nsubsym++;
-            msp->subsym = (symbol**)realloc(msp->subsym,
+            msp->subsym = (symbol**)lemon_realloc(msp->subsym,
                 sizeof(symbol*) * msp->nsubsym);
             msp->subsym[msp->nsubsym - 1] = Symbol_new(&x[1]);
             if (ISLOWER(x[1]) || ISLOWER(msp->subsym[0]->name[0])) {
@@ -2446,7 +2922,7 @@ static void parseonetoken(pstate* psp)
             psp->state = e_state::RESYNC_AFTER_DECL_ERROR;
         }
         else {
-            symbol* sp = Symbol_new(x);
+            symbol* sp = Symbol_fromid(psp->tokenid);
             psp->declargslot = &sp->destructor;
             psp->decllinenoslot = &sp->destLineno;
             psp->insertLineMacro = 1;
@@ -2470,7 +2946,7 @@ static void parseonetoken(pstate* psp)
             }
             else {
                 if (!sp) {
-                    sp = Symbol_new(x);
+                    sp = Symbol_fromid(psp->tokenid);
                 }
                 psp->declargslot = &sp->datatype;
                 psp->insertLineMacro = 0;
@@ -2484,7 +2960,7 @@ static void parseonetoken(pstate* psp)
         }
         else if (ISUPPER(x[0])) {
             symbol* sp;
-            sp = Symbol_new(x);
+            sp = Symbol_fromid(psp->tokenid);
             if (sp->prec >= 0) {
                 ErrorMsg(psp->filename, psp->tokenlineno,
                     "Symbol \"%s\" has already be given a precedence.", x);
@@ -2531,7 +3007,7 @@ static void parseonetoken(pstate* psp)
                 nLine = lemonStrlen(zLine);
                 n += nLine + lemonStrlen(psp->filename) + nBack;
             }
-            *psp->declargslot = (char*)realloc(*psp->declargslot, n);
+            *psp->declargslot = (char*)lemon_realloc(*psp->declargslot, n);
             zBuf = *psp->declargslot + nOld;
             if (addLineMacro) {
                 if (nOld && zBuf[-1] != '\n') {
@@ -2574,7 +3050,7 @@ static void parseonetoken(pstate* psp)
             psp->errorcnt++;
         }
         else {
-            symbol* sp = Symbol_new(x);
+            symbol* sp = Symbol_fromid(psp->tokenid);
             if (psp->fallback == nullptr) {
                 psp->fallback = sp;
             }
@@ -2608,7 +3084,7 @@ static void parseonetoken(pstate* psp)
             psp->errorcnt++;
         }
         else {
-            (void)Symbol_new(x);
+            (void)Symbol_fromid(psp->tokenid);
         }
         break;
     case e_state::WAITING_FOR_WILDCARD_ID:
@@ -2621,7 +3097,7 @@ static void parseonetoken(pstate* psp)
             psp->errorcnt++;
         }
         else {
-            symbol* sp = Symbol_new(x);
+            symbol* sp = Symbol_fromid(psp->tokenid);
             if (psp->gp->wildcard == nullptr) {
                 psp->gp->wildcard = sp;
             }
@@ -2646,7 +3122,7 @@ static void parseonetoken(pstate* psp)
             psp->state = e_state::RESYNC_AFTER_DECL_ERROR;
         }
         else {
-            psp->tkclass = Symbol_new(x);
+            psp->tkclass = Symbol_fromid(psp->tokenid);
             psp->tkclass->type = symbol_type::MULTITERMINAL;
             psp->state = e_state::WAITING_FOR_CLASS_TOKEN;
         }
@@ -2658,10 +3134,10 @@ static void parseonetoken(pstate* psp)
         else if (ISUPPER(x[0]) || ((x[0] == '|' || x[0] == '/') && ISUPPER(x[1]))) {
             symbol* msp = psp->tkclass;
             msp->nsubsym++;
-            msp->subsym = (symbol**)realloc(msp->subsym,
+            msp->subsym = (symbol**)lemon_realloc(msp->subsym,
                 sizeof(symbol*) * msp->nsubsym);
-            if (!ISUPPER(x[0])) x++;
-            msp->subsym[msp->nsubsym - 1] = Symbol_new(x);
+            msp->subsym[msp->nsubsym - 1] = ISUPPER(x[0]) ?
+                Symbol_fromid(psp->tokenid) : Symbol_new(&x[1]);
         }
         else {
             ErrorMsg(psp->filename, psp->tokenlineno,
@@ -2744,13 +3220,13 @@ static int eval_preprocessor_boolean(char* z, int lineno) {
             continue;
         }
         if (ISALPHA(z[i])) {
-            int j, k, n;
+            int k, n;
             if (!okTerm) goto pp_syntax_error;
             for (k = i + 1; ISALNUM(z[k]) || z[k] == '_'; k++) {}
             n = k - i;
             res = 0;
-            for (j = 0; j < nDefine; j++) {
-                if (strncmp(azDefine[j], &z[i], n) == 0 && azDefine[j][n] == 0) {
+            for (const auto& zDef : genp->opt.defines) {
+                if (zDef.compare(0, std::string::npos, &z[i], n) == 0) {
                     res = 1;
                     break;
                 }
@@ -2771,166 +3247,379 @@ pp_syntax_error:
     if (lineno > 0) {
         fprintf(stderr, "%%if syntax error on line %d.\n", lineno);
         fprintf(stderr, "  %.*s <-- syntax error here\n", i + 1, z);
-        exit(1);
     }
-    else {
-        return -(i + 1);
+    return -(i + 1);
+}
+
+/* A read-only view of the whole of a file, mapped into memory.  The
+** text is never written to, so the pages may be shared with any other
+** process or generator that reads the same file.
+*/
+struct srcmap {
+    const char* z = nullptr;  /* First byte of the file */
+    size_t n = 0;             /* Size of the file in bytes */
+#ifdef __WIN32__
+    HANDLE hFile = INVALID_HANDLE_VALUE;
+    HANDLE hMap = nullptr;
+#endif
+
+    srcmap() = default;
+    srcmap(const srcmap&) = delete;
+    srcmap& operator=(const srcmap&) = delete;
+    ~srcmap();
+
+    /* Map the file.  Return non-zero if it cannot be read. */
+    int open(const char* filename);
+};
+
+#ifdef __WIN32__
+int srcmap::open(const char* filename)
+{
+    LARGE_INTEGER size;
+    hFile = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (hFile == INVALID_HANDLE_VALUE) return 1;
+    if (!GetFileSizeEx(hFile, &size)) return 1;
+    n = (size_t)size.QuadPart;
+    if (n == 0) {
+        z = "";
+        return 0;
     }
+    hMap = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (hMap == nullptr) return 1;
+    z = (const char*)MapViewOfFile(hMap, FILE_MAP_READ, 0, 0, 0);
+    return z == nullptr;
+}
+
+srcmap::~srcmap()
+{
+    if (z && n) UnmapViewOfFile(z);
+    if (hMap) CloseHandle(hMap);
+    if (hFile != INVALID_HANDLE_VALUE) CloseHandle(hFile);
+}
+#else
+int srcmap::open(const char* filename)
+{
+    struct stat st;
+    void* p;
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) return 1;
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return 1;
+    }
+    n = (size_t)st.st_size;
+    if (n == 0) {
+        close(fd);
+        z = "";
+        return 0;
+    }
+    p = mmap(nullptr, n, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (p == MAP_FAILED) return 1;
+    z = (const char*)p;
+    return 0;
+}
+
+srcmap::~srcmap()
+{
+    if (z && n) munmap((void*)z, n);
 }
+#endif
 
-/* Run the preprocessor over the input file text.  The global variables
-** azDefine[0] through azDefine[nDefine-1] contains the names of all defined
-** macros.  This routine looks for "%ifdef" and "%ifndef" and "%endif" and
-** comments them out.  Text in between is also commented out as appropriate.
+/* The text of the grammar as the scanner sees it.  This is the mapped
+** file, up to its first NUL byte, except that the lines removed by the
+** preprocessor read as blanks.  Those lines are kept as a sorted list of
+** disjoint ranges rather than written over, and every byte in them other
+** than a newline reads as a space.
+**
+** The preprocessor runs inside the scanner rather than as a pass of its
+** own.  Before the scanner reads past the next "%ifdef", "%ifndef",
+** "%if", "%else" or "%endif" at the start of a line, that directive is
+** handled: its condition is evaluated once and, if the text after it is
+** excluded, memchr() hops from one '%' to the next until the matching
+** "%else" or "%endif" turns up.  The excluded text is not otherwise
+** looked at, and the scanner steps over it in one go.
 */
-static void preprocess_input(char* z) {
-    int i, j, k;
-    int exclude = 0;
-    int start = 0;
-    int lineno = 1;
-    int start_lineno = 1;
-    for (i = 0; z[i]; i++) {
-        if (z[i] == '\n') lineno++;
-        if (z[i] != '%' || (i > 0 && z[i - 1] != '\n')) continue;
-        if (strncmp(&z[i], "%endif", 6) == 0 && ISSPACE(z[i + 6])) {
-            if (exclude) {
-                exclude--;
-                if (exclude == 0) {
-                    for (j = start; j < i; j++) if (z[j] != '\n') z[j] = ' ';
-                }
-            }
-            for (j = i; z[j] && z[j] != '\n'; j++) z[j] = ' ';
+struct srctext {
+    const char* z;                                  /* The text */
+    size_t n;                                       /* Bytes in the text */
+    std::vector<std::pair<size_t, size_t>> blank;   /* Ranges [lo,hi) read as blanks */
+    size_t cur = 0;                                 /* Range last looked at */
+    size_t ppnext = 0;                              /* Next directive not yet handled */
+    int pperr = 0;                                  /* True after a preprocessor error */
+
+    srctext(const char* zText, size_t nText)
+        : z(zText), n(nText)
+    {
+        const char* zNul = (const char*)memchr(z, 0, n);
+        if (zNul) n = zNul - z;
+        ppnext = nextdirective(0);
+    }
+
+    /* Return the byte at offset i, or 0 past the end of the text */
+    char at(size_t i)
+    {
+        if (i >= ppnext) preprocess(i);
+        if (i >= n) return 0;
+        if (z[i] != '\n' && blanked(i)) return ' ';
+        return z[i];
+    }
+
+    /* If offset i is blank, return the end of its blank range.  Otherwise
+    ** return i. */
+    size_t skipblank(size_t i)
+    {
+        if (i >= ppnext) preprocess(i);
+        return (i < n && blanked(i)) ? blank[cur].second : i;
+    }
+
+    /* Return the text from offset lo up to hi.  This points into the file
+    ** unless some of it has been blanked, in which case it is copied into
+    ** buf with the blanks applied. */
+    std::string_view text(size_t lo, size_t hi, std::string& buf)
+    {
+        auto it = std::partition_point(blank.begin(), blank.end(),
+            [lo](const std::pair<size_t, size_t>& r) { return r.second <= lo; });
+        if (it == blank.end() || it->first >= hi) {
+            return std::string_view(z + lo, hi - lo);
         }
-        else if (strncmp(&z[i], "%else", 5) == 0 && ISSPACE(z[i + 5])) {
-            if (exclude == 1) {
-                exclude = 0;
-                for (j = start; j < i; j++) if (z[j] != '\n') z[j] = ' ';
-            }
-            else if (exclude == 0) {
-                exclude = 1;
-                start = i;
-                start_lineno = lineno;
+        buf.resize(hi - lo);
+        for (size_t i = lo; i < hi; i++) buf[i - lo] = at(i);
+        return buf;
+    }
+
+    /* Write the text, with the blanks applied, to out */
+    void print(FILE* out)
+    {
+        size_t i = 0;
+        std::string buf;
+        for (const auto& r : blank) {
+            fwrite(z + i, 1, r.first - i, out);
+            fwrite(text(r.first, r.second, buf).data(), 1, r.second - r.first, out);
+            i = r.second;
+        }
+        fwrite(z + i, 1, n - i, out);
+    }
+
+    /* Handle every directive up to and including offset i.  Return
+    ** non-zero after reporting an error, in which case the text is cut
+    ** short so that the scanner stops. */
+    int preprocess(size_t i);
+
+private:
+    /* Return true if offset i is in a blank range, and leave cur at
+    ** that range */
+    bool blanked(size_t i)
+    {
+        if (blank.empty()) return false;
+        while (cur < blank.size() && blank[cur].second <= i) cur++;
+        while (cur > 0 && blank[cur - 1].second > i) cur--;
+        return cur < blank.size() && blank[cur].first <= i;
+    }
+
+    /* Read the bytes from lo up to hi as blanks */
+    void clear(size_t lo, size_t hi)
+    {
+        if (lo >= hi) return;
+        if (!blank.empty() && blank.back().second >= lo) {
+            blank.back().second = std::max(blank.back().second, hi);
+        }
+        else {
+            blank.emplace_back(lo, hi);
+        }
+    }
+
+    /* Return the offset of the newline that ends the line holding i,
+    ** or the end of the text */
+    size_t eol(size_t i) const
+    {
+        const char* zNl = (const char*)memchr(z + i, '\n', n - i);
+        return zNl ? zNl - z : n;
+    }
+
+    /* Return the line number of offset i */
+    int linenoof(size_t i) const
+    {
+        return 1 + (int)std::count(z, z + i, '\n');
+    }
+
+    /* Return true if the text at offset i starts with the directive zDir
+    ** followed by white space */
+    bool isdirective(size_t i, const char* zDir) const
+    {
+        size_t k = strlen(zDir);
+        return n - i > k && memcmp(z + i, zDir, k) == 0 && ISSPACE(z[i + k]);
+    }
+
+    /* Return true if there is an "%if", "%ifdef" or "%ifndef" at offset i.
+    ** Unlike the other directives, these must be followed by a space. */
+    bool isif(size_t i) const
+    {
+        return (n - i >= 7 && memcmp(z + i, "%ifdef ", 7) == 0)
+            || (n - i >= 4 && memcmp(z + i, "%if ", 4) == 0)
+            || (n - i >= 8 && memcmp(z + i, "%ifndef ", 8) == 0);
+    }
+
+    /* Return the offset of the first directive at or after offset i, or
+    ** the end of the text if there are no more */
+    size_t nextdirective(size_t i) const
+    {
+        const char* zPct;
+        while (i < n && (zPct = (const char*)memchr(z + i, '%', n - i)) != nullptr) {
+            i = zPct - z;
+            if ((i == 0 || z[i - 1] == '\n')
+                && (isdirective(i, "%endif") || isdirective(i, "%else") || isif(i))) {
+                return i;
             }
-            for (j = i; z[j] && z[j] != '\n'; j++) z[j] = ' ';
+            i++;
         }
-        else if (strncmp(&z[i], "%ifdef ", 7) == 0
-            || strncmp(&z[i], "%if ", 4) == 0
-            || strncmp(&z[i], "%ifndef ", 8) == 0) {
-            if (exclude) {
-                exclude++;
+        return n;
+    }
+
+    /* The text from offset start, the start of an "%if" or "%else" line,
+    ** is excluded.  Blank it as far as the matching "%else" or "%endif"
+    ** and return the offset after that directive's line. */
+    size_t exclude(size_t start)
+    {
+        int depth = 1;
+        size_t i = start;
+        while ((i = nextdirective(eol(i))) < n) {
+            if (isdirective(i, "%endif")) {
+                if (--depth == 0) break;
+            }
+            else if (isdirective(i, "%else")) {
+                if (depth == 1) break;
             }
             else {
-                int isNot;
-                int iBool;
-                for (j = i; z[j] && !ISSPACE(z[j]); j++) {}
-                iBool = j;
-                isNot = (j == i + 7);
-                while (z[j] && z[j] != '\n') { j++; }
-                k = z[j];
-                z[j] = 0;
-                exclude = eval_preprocessor_boolean(&z[iBool], lineno);
-                z[j] = k;
-                if (!isNot) exclude = !exclude;
-                if (exclude) {
-                    start = i;
-                    start_lineno = lineno;
-                }
+                depth++;
+            }
+        }
+        if (i >= n) {
+            fprintf(stderr, "unterminated %%ifdef starting on line %d\n", linenoof(start));
+            pperr = 1;
+            return n;
+        }
+        clear(start, eol(i));
+        return eol(i);
+    }
+};
+
+int srctext::preprocess(size_t i)
+{
+    while (!pperr && ppnext <= i && ppnext < n) {
+        size_t d = ppnext;
+        size_t next = eol(d);
+        if (isdirective(d, "%else")) {
+            /* The text up to the matching "%endif" is excluded */
+            next = exclude(d);
+        }
+        else if (isif(d)) {
+            int isNot;
+            int exclude_;
+            size_t iBool, j;
+            for (j = d; j < n && !ISSPACE(z[j]); j++) {}
+            iBool = j;
+            isNot = (j == d + 7);
+            std::string zBool(z + iBool, eol(d) - iBool);
+            exclude_ = eval_preprocessor_boolean(&zBool[0], -1);
+            if (exclude_ < 0) {
+                /* Evaluate again to report the error and its line */
+                eval_preprocessor_boolean(&zBool[0], linenoof(d));
+                pperr = 1;
+                break;
             }
-            for (j = i; z[j] && z[j] != '\n'; j++) z[j] = ' ';
+            if (!isNot) exclude_ = !exclude_;
+            if (exclude_) next = exclude(d);
         }
+        clear(d, next);
+        ppnext = pperr ? n : nextdirective(next);
     }
-    if (exclude) {
-        fprintf(stderr, "unterminated %%ifdef starting on line %d\n", start_lineno);
-        exit(1);
+    if (pperr) {
+        n = 0;
+        ppnext = SIZE_MAX;
     }
+    return pperr;
 }
 
-/* In spite of its name, this function is really a scanner.  It read
-** in the entire input file (all at once) then tokenizes it.  Each
-** token is passed to the function "parseonetoken" which builds all
-** the appropriate data structures in the global state vector "gp".
+/* In spite of its name, this function is really a scanner.  It maps
+** the entire input file into memory then tokenizes it.  Each token is
+** passed to the function "parseonetoken" which builds all the
+** appropriate data structures in the global state vector "gp".  The
+** file is only read; a token is a view of the text, not a copy.
 */
 void Parse(lemon& gp)
 {
-    pstate ps;
-    FILE* fp;
-    char* filebuf;
-    unsigned int filesize;
+    pstate ps{};
+    srcmap map;
+    std::string buf;
     int lineno;
-    int c;
-    char* cp, * nextcp;
+    char c;
+    size_t cp, nextcp;
     constexpr int startline = 0;
 
-    memset(&ps, '\0', sizeof(ps));
     ps.gp = &gp;
     ps.filename = gp.filename;
     ps.errorcnt = 0;
     ps.state = e_state::INITIALIZE;
 
-    /* Begin by reading the input file */
-    fp = fopen(ps.filename, "rb");
-    if (fp == nullptr) {
+    /* Begin by mapping the input file */
+    if (map.open(ps.filename)) {
         ErrorMsg(ps.filename, 0, "Can't open this file for reading.");
         gp.errorcnt++;
         return;
     }
-    fseek(fp, 0, 2);
-    filesize = ftell(fp);
-    rewind(fp);
-    filebuf = new char[filesize + 1];
-    if (filesize > 100000000 || filebuf == nullptr) {
-        ErrorMsg(ps.filename, 0, "Input file too large.");
-        delete[] filebuf;
-        gp.errorcnt++;
-        fclose(fp);
-        return;
-    }
-    if (fread(filebuf, 1, filesize, fp) != filesize) {
-        ErrorMsg(ps.filename, 0, "Can't read in all %d bytes of this file.",
-            filesize);
-        delete[] filebuf;
-        gp.errorcnt++;
-        fclose(fp);
-        return;
-    }
-    fclose(fp);
-    filebuf[filesize] = 0;
+    srctext src(map.z, map.n);
 
-    /* Make an initial pass through the file to handle %ifdef and %ifndef */
-    preprocess_input(filebuf);
+    /* With -E, handle all of the %ifdef and %ifndef then print the text */
     if (gp.printPreprocessed) {
-        printf("%s\n", filebuf);
+        if (src.preprocess(SIZE_MAX)) {
+            gp.errorcnt++;
+            return;
+        }
+        src.print(stdout);
+        printf("\n");
         return;
     }
 
-    /* Now scan the text of the input file */
+    /* Now scan the text of the input file.  Directives are handled as
+    ** the scanner comes to them. */
     lineno = 1;
-    for (cp = filebuf; (c = *cp) != 0; ) {
-        if (c == '\n') lineno++;              /* Keep track of the line number */
-        if (ISSPACE(c)) { cp++; continue; }  /* Skip all white space */
-        if (c == '/' && cp[1] == '/') {          /* Skip C++ style comments */
+    for (cp = 0; (c = src.at(cp)) != 0; ) {
+        if (ISSPACE(c)) {                     /* Skip all white space */
+            size_t e = src.skipblank(cp);
+            if (e > cp) {                     /* Step over excluded text */
+                lineno += (int)std::count(src.z + cp, src.z + e, '\n');
+                cp = e;
+                continue;
+            }
+            if (c == '\n') lineno++;          /* Keep track of the line number */
+            cp++;
+            continue;
+        }
+        if (c == '/' && src.at(cp + 1) == '/') {  /* Skip C++ style comments */
             cp += 2;
-            while ((c = *cp) != 0 && c != '\n') cp++;
+            while ((c = src.at(cp)) != 0 && c != '\n') cp++;
             continue;
         }
-        if (c == '/' && cp[1] == '*') {          /* Skip C style comments */
+        if (c == '/' && src.at(cp + 1) == '*') {  /* Skip C style comments */
             cp += 2;
-            while ((c = *cp) != 0 && (c != '/' || cp[-1] != '*')) {
+            while ((c = src.at(cp)) != 0 && (c != '/' || src.at(cp - 1) != '*')) {
                 if (c == '\n') lineno++;
                 cp++;
             }
             if (c) cp++;
             continue;
         }
-        ps.tokenstart = cp;                /* Mark the beginning of the token */
+        size_t tokenstart = cp;            /* Mark the beginning of the token */
         ps.tokenlineno = lineno;           /* Linenumber on which token begins */
         if (c == '\"') {                     /* String literals */
             cp++;
-            while ((c = *cp) != 0 && c != '\"') {
+            while ((c = src.at(cp)) != 0 && c != '\"') {
                 if (c == '\n') lineno++;
                 cp++;
             }
-            if (c == 0) {
+            if (c == 0 && !src.pperr) {
                 ErrorMsg(ps.filename, startline,
                     "String starting on this line is not terminated before "
                     "the end of the file.");
@@ -2944,37 +3633,37 @@ void Parse(lemon& gp)
         else if (c == '{') {               /* A block of C code */
             int level;
             cp++;
-            for (level = 1; (c = *cp) != 0 && (level > 1 || c != '}'); cp++) {
+            for (level = 1; (c = src.at(cp)) != 0 && (level > 1 || c != '}'); cp++) {
                 if (c == '\n') lineno++;
                 else if (c == '{') level++;
                 else if (c == '}') level--;
-                else if (c == '/' && cp[1] == '*') {  /* Skip comments */
+                else if (c == '/' && src.at(cp + 1) == '*') {  /* Skip comments */
                     int prevc;
-                    cp = &cp[2];
+                    cp += 2;
                     prevc = 0;
-                    while ((c = *cp) != 0 && (c != '/' || prevc != '*')) {
+                    while ((c = src.at(cp)) != 0 && (c != '/' || prevc != '*')) {
                         if (c == '\n') lineno++;
                         prevc = c;
                         cp++;
                     }
                 }
-                else if (c == '/' && cp[1] == '/') {  /* Skip C++ style comments too */
-                    cp = &cp[2];
-                    while ((c = *cp) != 0 && c != '\n') cp++;
+                else if (c == '/' && src.at(cp + 1) == '/') {  /* Skip C++ style comments too */
+                    cp += 2;
+                    while ((c = src.at(cp)) != 0 && c != '\n') cp++;
                     if (c) lineno++;
                 }
                 else if (c == '\'' || c == '\"') {    /* String a character literals */
                     int startchar, prevc;
                     startchar = c;
                     prevc = 0;
-                    for (cp++; (c = *cp) != 0 && (c != startchar || prevc == '\\'); cp++) {
+                    for (cp++; (c = src.at(cp)) != 0 && (c != startchar || prevc == '\\'); cp++) {
                         if (c == '\n') lineno++;
                         if (prevc == '\\') prevc = 0;
                         else              prevc = c;
                     }
                 }
             }
-            if (c == 0) {
+            if (c == 0 && !src.pperr) {
                 ErrorMsg(ps.filename, ps.tokenlineno,
                     "C code starting on this line is not terminated before "
                     "the end of the file.");
@@ -2986,31 +3675,30 @@ void Parse(lemon& gp)
             }
         }
         else if (ISALNUM(c)) {          /* Identifiers */
-            while ((c = *cp) != 0 && (ISALNUM(c) || c == '_')) cp++;
+            while ((c = src.at(cp)) != 0 && (ISALNUM(c) || c == '_')) cp++;
             nextcp = cp;
         }
-        else if (c == ':' && cp[1] == ':' && cp[2] == '=') { /* The operator "::=" */
+        else if (c == ':' && src.at(cp + 1) == ':' && src.at(cp + 2) == '=') { /* The operator "::=" */
             cp += 3;
             nextcp = cp;
         }
-        else if ((c == '/' || c == '|') && ISALPHA(cp[1])) {
+        else if ((c == '/' || c == '|') && ISALPHA(src.at(cp + 1))) {
             cp += 2;
-            while ((c = *cp) != 0 && (ISALNUM(c) || c == '_')) cp++;
+            while ((c = src.at(cp)) != 0 && (ISALNUM(c) || c == '_')) cp++;
             nextcp = cp;
         }
         else {                          /* All other (one character) operators */
             cp++;
             nextcp = cp;
         }
-        c = *cp;
-        *cp = 0;                        /* Null terminate the token */
+        if (src.pperr) break;           /* Stop at a bad directive */
+        ps.token = src.text(tokenstart, cp, buf);
+        ps.tokenid = Strsafe_id(ps.token);
         parseonetoken(&ps);             /* Parse the token */
-        *cp = (char)c;                  /* Restore the buffer */
         cp = nextcp;
     }
-    delete[] filebuf;                    /* Release the buffer after parsing */
     gp.rule = ps.firstrule;
-    gp.errorcnt = ps.errorcnt;
+    gp.errorcnt = ps.errorcnt + src.pperr;
 }
 /*************************** From the file "plink.c" *********************/
 namespace Plink
@@ -3019,23 +3707,15 @@ namespace Plink
 ** Routines processing configuration follow-set propagation links
 ** in the LEMON parser generator.
 */
-static plink* plink_freelist = nullptr;
+#define plink_freelist (bldp->plinkfreelist)
 
 /* Allocate a new plink */
 plink* Plink_new(void) {
     plink* newlink;
 
+    bldp->work.nplink++;
     if (plink_freelist == nullptr) {
-        int i;
-        int amt = 100;
-        plink_freelist = (plink*)calloc(amt, sizeof(plink));
-        if (plink_freelist == nullptr) {
-            fprintf(stderr,
-                "Unable to allocate memory for a new follow-set propagation link.\n");
-            exit(1);
-        }
-        for (i = 0; i < amt - 1; i++) plink_freelist[i].next = &plink_freelist[i + 1];
-        plink_freelist[amt - 1].next = nullptr;
+        return (plink*)pool_alloc(bldp->pools[POOL_PLINK], sizeof(plink));
     }
     newlink = plink_freelist;
     plink_freelist = plink_freelist->next;
@@ -3077,6 +3757,7 @@ void Plink_delete(plink* plp)
     }
 }
 }
+#undef plink_freelist
 using namespace Plink;
 /*********************** From the file "report.c" **************************/
 /*
@@ -3084,7 +3765,7 @@ using namespace Plink;
 */
 
 /* Generate a filename with the given suffix.  Space to hold the
-** name comes from malloc() and must be freed by the calling
+** name comes from lemon_calloc() and must be freed by the calling
 ** function.
 */
 PRIVATE char* file_makename(const lemon& lemp, const char* suffix)
@@ -3092,9 +3773,11 @@ PRIVATE char* file_makename(const lemon& lemp, const char* suffix)
     char* name;
     char* cp;
     char* filename = lemp.filename;
+    const char* outputDir = nullptr;
     int sz;
 
-    if (outputDir) {
+    if (!genp->opt.outputDir.empty()) {
+        outputDir = genp->opt.outputDir.c_str();
         cp = strrchr(filename, '/');
         if (cp) filename = cp + 1;
     }
@@ -3102,7 +3785,7 @@ PRIVATE char* file_makename(const lemon& lemp, const char* suffix)
     sz += lemonStrlen(suffix);
     if (outputDir) sz += lemonStrlen(outputDir) + 1;
     sz += 5;
-    name = new char[sz];
+    name = (char*)lemon_calloc(sz, 1);
     if (name == nullptr) {
         fprintf(stderr, "Can't allocate space for a filename.\n");
         exit(1);
@@ -3119,46 +3802,133 @@ PRIVATE char* file_makename(const lemon& lemp, const char* suffix)
     return name;
 }
 
-/* Open a file with a name based on the name of the input file,
-** but with a different (specified) suffix, and return a pointer
-** to the stream */
-PRIVATE FILE* file_open(
+/* Begin a file for writing with a name based on the name of the input
+** file, but with a different (specified) suffix.  The file itself is not
+** opened until file_close().
+*/
+PRIVATE outfile* file_open(
     lemon& lemp,
-    const char* suffix,
-    const char* mode
+    const char* suffix
 ) {
-    FILE* fp;
+    outfile* out;
 
-    if (lemp.outname) delete[] lemp.outname;
+    if (lemp.outname) lemon_free(lemp.outname);
     lemp.outname = file_makename(lemp, suffix);
-    fp = fopen(lemp.outname, mode);
-    if (fp == nullptr && *mode == 'w') {
-        fprintf(stderr, "Can't open file \"%s\".\n", lemp.outname);
-        lemp.errorcnt++;
-        return nullptr;
-    }
-    return fp;
+    genp->outfiles.emplace_back();
+    out = &genp->outfiles.back();
+    out->name = lemp.outname;
+    out->text.reserve(64 * 1024);
+    return out;
 }
 
-/* Print the text of a rule
-*/
-void rule_print(FILE* out, const rule* rp) {
+/* Return true if the file "name" holds exactly "text" */
+PRIVATE int file_unchanged(const char* name, const std::string& text)
+{
+    srcmap map;
+    if (map.open(name)) return 0;
+    return map.n == text.size() && memcmp(map.z, text.data(), map.n) == 0;
+}
+
+/* Write out a file from file_open().  A file that already holds the same
+** text is left alone, so that its modification time does not change.
+** The text of an in-memory output is saved in the outputs of the
+** generator, under the name of its file.
+*/
+PRIVATE void file_close(outfile* out)
+{
+    const char* name = out->name.c_str();
+    if (genp->opt.inMemory) {
+        genp->outputs[out->name] = std::move(out->text);
+    }
+    else if (file_unchanged(name, out->text)) {
+        genp->lem.nunchanged++;
+    }
+    else {
+        FILE* fp = fopen(name, "wb");
+        if (fp == nullptr) {
+            fprintf(stderr, "Can't open file \"%s\".\n", name);
+            genp->lem.errorcnt++;
+        }
+        else {
+            size_t n = fwrite(out->text.data(), 1, out->text.size(), fp);
+            if (fclose(fp) != 0 || n != out->text.size()) {
+                fprintf(stderr, "Can't write file \"%s\".\n", name);
+                genp->lem.errorcnt++;
+            }
+        }
+    }
+    genp->outfiles.remove_if([out](const outfile& f) { return &f == out; });
+}
+
+/* Append n bytes of z to a file */
+PRIVATE void owrite(outfile* out, const char* z, size_t n)
+{
+    out->text.append(z, n);
+}
+
+/* Append the string z to a file */
+PRIVATE void oputs(outfile* out, const char* z)
+{
+    out->text.append(z);
+}
+
+/* Append the character c to a file */
+PRIVATE void oputc(outfile* out, int c)
+{
+    out->text.push_back((char)c);
+}
+
+/* Append the integer v to a file, right-justified in w columns like "%*d" */
+PRIVATE void oputi(outfile* out, int v, int w)
+{
+    char buf[16];
+    int n = (int)(std::to_chars(buf, buf + sizeof(buf), v).ptr - buf);
+    if (n < w) out->text.append(w - n, ' ');
+    out->text.append(buf, n);
+}
+
+/* Append text to a file, formatted as by printf() */
+PRIVATE void oprintf(outfile* out, const char* zFormat, ...)
+{
+    va_list ap;
+    char buf[256];
+    size_t len;
+    int n;
+    va_start(ap, zFormat);
+    n = vsnprintf(buf, sizeof(buf), zFormat, ap);
+    va_end(ap);
+    if (n < 0) return;
+    if (n < (int)sizeof(buf)) {
+        out->text.append(buf, n);
+        return;
+    }
+    len = out->text.size();
+    out->text.resize(len + n + 1);
+    va_start(ap, zFormat);
+    vsnprintf(&out->text[len], n + 1, zFormat, ap);
+    va_end(ap);
+    out->text.resize(len + n);
+}
+
+/* Print the text of a rule
+*/
+void rule_print(outfile* out, const rule* rp) {
     int i, j;
-    fprintf(out, "%s", rp->lhs->name);
-    /*    if( rp->lhsalias ) fprintf(out,"(%s)",rp->lhsalias); */
-    fprintf(out, " ::=");
+    oputs(out, rp->lhs->name);
+    /*    if( rp->lhsalias ) oprintf(out,"(%s)",rp->lhsalias); */
+    oputs(out, " ::=");
     for (i = 0; i < rp->nrhs; i++) {
         const symbol* sp = rp->rhs[i];
         if (sp->type == symbol_type::MULTITERMINAL) {
-            fprintf(out, " %s", sp->subsym[0]->name);
+            oprintf(out, " %s", sp->subsym[0]->name);
             for (j = 1; j < sp->nsubsym; j++) {
-                fprintf(out, "|%s", sp->subsym[j]->name);
+                oprintf(out, "|%s", sp->subsym[j]->name);
             }
         }
         else {
-            fprintf(out, " %s", sp->name);
+            oprintf(out, " %s", sp->name);
         }
-        /* if( rp->rhsalias[i] ) fprintf(out,"(%s)",rp->rhsalias[i]); */
+        /* if( rp->rhsalias[i] ) oprintf(out,"(%s)",rp->rhsalias[i]); */
     }
 }
 
@@ -3169,7 +3939,8 @@ void Reprint(lemon& lemp)
     rule* rp;
     symbol* sp;
     int i, j, maxlen, len, ncolumns, skip;
-    printf("// Reprint of input file \"%s\".\n// Symbols:\n", lemp.filename);
+    outfile out;
+    oprintf(&out, "// Reprint of input file \"%s\".\n// Symbols:\n", lemp.filename);
     maxlen = 10;
     for (i = 0; i < lemp.nsymbol; i++) {
         sp = lemp.symbols[i];
@@ -3180,48 +3951,49 @@ void Reprint(lemon& lemp)
     if (ncolumns < 1) ncolumns = 1;
     skip = (lemp.nsymbol + ncolumns - 1) / ncolumns;
     for (i = 0; i < skip; i++) {
-        printf("//");
+        oputs(&out, "//");
         for (j = i; j < lemp.nsymbol; j += skip) {
             sp = lemp.symbols[j];
             assert(sp->index == j);
-            printf(" %3d %-*.*s", j, maxlen, maxlen, sp->name);
+            oprintf(&out, " %3d %-*.*s", j, maxlen, maxlen, sp->name);
         }
-        printf("\n");
+        oputs(&out, "\n");
     }
     for (rp = lemp.rule; rp; rp = rp->next) {
-        rule_print(stdout, rp);
-        printf(".");
-        if (rp->precsym) printf(" [%s]", rp->precsym->name);
+        rule_print(&out, rp);
+        oputs(&out, ".");
+        if (rp->precsym) oprintf(&out, " [%s]", rp->precsym->name);
         /* if( rp->code ) printf("\n    %s",rp->code); */
-        printf("\n");
+        oputs(&out, "\n");
     }
+    fwrite(out.text.data(), 1, out.text.size(), stdout);
 }
 
 /* Print a single rule.
 */
-void RulePrint(FILE* fp, rule* rp, int iCursor) {
+void RulePrint(outfile* fp, rule* rp, int iCursor) {
     symbol* sp;
     int i, j;
-    fprintf(fp, "%s ::=", rp->lhs->name);
+    oprintf(fp, "%s ::=", rp->lhs->name);
     for (i = 0; i <= rp->nrhs; i++) {
-        if (i == iCursor) fprintf(fp, " *");
+        if (i == iCursor) oputs(fp, " *");
         if (i == rp->nrhs) break;
         sp = rp->rhs[i];
         if (sp->type == symbol_type::MULTITERMINAL) {
-            fprintf(fp, " %s", sp->subsym[0]->name);
+            oprintf(fp, " %s", sp->subsym[0]->name);
             for (j = 1; j < sp->nsubsym; j++) {
-                fprintf(fp, "|%s", sp->subsym[j]->name);
+                oprintf(fp, "|%s", sp->subsym[j]->name);
             }
         }
         else {
-            fprintf(fp, " %s", sp->name);
+            oprintf(fp, " %s", sp->name);
         }
     }
 }
 
 /* Print the rule for a configuration.
 */
-void ConfigPrint(FILE* fp, config* cfp) {
+void ConfigPrint(outfile* fp, config* cfp) {
     RulePrint(fp, cfp->rp, cfp->dot);
 }
 
@@ -3229,33 +4001,33 @@ void ConfigPrint(FILE* fp, config* cfp) {
 #if 0
 /* Print a set */
 PRIVATE void SetPrint(out, set, lemp)
-FILE* out;
+outfile* out;
 char* set;
 lemon* lemp;
 {
     int i;
     char* spacer;
     spacer = "";
-    fprintf(out, "%12s[", "");
+    oprintf(out, "%12s[", "");
     for (i = 0; i < lemp.nterminal; i++) {
         if (SetFind(set, i)) {
-            fprintf(out, "%s%s", spacer, lemp.symbols[i]->name);
+            oprintf(out, "%s%s", spacer, lemp.symbols[i]->name);
             spacer = " ";
         }
     }
-    fprintf(out, "]\n");
+    oputs(out, "]\n");
 }
 
 /* Print a plink chain */
 PRIVATE void PlinkPrint(out, plp, tag)
-FILE* out;
+outfile* out;
 plink* plp;
 char* tag;
 {
     while (plp) {
-        fprintf(out, "%12s%s (state %2d) ", "", tag, plp->cfp->stp->statenum);
+        oprintf(out, "%12s%s (state %2d) ", "", tag, plp->cfp->stp->statenum);
         ConfigPrint(out, plp->cfp);
-        fprintf(out, "\n");
+        oputs(out, "\n");
         plp = plp->next;
     }
 }
@@ -3266,46 +4038,46 @@ char* tag;
 */
 int PrintAction(
     action* ap,          /* The action to print */
-    FILE* fp,                   /* Print the action here */
+    outfile* fp,                /* Print the action here */
     int indent                  /* Indent by this amount */
 ) {
     int result = 1;
     switch (ap->type) {
     case e_action::SHIFT: {
         const state* stp = ap->x.stp;
-        fprintf(fp, "%*s shift        %-7d", indent, ap->sp->name, stp->statenum);
+        oprintf(fp, "%*s shift        %-7d", indent, ap->sp->name, stp->statenum);
         break;
     }
     case e_action::REDUCE: {
         rule* rp = ap->x.rp;
-        fprintf(fp, "%*s reduce       %-7d", indent, ap->sp->name, rp->iRule);
+        oprintf(fp, "%*s reduce       %-7d", indent, ap->sp->name, rp->iRule);
         RulePrint(fp, rp, -1);
         break;
     }
     case e_action::SHIFTREDUCE: {
         rule* rp = ap->x.rp;
-        fprintf(fp, "%*s shift-reduce %-7d", indent, ap->sp->name, rp->iRule);
+        oprintf(fp, "%*s shift-reduce %-7d", indent, ap->sp->name, rp->iRule);
         RulePrint(fp, rp, -1);
         break;
     }
     case e_action::ACCEPT:
-        fprintf(fp, "%*s accept", indent, ap->sp->name);
+        oprintf(fp, "%*s accept", indent, ap->sp->name);
         break;
     case e_action::ERROR:
-        fprintf(fp, "%*s error", indent, ap->sp->name);
+        oprintf(fp, "%*s error", indent, ap->sp->name);
         break;
     case e_action::SRCONFLICT:
     case e_action::RRCONFLICT:
-        fprintf(fp, "%*s reduce       %-7d ** Parsing conflict **",
+        oprintf(fp, "%*s reduce       %-7d ** Parsing conflict **",
             indent, ap->sp->name, ap->x.rp->iRule);
         break;
     case e_action::SSCONFLICT:
-        fprintf(fp, "%*s shift        %-7d ** Parsing conflict **",
+        oprintf(fp, "%*s shift        %-7d ** Parsing conflict **",
             indent, ap->sp->name, ap->x.stp->statenum);
         break;
     case e_action::SH_RESOLVED:
-        if (showPrecedenceConflict) {
-            fprintf(fp, "%*s shift        %-7d -- dropped by precedence",
+        if (genp->opt.showPrecedenceConflict) {
+            oprintf(fp, "%*s shift        %-7d -- dropped by precedence",
                 indent, ap->sp->name, ap->x.stp->statenum);
         }
         else {
@@ -3313,8 +4085,8 @@ int PrintAction(
         }
         break;
     case e_action::RD_RESOLVED:
-        if (showPrecedenceConflict) {
-            fprintf(fp, "%*s reduce %-7d -- dropped by precedence",
+        if (genp->opt.showPrecedenceConflict) {
+            oprintf(fp, "%*s reduce %-7d -- dropped by precedence",
                 indent, ap->sp->name, ap->x.rp->iRule);
         }
         else {
@@ -3326,7 +4098,7 @@ int PrintAction(
         break;
     }
     if (result && ap->spOpt) {
-        fprintf(fp, "  /* because %s==%s */", ap->sp->name, ap->spOpt->name);
+        oprintf(fp, "  /* because %s==%s */", ap->sp->name, ap->spOpt->name);
     }
     return result;
 }
@@ -3339,26 +4111,26 @@ void ReportOutput(lemon& lemp)
     config* cfp;
     action* ap;
     rule* rp;
-    FILE* fp;
+    outfile* fp;
 
-    fp = file_open(lemp, ".out", "wb");
+    fp = file_open(lemp, ".out");
     if (fp == nullptr) return;
     for (i = 0; i < lemp.nxstate; i++) {
         stp = lemp.sorted[i];
-        fprintf(fp, "State %d:\n", stp->statenum);
+        oprintf(fp, "State %d:\n", stp->statenum);
         if (lemp.basisflag) cfp = stp->bp;
         else                  cfp = stp->cfp;
         while (cfp) {
             char buf[20];
             if (cfp->dot == cfp->rp->nrhs) {
                 lemon_sprintf(buf, "(%d)", cfp->rp->iRule);
-                fprintf(fp, "    %5s ", buf);
+                oprintf(fp, "    %5s ", buf);
             }
             else {
-                fprintf(fp, "          ");
+                oputs(fp, "          ");
             }
             ConfigPrint(fp, cfp);
-            fprintf(fp, "\n");
+            oputs(fp, "\n");
 #if 0
             SetPrint(fp, cfp->fws, lemp);
             PlinkPrint(fp, cfp->fplp, "To  ");
@@ -3367,118 +4139,71 @@ void ReportOutput(lemon& lemp)
             if (lemp.basisflag) cfp = cfp->bp;
             else                  cfp = cfp->next;
         }
-        fprintf(fp, "\n");
+        oputs(fp, "\n");
         for (ap = stp->ap; ap; ap = ap->next) {
-            if (PrintAction(ap, fp, 30)) fprintf(fp, "\n");
+            if (PrintAction(ap, fp, 30)) oputs(fp, "\n");
         }
-        fprintf(fp, "\n");
+        oputs(fp, "\n");
     }
-    fprintf(fp, "----------------------------------------------------\n");
-    fprintf(fp, "Symbols:\n");
-    fprintf(fp, "The first-set of non-terminals is shown after the name.\n\n");
+    oputs(fp, "----------------------------------------------------\n");
+    oputs(fp, "Symbols:\n");
+    oputs(fp, "The first-set of non-terminals is shown after the name.\n\n");
     for (i = 0; i < lemp.nsymbol; i++) {
         int j;
         symbol* sp;
 
         sp = lemp.symbols[i];
-        fprintf(fp, "  %3d: %s", i, sp->name);
+        oprintf(fp, "  %3d: %s", i, sp->name);
         if (sp->type == symbol_type::NONTERMINAL) {
-            fprintf(fp, ":");
+            oputs(fp, ":");
             if (sp->lambda == Boolean::LEMON_TRUE) {
-                fprintf(fp, " <lambda>");
+                oputs(fp, " <lambda>");
             }
             for (j = 0; j < lemp.nterminal; j++) {
                 if (sp->firstset && SetFind(sp->firstset, j)) {
-                    fprintf(fp, " %s", lemp.symbols[j]->name);
+                    oprintf(fp, " %s", lemp.symbols[j]->name);
                 }
             }
         }
-        if (sp->prec >= 0) fprintf(fp, " (precedence=%d)", sp->prec);
-        fprintf(fp, "\n");
+        if (sp->prec >= 0) oprintf(fp, " (precedence=%d)", sp->prec);
+        oputs(fp, "\n");
     }
-    fprintf(fp, "----------------------------------------------------\n");
-    fprintf(fp, "Syntax-only Symbols:\n");
-    fprintf(fp, "The following symbols never carry semantic content.\n\n");
+    oputs(fp, "----------------------------------------------------\n");
+    oputs(fp, "Syntax-only Symbols:\n");
+    oputs(fp, "The following symbols never carry semantic content.\n\n");
     for (i = n = 0; i < lemp.nsymbol; i++) {
         int w;
         const symbol* sp = lemp.symbols[i];
         if (sp->bContent) continue;
         w = (int)strlen(sp->name);
         if (n > 0 && n + w > 75) {
-            fprintf(fp, "\n");
+            oputs(fp, "\n");
             n = 0;
         }
         if (n > 0) {
-            fprintf(fp, " ");
+            oputs(fp, " ");
             n++;
         }
-        fprintf(fp, "%s", sp->name);
+        oputs(fp, sp->name);
         n += w;
     }
-    if (n > 0) fprintf(fp, "\n");
-    fprintf(fp, "----------------------------------------------------\n");
-    fprintf(fp, "Rules:\n");
+    if (n > 0) oputs(fp, "\n");
+    oputs(fp, "----------------------------------------------------\n");
+    oputs(fp, "Rules:\n");
     for (rp = lemp.rule; rp; rp = rp->next) {
-        fprintf(fp, "%4d: ", rp->iRule);
+        oprintf(fp, "%4d: ", rp->iRule);
         rule_print(fp, rp);
-        fprintf(fp, ".");
+        oputs(fp, ".");
         if (rp->precsym) {
-            fprintf(fp, " [%s precedence=%d]",
+            oprintf(fp, " [%s precedence=%d]",
                 rp->precsym->name, rp->precsym->prec);
         }
-        fprintf(fp, "\n");
+        oputs(fp, "\n");
     }
-    fclose(fp);
+    file_close(fp);
     return;
 }
 
-/* Search for the file "name" which is in the same directory as
-** the executable */
-PRIVATE char* pathsearch(char* argv0, char* name, int modemask)
-{
-    const char* pathlist;
-    char* pathbufptr = nullptr;
-    char* pathbuf = nullptr;
-    char* path, * cp;
-    char c;
-
-#ifdef __WIN32__
-    cp = strrchr(argv0, '\\');
-#else
-    cp = strrchr(argv0, '/');
-#endif
-    if (cp) {
-        c = *cp;
-        *cp = 0;
-        path = new char[lemonStrlen(argv0) + lemonStrlen(name) + 2];
-        if (path) lemon_sprintf(path, "%s/%s", argv0, name);
-        *cp = c;
-    }
-    else {
-        pathlist = getenv("PATH");
-        if (pathlist == nullptr) pathlist = ".:/bin:/usr/bin";
-        pathbuf = new char[lemonStrlen(pathlist) + 1];
-        path = new char[lemonStrlen(pathlist) + lemonStrlen(name) + 2];
-        if ((pathbuf != nullptr) && (path != 0)) {
-            pathbufptr = pathbuf;
-            lemon_strcpy(pathbuf, pathlist);
-            while (*pathbuf) {
-                cp = strchr(pathbuf, ':');
-                if (cp == nullptr) cp = &pathbuf[lemonStrlen(pathbuf)];
-                c = *cp;
-                *cp = 0;
-                lemon_sprintf(path, "%s/%s", pathbuf, name);
-                *cp = c;
-                if (c == 0) pathbuf[0] = 0;
-                else pathbuf = &cp[1];
-                if (access(path, modemask) == 0) break;
-            }
-        }
-        delete [] pathbufptr;
-    }
-    return path;
-}
-
 /* Given an action, compute the integer value for that action
 ** which is to be put in the action table of the generated machine.
 ** Return negative if no action should be generated.
@@ -3507,130 +4232,188 @@ PRIVATE int compute_action(const lemon& lemp, const action* ap)
 
 #define LINESIZE 1000
 /* The next cluster of routines are for reading the template file
-** and writing the results to the generated parser */
-/* The first function transfers data from "in" to "out" until
-** a line is seen which begins with "%%".  The line number is
-** tracked.
+** and writing the results to the generated parser.
+**
+** A template is split once, when it is loaded, into the segments of text
+** between lines which begin with "%%".  The offsets of every "Parse" that
+** is to be replaced by the %name are recorded with each segment, so that
+** copying a segment out is only a few calls to owrite().
+*/
+struct tplt_seg {
+    size_t start, end;          /* The text of the segment */
+    int nline;                  /* Number of lines in the segment */
+    std::vector<size_t> parse;  /* Offsets of each "Parse" to be renamed */
+};
+struct tplt {
+    std::string text;           /* The complete template */
+    std::vector<tplt_seg> seg;  /* The text between "%%" lines, in order */
+    bool dense = false;         /* True if the template reads YYDENSE tables */
+
+    void index();
+};
+
+/* A template being copied into the generated parser */
+struct tplt_in {
+    const tplt* t = nullptr;    /* The template */
+    std::unique_ptr<tplt> own;  /* Storage for a template read with -T */
+    size_t iSeg = 0;            /* The next segment to copy */
+};
+
+/* Split the text of a template into segments */
+void tplt::index()
+{
+    const char* z = text.data();
+    size_t n = text.size();
+    size_t pos = 0;
+    tplt_seg cur{ 0, 0, 0, {} };
+
+    seg.clear();
+    while (pos < n) {
+        const char* eol = (const char*)memchr(z + pos, '\n', n - pos);
+        size_t next = eol ? (size_t)(eol - z) + 1 : n;
+        if (z[pos] == '%' && pos + 1 < n && z[pos + 1] == '%') {
+            cur.end = pos;
+            seg.push_back(std::move(cur));
+            cur = tplt_seg{ next, next, 0, {} };
+        }
+        else {
+            cur.nline++;
+        }
+        pos = next;
+    }
+    cur.end = n;
+    seg.push_back(std::move(cur));
+
+    std::string_view sv(text);
+    dense = sv.find("YYDENSE") != std::string_view::npos;
+    for (tplt_seg& s : seg) {
+        for (size_t i = sv.find("Parse", s.start);
+            i != std::string_view::npos && i + 5 <= s.end;
+            i = sv.find("Parse", i + 5)) {
+            if (i == 0 || !ISALPHA(z[i - 1])) s.parse.push_back(i);
+        }
+    }
+}
+
+/* The text of lempar.c and lempar.hpp, compiled into the program.  The
+** copies are found on the include path, so that the CMake build can use
+** the ones it writes from the current templates. */
+static const char* const lempar_chunks[] = {
+#include <lempar.inc>
+};
+static const char* const lempar_hpp_chunks[] = {
+#include <lempar_hpp.inc>
+};
+
+/* Index the template made of the chunks in z[] */
+template <size_t N>
+PRIVATE tplt tplt_index(const char* const (&z)[N])
+{
+    tplt d;
+    for (const char* c : z) d.text += c;
+    d.index();
+    return d;
+}
+
+/* The default template, indexed the first time it is needed */
+PRIVATE const tplt* tplt_default()
+{
+    if (genp->opt.cplusplus) {
+        static const tplt hpp = tplt_index(lempar_hpp_chunks);
+        return &hpp;
+    }
+    static const tplt t = tplt_index(lempar_chunks);
+    return &t;
+}
+
+/* The first function transfers the next segment of the template to
+** "out".  The line number is tracked.
 **
 ** if name!=0, then any word that begin with "Parse" is changed to
 ** begin with *name instead.
 */
-PRIVATE void tplt_xfer(char* name, FILE* in, FILE* out, int* lineno)
+PRIVATE void tplt_xfer(char* name, tplt_in& in, outfile* out, int* lineno)
 {
-    int i, iStart;
-    char line[LINESIZE];
-    while (fgets(line, LINESIZE, in) && (line[0] != '%' || line[1] != '%')) {
-        (*lineno)++;
-        iStart = 0;
-        if (name) {
-            for (i = 0; line[i]; i++) {
-                if (line[i] == 'P' && strncmp(&line[i], "Parse", 5) == 0
-                    && (i == 0 || !ISALPHA(line[i - 1]))
-                    ) {
-                    if (i > iStart) fprintf(out, "%.*s", i - iStart, &line[iStart]);
-                    fprintf(out, "%s", name);
-                    i += 4;
-                    iStart = i + 1;
-                }
-            }
+    if (in.iSeg >= in.t->seg.size()) return;
+    const tplt_seg& s = in.t->seg[in.iSeg++];
+    const char* z = in.t->text.data();
+    size_t iStart = s.start;
+    if (name) {
+        size_t nName = lemonStrlen(name);
+        for (size_t i : s.parse) {
+            owrite(out, &z[iStart], i - iStart);
+            owrite(out, name, nName);
+            iStart = i + 5;
         }
-        fprintf(out, "%s", &line[iStart]);
     }
+    owrite(out, &z[iStart], s.end - iStart);
+    *lineno += s.nline;
 }
 
 /* Skip forward past the header of the template file to the first "%%"
 */
-PRIVATE void tplt_skip_header(FILE* in, int* lineno)
+PRIVATE void tplt_skip_header(tplt_in& in, int* lineno)
 {
-    char line[LINESIZE];
-    while (fgets(line, LINESIZE, in) && (line[0] != '%' || line[1] != '%')) {
-        (*lineno)++;
-    }
+    if (in.iSeg >= in.t->seg.size()) return;
+    *lineno += in.t->seg[in.iSeg++].nline;
 }
 
-/* The next function finds the template file and opens it, returning
-** a pointer to the opened file. */
-PRIVATE FILE* tplt_open(lemon& lemp)
+/* The next function loads the template named with -T, or else selects
+** the template compiled into the program.  Return non-zero on error. */
+PRIVATE int tplt_open(lemon& lemp, tplt_in& in)
 {
-    static char templatename[] = "lempar.c";
-    char buf[1000];
-    FILE* in;
-    char* tpltname;
-    char* toFree = nullptr;
-    char* cp;
-
-    /* first, see if user specified a template filename on the command line. */
-    if (user_templatename != nullptr) {
-        if (access(user_templatename, 004) == -1) {
-            fprintf(stderr, "Can't find the parser driver template file \"%s\".\n",
-                user_templatename);
-            lemp.errorcnt++;
-            return nullptr;
-        }
-        in = fopen(user_templatename, "rb");
-        if (in == nullptr) {
-            fprintf(stderr, "Can't open the template file \"%s\".\n",
-                user_templatename);
-            lemp.errorcnt++;
-            return nullptr;
-        }
-        return in;
+    in.iSeg = 0;
+    if (genp->opt.templateName.empty()) {
+        in.t = tplt_default();
+        return 0;
     }
 
-    cp = strrchr(lemp.filename, '.');
-    if (cp) {
-        lemon_sprintf(buf, "%.*s.lt", (int)(cp - lemp.filename), lemp.filename);
-    }
-    else {
-        lemon_sprintf(buf, "%s.lt", lemp.filename);
-    }
-    if (access(buf, 004) == 0) {
-        tpltname = buf;
-    }
-    else if (access(templatename, 004) == 0) {
-        tpltname = templatename;
-    }
-    else {
-        toFree = tpltname = pathsearch(lemp.argv0, templatename, 0);
-    }
-    if (tpltname == nullptr) {
+    const char* user_templatename = genp->opt.templateName.c_str();
+    if (access(user_templatename, 004) == -1) {
         fprintf(stderr, "Can't find the parser driver template file \"%s\".\n",
-            templatename);
+            user_templatename);
         lemp.errorcnt++;
-        return nullptr;
+        return 1;
     }
-    in = fopen(tpltname, "rb");
-    if (in == nullptr) {
-        fprintf(stderr, "Can't open the template file \"%s\".\n", tpltname);
+    srcmap map;
+    if (map.open(user_templatename)) {
+        fprintf(stderr, "Can't open the template file \"%s\".\n",
+            user_templatename);
         lemp.errorcnt++;
+        return 1;
     }
-    delete[] toFree;
-    return in;
+    in.own = std::make_unique<tplt>();
+    in.own->text.assign(map.z, map.n);
+    in.own->index();
+    in.t = in.own.get();
+    return 0;
 }
 
 /* Print a #line directive line to the output file. */
-PRIVATE void tplt_linedir(FILE* out, int lineno, char* filename)
+PRIVATE void tplt_linedir(outfile* out, int lineno, char* filename)
 {
-    fprintf(out, "#line %d \"", lineno);
+    oputs(out, "#line ");
+    oputi(out, lineno, 0);
+    oputs(out, " \"");
     while (*filename) {
-        if (*filename == '\\') putc('\\', out);
-        putc(*filename, out);
+        if (*filename == '\\') oputc(out, '\\');
+        oputc(out, *filename);
         filename++;
     }
-    fprintf(out, "\"\n");
+    oputs(out, "\"\n");
 }
 
 /* Print a string to the file and keep the linenumber up to date */
-PRIVATE void tplt_print(FILE* out, lemon& lemp, char* str, int* lineno)
+PRIVATE void tplt_print(outfile* out, lemon& lemp, char* str, int* lineno)
 {
+    size_t n;
     if (str == nullptr) return;
-    while (*str) {
-        putc(*str, out);
-        if (*str == '\n') (*lineno)++;
-        str++;
-    }
+    n = strlen(str);
+    owrite(out, str, n);
+    *lineno += (int)std::count(str, str + n, '\n');
+    str += n;
     if (str[-1] != '\n') {
-        putc('\n', out);
+        oputc(out, '\n');
         (*lineno)++;
     }
     if (!lemp.nolinenosflag) {
@@ -3644,7 +4427,7 @@ PRIVATE void tplt_print(FILE* out, lemon& lemp, char* str, int* lineno)
 ** symbol sp
 */
 void emit_destructor_code(
-    FILE* out,
+    outfile* out,
     symbol* sp,
     lemon& lemp,
     int* lineno
@@ -3654,11 +4437,11 @@ void emit_destructor_code(
     if (sp->type == symbol_type::TERMINAL) {
         cp = lemp.tokendest;
         if (cp == nullptr) return;
-        fprintf(out, "{\n"); (*lineno)++;
+        oputs(out, "{\n"); (*lineno)++;
     }
     else if (sp->destructor) {
         cp = sp->destructor;
-        fprintf(out, "{\n"); (*lineno)++;
+        oputs(out, "{\n"); (*lineno)++;
         if (!lemp.nolinenosflag) {
             (*lineno)++;
             tplt_linedir(out, sp->destLineno, lemp.filename);
@@ -3667,25 +4450,25 @@ void emit_destructor_code(
     else if (lemp.vardest) {
         cp = lemp.vardest;
         if (cp == nullptr) return;
-        fprintf(out, "{\n"); (*lineno)++;
+        oputs(out, "{\n"); (*lineno)++;
     }
     else {
         assert(0);  /* Cannot happen */
     }
     for (; *cp; cp++) {
         if (*cp == '$' && cp[1] == '$') {
-            fprintf(out, "(yypminor->yy%d)", sp->dtnum);
+            oprintf(out, "(yypminor->yy%d)", sp->dtnum);
             cp++;
             continue;
         }
         if (*cp == '\n') (*lineno)++;
-        fputc(*cp, out);
+        oputc(out, *cp);
     }
-    fprintf(out, "\n"); (*lineno)++;
+    oputs(out, "\n"); (*lineno)++;
     if (!lemp.nolinenosflag) {
         (*lineno)++; tplt_linedir(out, *lineno, lemp.outname);
     }
-    fprintf(out, "}\n"); (*lineno)++;
+    oputs(out, "}\n"); (*lineno)++;
     return;
 }
 
@@ -3718,9 +4501,9 @@ int has_destructor(const symbol& sp, const lemon& lemp)
 */
 PRIVATE char* append_str(const char* zText, int n, int p1, int p2) {
     static char empty[1] = { 0 };
-    static char* z = nullptr;
-    static int alloced = 0;
-    static int used = 0;
+    char*& z = genp->zAppend;
+    int& alloced = genp->nAppendAlloc;
+    int& used = genp->nAppendUsed;
     int c;
     char zInt[40];
     if (zText == nullptr) {
@@ -3737,7 +4520,7 @@ PRIVATE char* append_str(const char* zText, int n, int p1, int p2) {
     }
     if ((int)(n + sizeof(zInt) * 2 + used) >= alloced) {
         alloced = n + sizeof(zInt) * 2 + used + 200;
-        z = (char*)realloc(z, alloced);
+        z = (char*)lemon_realloc(z, alloced);
     }
     if (z == nullptr) return empty;
     while (n-- > 0) {
@@ -3758,17 +4541,37 @@ PRIVATE char* append_str(const char* zText, int n, int p1, int p2) {
     return z;
 }
 
+/*
+** Return the member of YYMINORTYPE that holds the value of sp on the
+** parser's stack.  Tokens, including the error symbol, are held in yy0.
+*/
+PRIVATE int stack_dtnum(const lemon& lemp, const symbol* sp)
+{
+    if (sp->type == symbol_type::MULTITERMINAL) sp = sp->subsym[0];
+    if (sp == lemp.errsym) return 0;
+    return sp->dtnum;
+}
+
 /*
 ** Write and transform the rp->code string so that symbols are expanded.
 ** Populate the rp->codePrefix and rp->codeSuffix strings, as appropriate.
 **
 ** Return 1 if the expanded code requires that "yylhsminor" local variable
 ** to be defined.
+**
+** For the C++ parser of lempar.hpp, the values on the stack are objects.
+** The suffix then destroys the values of the RHS and constructs the value
+** of the LHS in their place.  The LHS is only written in place if the RHS
+** is empty or its left-most symbol has the same label as the LHS.
 */
 PRIVATE int translate_code(lemon& lemp, rule& rp) {
     char* cp, * xp;
     int i;
     int rc = 0;            /* True if yylhsminor is used */
+    const bool cpp = genp->opt.cplusplus;
+    const char* zDestructor = cpp ? "  yy_destructor(%d,&yymsp[%d].minor);\n"
+                                  : "  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n";
+    char inplace = 0;      /* True if the LHS takes over the left-most RHS value */
     int dontUseRhs0 = 0;   /* If true, use of left-most RHS label is illegal */
     const char* zSkip = nullptr; /* The zOvwrt comment within rp->code, or NULL */
     char lhsused = 0;      /* True if the LHS element has been used */
@@ -3802,8 +4605,7 @@ PRIVATE int translate_code(lemon& lemp, rule& rp) {
         //                    v better not be a nullptr
         if (has_destructor(*rp.rhs[0], lemp)) {
             append_str(nullptr, 0, 0, 0);
-            append_str("  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n", 0,
-                rp.rhs[0]->index, 1 - rp.nrhs);
+            append_str(zDestructor, 0, rp.rhs[0]->index, 1 - rp.nrhs);
             rp.codePrefix = Strsafe(append_str(nullptr, 0, 0, 0));
             rp.noCode = Boolean::LEMON_FALSE;
         }
@@ -3818,6 +4620,7 @@ PRIVATE int translate_code(lemon& lemp, rule& rp) {
         lhsdirect = 1;
         lhsused = 1;
         used[0] = 1;
+        inplace = 1;
         if (rp.lhs->dtnum != rp.rhs[0]->dtnum) {
             ErrorMsg(lemp.filename, rp.ruleline,
                 "%s(%s) and %s(%s) share the same label but have "
@@ -3829,7 +4632,7 @@ PRIVATE int translate_code(lemon& lemp, rule& rp) {
     else {
         lemon_sprintf(zOvwrt, "/*%s-overwrites-%s*/",
             rp.lhsalias, rp.rhsalias[0]);
-        zSkip = strstr(rp.code, zOvwrt);
+        zSkip = cpp ? nullptr : strstr(rp.code, zOvwrt);
         if (zSkip != nullptr) {
             /* The code contains a special comment that indicates that it is safe
             ** for the LHS label to overwrite left-most RHS label. */
@@ -3839,6 +4642,23 @@ PRIVATE int translate_code(lemon& lemp, rule& rp) {
             lhsdirect = 0;
         }
     }
+    if (cpp && !inplace && (rp.nrhs == 0 || rp.lhsalias)) {
+        /* With no RHS the LHS value is constructed on the stack at once.
+        ** Otherwise the RHS values stay alive until the code is done, so a
+        ** labeled LHS is constructed and built in yylhsminor */
+        append_str(nullptr, 0, 0, 0);
+        if (rp.codePrefix) append_str(rp.codePrefix, 0, 0, 0);
+        if (rp.nrhs == 0) {
+            append_str("  yy_construct(yymsp[1].minor.yy%d);\n", 0, rp.lhs->dtnum, 0);
+            inplace = 1;
+        }
+        else {
+            append_str("  yy_construct(yylhsminor.yy%d);\n", 0, rp.lhs->dtnum, 0);
+            lhsdirect = 0;
+        }
+        rp.codePrefix = Strsafe(append_str(nullptr, 0, 0, 0));
+        rp.noCode = Boolean::LEMON_FALSE;
+    }
     if (lhsdirect) {
         sprintf(zLhs, "yymsp[%d].minor.yy%d", 1 - rp.nrhs, rp.lhs->dtnum);
     }
@@ -3949,14 +4769,30 @@ PRIVATE int translate_code(lemon& lemp, rule& rp) {
         }
         //                                      v better not be a nullptr
         else if (i > 0 && has_destructor(*rp.rhs[i], lemp)) {
-            append_str("  yy_destructor(yypParser,%d,&yymsp[%d].minor);\n", 0,
-                rp.rhs[i]->index, i - rp.nrhs + 1);
+            append_str(zDestructor, 0, rp.rhs[i]->index, i - rp.nrhs + 1);
         }
     }
 
+    if (cpp) {
+        /* Destroy the RHS values, then construct the LHS value in the
+        ** stack entry of the left-most one */
+        for (i = inplace; i < rp.nrhs; i++) {
+            append_str("  yy_destroy(yymsp[%d].minor.yy%d);\n", 0,
+                i - rp.nrhs + 1, stack_dtnum(lemp, rp.rhs[i]));
+        }
+        if (!inplace) {
+            if (lhsdirect) {
+                append_str("  yy_construct(", 0, 0, 0);
+            }
+            else {
+                append_str("  yy_relocate(yylhsminor.yy%d, ", 0, rp.lhs->dtnum, 0);
+            }
+            append_str("yymsp[%d].minor.yy%d);\n", 0, 1 - rp.nrhs, rp.lhs->dtnum);
+        }
+    }
     /* If unable to write LHS values directly into the stack, write the
     ** saved LHS value now. */
-    if (lhsdirect == 0) {
+    else if (lhsdirect == 0) {
         append_str("  yymsp[%d].minor.yy%d = ", 0, 1 - rp.nrhs, rp.lhs->dtnum);
         append_str(zLhs, 0, 0, 0);
         append_str(";\n", 0, 0, 0);
@@ -3977,7 +4813,7 @@ PRIVATE int translate_code(lemon& lemp, rule& rp) {
 ** the code to "out".  Make sure lineno stays up-to-date.
 */
 PRIVATE void emit_code(
-    FILE* out,
+    outfile* out,
     const rule* rp,
     lemon& lemp,
     int* lineno
@@ -3986,7 +4822,7 @@ PRIVATE void emit_code(
 
     /* Setup code prior to the #line directive */
     if (rp->codePrefix && rp->codePrefix[0]) {
-        fprintf(out, "{%s", rp->codePrefix);
+        oprintf(out, "{%s", rp->codePrefix);
         for (cp = rp->codePrefix; *cp; cp++) { if (*cp == '\n') (*lineno)++; }
     }
 
@@ -3996,9 +4832,9 @@ PRIVATE void emit_code(
             (*lineno)++;
             tplt_linedir(out, rp->line, lemp.filename);
         }
-        fprintf(out, "{%s", rp->code);
+        oprintf(out, "{%s", rp->code);
         for (cp = rp->code; *cp; cp++) { if (*cp == '\n') (*lineno)++; }
-        fprintf(out, "}\n"); (*lineno)++;
+        oputs(out, "}\n"); (*lineno)++;
         if (!lemp.nolinenosflag) {
             (*lineno)++;
             tplt_linedir(out, *lineno, lemp.outname);
@@ -4007,12 +4843,12 @@ PRIVATE void emit_code(
 
     /* Generate breakdown code that occurs after the #line directive */
     if (rp->codeSuffix && rp->codeSuffix[0]) {
-        fprintf(out, "%s", rp->codeSuffix);
+        oputs(out, rp->codeSuffix);
         for (cp = rp->codeSuffix; *cp; cp++) { if (*cp == '\n') (*lineno)++; }
     }
 
     if (rp->codePrefix) {
-        fprintf(out, "}\n"); (*lineno)++;
+        oputs(out, "}\n"); (*lineno)++;
     }
 
     return;
@@ -4026,7 +4862,7 @@ PRIVATE void emit_code(
 ** symbol.
 */
 void print_stack_union(
-    FILE* out,                  /* The output stream */
+    outfile* out,                  /* The output stream */
     lemon& lemp,         /* The main info structure for this parser */
     int* plineno,               /* Pointer to the line number */
     int mhflag                  /* True if generating makeheaders output */
@@ -4120,24 +4956,38 @@ void print_stack_union(
     /* Print out the definition of YYTOKENTYPE and YYMINORTYPE */
     name = lemp.name ? lemp.name : "Parse";
     lineno = *plineno;
-    if (mhflag) { fprintf(out, "#if INTERFACE\n"); lineno++; }
-    fprintf(out, "#define %sTOKENTYPE %s\n", name,
+    if (mhflag) { oputs(out, "#if INTERFACE\n"); lineno++; }
+    oprintf(out, "#define %sTOKENTYPE %s\n", name,
         lemp.tokentype ? lemp.tokentype : "void*");  lineno++;
-    if (mhflag) { fprintf(out, "#endif\n"); lineno++; }
-    fprintf(out, "typedef union {\n"); lineno++;
-    fprintf(out, "  int yyinit;\n"); lineno++;
-    fprintf(out, "  %sTOKENTYPE yy0;\n", name); lineno++;
+    if (mhflag) { oputs(out, "#endif\n"); lineno++; }
+    if (genp->opt.cplusplus) {
+        oprintf(out, "union %sMINORTYPE {\n", name); lineno++;
+    }
+    else {
+        oputs(out, "typedef union {\n"); lineno++;
+    }
+    oputs(out, "  int yyinit;\n"); lineno++;
+    oprintf(out, "  %sTOKENTYPE yy0;\n", name); lineno++;
     for (i = 0; i < arraysize; i++) {
         if (types[i] == nullptr) continue;
-        fprintf(out, "  %s yy%d;\n", types[i], i + 1); lineno++;
+        oprintf(out, "  %s yy%d;\n", types[i], i + 1); lineno++;
         delete[] types[i];
     }
     if (lemp.errsym && lemp.errsym->useCnt) {
-        fprintf(out, "  int yy%d;\n", lemp.errsym->dtnum); lineno++;
+        oprintf(out, "  int yy%d;\n", lemp.errsym->dtnum); lineno++;
     }
     delete[] stddt;
     delete[] types;
-    fprintf(out, "} YYMINORTYPE;\n"); lineno++;
+    if (genp->opt.cplusplus) {
+        /* The parser constructs and destroys the members itself */
+        oprintf(out, "  %sMINORTYPE() {}\n", name); lineno++;
+        oprintf(out, "  ~%sMINORTYPE() {}\n", name); lineno++;
+        oputs(out, "};\n"); lineno++;
+        oprintf(out, "#define YYMINORTYPE %sMINORTYPE\n", name); lineno++;
+    }
+    else {
+        oputs(out, "} YYMINORTYPE;\n"); lineno++;
+    }
     *plineno = lineno;
 }
 
@@ -4186,6 +5036,10 @@ struct axset {
     int isTkn;           /* True to use tokens.  False for non-terminals */
     int nAction;         /* Number of actions */
     int iOrder;          /* Original order of action sets */
+    int iEntry;          /* Index of its first entry in the packing */
+    int nEntry;          /* Number of its entries */
+    int nSpan;           /* Largest lookahead less smallest, plus one */
+    int iOfst;           /* Offset chosen for it by the packing */
 
     /*
     ** Compare to axset structures for sorting purposes
@@ -4201,22 +5055,185 @@ struct axset {
     }
 };
 
+/*
+** Routines that choose where each transaction set goes in the yy_action[]
+** table.  A packing takes the sets in some order and inserts each one
+** into an acttab, either at the first hole that fits or at the tightest.
+** The packing strategy (the -P option) picks the order and the fit:
+**
+**   first     Largest sets first, first fit.  The classic LEMON packing.
+**   best      Largest sets first, best fit.
+**   displace  Sets with the widest span of lookaheads first, since their
+**             gaps are the holes that the narrower sets fill.  Best fit.
+**   search    Try all of the above, then move one set at a time in the
+**             order of the smallest table, N times.  The moves come from a
+**             fixed seed, so the result does not depend on machine load.
+**
+** Table size is measured as the number of entries in yy_action[] plus
+** the number in yy_lookahead[].
+*/
+
+/* Return the number of entries in yy_action[] and yy_lookahead[] */
+static int acttab_footprint(const acttab* p)
+{
+    int n = acttab_action_size(p);
+    int nLookahead = acttab_lookahead_size(p);
+    if (nLookahead < p->nterminal + n) nLookahead = p->nterminal + n;
+    return n + nLookahead;
+}
+
+/* Insert the sets ax[order[0]], ax[order[1]], ... into a new action table
+** and record the offset of each in its iOfst */
+static acttab* pack_actions(
+    const lemon& lemp,
+    std::vector<axset>& ax,
+    const std::vector<lookahead_action>& entries,
+    const std::vector<int>& order,
+    int bestFit
+) {
+    acttab* p = acttab_alloc(lemp.nsymbol, lemp.nterminal);
+    p->bestFit = bestFit;
+    for (int i : order) {
+        for (int j = ax[i].iEntry; j < ax[i].iEntry + ax[i].nEntry; j++) {
+            acttab_action(p, entries[j].lookahead, entries[j].action);
+        }
+        ax[i].iOfst = acttab_insert(p, ax[i].isTkn);
+#if 0  /* Uncomment for a trace of how the yy_action[] table fills out */
+        { int jj, nn;
+        for (jj = nn = 0; jj < p->nAction; jj++) {
+            if (p->aAction[jj].action < 0) nn++;
+        }
+        printf("State %3d %s n: %2d size: %5d freespace: %d\n",
+            ax[i].stp->statenum, ax[i].isTkn ? "Token" : "Var  ",
+            ax[i].nAction, p->nAction, nn);
+        }
+#endif
+    }
+    return p;
+}
+
+/* Choose the offset of every transaction set in ax[] with the packing
+** strategy of the generator, store the offsets in the states, and
+** return the action table that results.
+*/
+static acttab* PackActions(lemon& lemp, std::vector<axset>& ax)
+{
+    std::vector<lookahead_action> entries;
+    std::vector<int> largest, widest, order;
+    std::vector<int> bestOrder;
+    int bestFit = 0, nBest = 0;
+    acttab* pBest = nullptr;
+    action* ap;
+    const e_packing strategy = genp->opt.packing;
+    const auto start = std::chrono::steady_clock::now();
+
+    /* Gather the entries of every set that has any */
+    for (auto& x : ax) {
+        x.iEntry = (int)entries.size();
+        for (ap = x.stp->ap; x.nAction > 0 && ap; ap = ap->next) {
+            int action;
+            if (x.isTkn) {
+                if (ap->sp->index >= lemp.nterminal) continue;
+            }
+            else {
+                if (ap->sp->index < lemp.nterminal) continue;
+                if (ap->sp->index == lemp.nsymbol) continue;
+            }
+            action = compute_action(lemp, ap);
+            if (action < 0) continue;
+            entries.push_back({ ap->sp->index, action });
+        }
+        x.nEntry = (int)entries.size() - x.iEntry;
+        x.nSpan = 0;
+        if (x.nEntry > 0) {
+            auto [mn, mx] = std::minmax_element(entries.begin() + x.iEntry, entries.end(),
+                [](const auto& a, const auto& b) { return a.lookahead < b.lookahead; });
+            x.nSpan = mx->lookahead - mn->lookahead + 1;
+        }
+    }
+
+    /* In an effort to minimize the action table size, use the heuristic
+    ** of placing the largest action sets first */
+    for (int i = 0; i < (int)ax.size(); i++) {
+        if (ax[i].nAction > 0) largest.push_back(i);
+    }
+    std::sort(largest.begin(), largest.end(), [&](int a, int b) { return ax[a] < ax[b]; });
+    widest = largest;
+    std::stable_sort(widest.begin(), widest.end(),
+        [&](int a, int b) { return ax[a].nSpan > ax[b].nSpan; });
+
+    /* Try a packing and keep it if it gives the smallest table so far */
+    auto attempt = [&](const std::vector<int>& o, int fit) {
+        acttab* p = pack_actions(lemp, ax, entries, o, fit);
+        int n = acttab_footprint(p);
+        lemp.npacking++;
+        if (pBest == nullptr || n < nBest) {
+            if (pBest) acttab_free(pBest);
+            pBest = p;
+            nBest = n;
+            bestOrder = o;
+            bestFit = fit;
+        }
+        else {
+            acttab_free(p);
+        }
+    };
+
+    switch (strategy) {
+    case e_packing::FIRST_FIT: attempt(largest, 0); break;
+    case e_packing::BEST_FIT:  attempt(largest, 1); break;
+    case e_packing::DISPLACE:  attempt(widest, 1);  break;
+    case e_packing::SEARCH: {
+        std::mt19937 rng(1);
+        attempt(largest, 0);
+        attempt(largest, 1);
+        attempt(widest, 0);
+        attempt(widest, 1);
+        for (int nMove = 0; nMove < genp->opt.packMoves && bestOrder.size() > 1; nMove++) {
+            /* Move one set of the best order to another place */
+            std::uniform_int_distribution<int> pick(0, (int)bestOrder.size() - 1);
+            std::uniform_int_distribution<int> pickOther(0, (int)bestOrder.size() - 2);
+            int from = pick(rng), to = pickOther(rng);
+            if (to >= from) to++;
+            order = bestOrder;
+            if (from < to) std::rotate(order.begin() + from, order.begin() + from + 1, order.begin() + to + 1);
+            else std::rotate(order.begin() + to, order.begin() + from, order.begin() + from + 1);
+            attempt(order, bestFit);
+        }
+        break;
+    }
+    }
+
+    /* Later packings overwrote the offsets in ax[], so redo the winner */
+    if (strategy == e_packing::SEARCH) {
+        acttab_free(pBest);
+        pBest = pack_actions(lemp, ax, entries, bestOrder, bestFit);
+    }
+    for (int i : bestOrder) {
+        if (ax[i].isTkn) ax[i].stp->iTknOfst = ax[i].iOfst;
+        else ax[i].stp->iNtOfst = ax[i].iOfst;
+    }
+    lemp.packusec = (int)std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    return pBest;
+}
+
 /*
 ** Write text on "out" that describes the rule "rp".
 */
-static void writeRuleText(FILE* out, const rule* rp) {
+static void writeRuleText(outfile* out, const rule* rp) {
     int j;
-    fprintf(out, "%s ::=", rp->lhs->name);
+    oprintf(out, "%s ::=", rp->lhs->name);
     for (j = 0; j < rp->nrhs; j++) {
         const symbol* sp = rp->rhs[j];
         if (sp->type != symbol_type::MULTITERMINAL) {
-            fprintf(out, " %s", sp->name);
+            oprintf(out, " %s", sp->name);
         }
         else {
             int k;
-            fprintf(out, " %s", sp->subsym[0]->name);
+            oprintf(out, " %s", sp->subsym[0]->name);
             for (k = 1; k < sp->nsubsym; k++) {
-                fprintf(out, "|%s", sp->subsym[k]->name);
+                oprintf(out, "|%s", sp->subsym[k]->name);
             }
         }
     }
@@ -4224,13 +5241,286 @@ static void writeRuleText(FILE* out, const rule* rp) {
 
 char INCLUDE_BUFFER[] = "";
 
+/* Start a row of one of the big tables, whose first entry is number i */
+PRIVATE void table_row(outfile* out, int i)
+{
+    oputs(out, " /* ");
+    oputi(out, i, 5);
+    oputs(out, " */ ");
+}
+
+/* Write one entry of one of the big tables */
+PRIVATE void table_entry(outfile* out, int v)
+{
+    oputc(out, ' ');
+    oputi(out, v, 4);
+    oputc(out, ',');
+}
+
+/*
+** The yy_action[] and yy_lookahead[] tables exactly as ReportTable()
+** writes them, so that a dense matrix can be filled by doing the lookups
+** of the generated parser ahead of time.
+*/
+struct combtab {
+    std::vector<int> action;
+    std::vector<int> lookahead;
+};
+
+PRIVATE combtab comb_tables(const lemon& lemp, const acttab* pActtab)
+{
+    combtab t;
+    int i;
+    for (i = 0; i < acttab_action_size(pActtab); i++) {
+        int action = acttab_yyaction(pActtab, i);
+        t.action.push_back(action < 0 ? lemp.noAction : action);
+    }
+    for (i = 0; i < acttab_lookahead_size(pActtab); i++) {
+        int la = acttab_yylookahead(pActtab, i);
+        t.lookahead.push_back(la < 0 ? lemp.nsymbol : la);
+    }
+    t.lookahead.resize(lemp.nterminal + t.action.size(), lemp.nterminal);
+    return t;
+}
+
+/* What yy_find_shift_action() returns for a terminal in a state whose
+** yy_shift_ofst[] is ofst and yy_default[] is dflt */
+PRIVATE int comb_shift_action(const lemon& lemp, const combtab& t, int ofst, int dflt, int iLookAhead)
+{
+    for (;;) {
+        const int i = ofst + iLookAhead;
+        if (t.lookahead[i] == iLookAhead) return t.action[i];
+        if (lemp.has_fallback && lemp.symbols[iLookAhead]->fallback) {
+            iLookAhead = lemp.symbols[iLookAhead]->fallback->index;
+            continue;
+        }
+        if (lemp.wildcard && iLookAhead > 0) {
+            const int j = ofst + lemp.wildcard->index;
+            if (t.lookahead[j] == lemp.wildcard->index) return t.action[j];
+        }
+        return dflt;
+    }
+}
+
+/* What yy_find_reduce_action() returns for a non-terminal in a state whose
+** yy_reduce_ofst[] is ofst and yy_default[] is dflt */
+PRIVATE int comb_reduce_action(const combtab& t, int ofst, int dflt, int iLookAhead)
+{
+    const int i = ofst + iLookAhead;
+    if (i < 0 || i >= (int)t.action.size() || t.lookahead[i] != iLookAhead) return dflt;
+    return t.action[i];
+}
+
+/* Write one row of a dense matrix, ten entries to a line */
+PRIVATE void dense_row(outfile* out, int* plineno, int stateno, const std::vector<int>& row)
+{
+    size_t k;
+    table_row(out, stateno);
+    oputs(out, "{\n"); (*plineno)++;
+    for (k = 0; k < row.size(); k++) {
+        if (k % 10 == 0) oputs(out, "           ");
+        table_entry(out, row[k]);
+        if (k % 10 == 9 || k == row.size() - 1) {
+            oputc(out, '\n'); (*plineno)++;
+        }
+    }
+    oputs(out, "           },\n"); (*plineno)++;
+}
+
+/* Write the statement of yy_threaded() that carries out action value v.
+** After a goto a state number means to go on in that state; after a
+** token it means to shift, which is left to Parse(). */
+PRIVATE void threaded_jump(outfile* out, const lemon& lemp, int v, bool isGoto)
+{
+    if (v < lemp.nxstate && isGoto) oprintf(out, "goto yyS%d;", v);
+    else if (v >= lemp.minReduce) oprintf(out, "goto yyR%d;", v - lemp.minReduce);
+    else oprintf(out, "return %d;", v);
+}
+
+/* Write the case labels k[], ten to a line, leaving the line open */
+PRIVATE void threaded_cases(outfile* out, int* plineno, const std::vector<int>& k)
+{
+    size_t n;
+    for (n = 0; n < k.size(); n++) {
+        if (n % 10 == 0) oputs(out, "   ");
+        oprintf(out, " case %d:", k[n]);
+        if (n % 10 == 9 && n < k.size() - 1) {
+            oputc(out, '\n'); (*plineno)++;
+        }
+    }
+}
+
+/*
+** Write the switch on the look-ahead token of one state.  cases[] maps
+** each action to the tokens that lead to it.  The most common action
+** becomes the default.
+*/
+PRIVATE void threaded_switch(outfile* out, int* plineno, const lemon& lemp,
+    const std::map<int, std::vector<int>>& cases)
+{
+    int dflt = -1;
+    size_t nDflt = 0;
+    for (const auto& c : cases) {
+        if (c.second.size() > nDflt) {
+            dflt = c.first;
+            nDflt = c.second.size();
+        }
+    }
+    if (cases.size() == 1) {
+        oputs(out, "    ");
+        threaded_jump(out, lemp, dflt, false);
+        oputc(out, '\n'); (*plineno)++;
+        return;
+    }
+    oputs(out, "    switch (yymajor) {\n"); (*plineno)++;
+    for (const auto& c : cases) {
+        if (c.first == dflt) continue;
+        threaded_cases(out, plineno, c.second);
+        oputc(out, ' ');
+        threaded_jump(out, lemp, c.first, false);
+        oputc(out, '\n'); (*plineno)++;
+    }
+    oputs(out, "    default: ");
+    threaded_jump(out, lemp, dflt, false);
+    oputs(out, "\n    }\n"); *plineno += 2;
+}
+
+/*
+** Generate yy_threaded(), the direct-threaded form of the parser.  Each
+** state is a block of code labelled yyS<n> that switches on the look-ahead
+** token.  A shift, accept or error returns to Parse(), which finishes the
+** job as usual.  A reduce jumps to yyR<n>, which runs the code of rule n,
+** pops the stack and jumps to yyG<n>, the gotos on non-terminal n.  These
+** switch on the uncovered state and jump straight to the next block.
+**
+** The actions come from the comb tables, so the code does exactly what
+** the table-driven loop would do, fallback and wildcard tokens included.
+*/
+PRIVATE void ReportThreaded(outfile* out, int* plineno, const lemon& lemp, const combtab& comb)
+{
+    int i, j;
+    state* stp;
+    rule* rp;
+    std::vector<char> isLhs(lemp.nsymbol, 0);
+    const char* name = lemp.name ? lemp.name : "Parse";
+
+    for (rp = lemp.rule; rp; rp = rp->next) isLhs[rp->lhs->index] = 1;
+
+    oprintf(out,
+        "static YYACTIONTYPE yy_threaded(\n"
+        "    yyParser* yypParser,         /* The parser */\n"
+        "    YYCODETYPE yymajor,          /* The look-ahead token */\n"
+        "    %sTOKENTYPE yyminor       /* The value of the look-ahead token */\n"
+        "    %sCTX_PDECL               /* %%extra_context */\n"
+        ") {\n"
+        "    yyStackEntry* yymsp;\n"
+        "    YYACTIONTYPE yyact;\n"
+        "#ifdef YYCOMPUTEDGOTO\n"
+        "    static const void* const yyLabel[] = {\n", name, name);
+    *plineno += 10;
+    for (i = 0; i < lemp.maxAction; i++) {
+        if (i % 8 == 0) oputs(out, "       ");
+        if (i < lemp.nxstate) oprintf(out, " &&yyS%d,", i);
+        else if (i >= lemp.minReduce) oprintf(out, " &&yyR%d,", i - lemp.minReduce);
+        else oputs(out, " &&yyOther,");
+        if (i % 8 == 7 || i == lemp.maxAction - 1) {
+            oputc(out, '\n'); (*plineno)++;
+        }
+    }
+    oputs(out,
+        "    };\n"
+        "#endif\n"
+        "\n"
+        "    yyact = yypParser->yytos->stateno;\n"
+        "yyDispatch:\n"
+        "#ifdef YYCOMPUTEDGOTO\n"
+        "    assert(yyact < sizeof(yyLabel) / sizeof(yyLabel[0]));\n"
+        "    goto *yyLabel[yyact];\n"
+        "#else\n"
+        "    switch (yyact) {\n");
+    *plineno += 10;
+    for (i = 0; i < lemp.nxstate; i++) {
+        oprintf(out, "    case %d: goto yyS%d;\n", i, i); (*plineno)++;
+    }
+    for (i = 0; i < lemp.nrule; i++) {
+        oprintf(out, "    case %d: goto yyR%d;\n", i + lemp.minReduce, i); (*plineno)++;
+    }
+    oputs(out,
+        "    default: goto yyOther;\n"
+        "    }\n"
+        "#endif\n"
+        "yyOther:\n"
+        "    return yyact;\n");
+    *plineno += 5;
+
+    /* One block for each state, dispatching on the look-ahead token */
+    for (i = 0; i < lemp.nxstate; i++) {
+        std::map<int, std::vector<int>> cases;
+        stp = lemp.sorted[i];
+        const int ofst = stp->iTknOfst == NO_OFFSET ? (int)comb.action.size() : stp->iTknOfst;
+        const int dflt = stp->iDfltReduce < 0 ? lemp.errAction : stp->iDfltReduce + lemp.minReduce;
+        for (j = 0; j < lemp.nterminal; j++) cases[comb_shift_action(lemp, comb, ofst, dflt, j)].push_back(j);
+        oprintf(out, "yyS%d:\n", i); (*plineno)++;
+        threaded_switch(out, plineno, lemp, cases);
+    }
+
+    /* One block for each rule: run its code and pop the right-hand side */
+    for (rp = lemp.rule; rp; rp = rp->next) {
+        oprintf(out, "yyR%d: /* ", rp->iRule);
+        writeRuleText(out, rp);
+        oputs(out, " */\n"); (*plineno)++;
+        if (rp->nrhs == 0) {
+            oputs(out, "    if (yy_reduce_room(yypParser)) return YY_NO_ACTION;\n"); (*plineno)++;
+        }
+        if (rp->noCode == Boolean::LEMON_FALSE) {
+            oprintf(out, "    yy_reduce_action(yypParser, %d, yymajor, yyminor %sCTX_PARAM);\n",
+                rp->iRule, name); (*plineno)++;
+        }
+        oprintf(out, "    yymsp = yypParser->yytos += %d;\n", 1 - rp->nrhs); (*plineno)++;
+        if (rp->nrhs > 1) {
+            oputs(out, "    yyStackPopped(yypParser, yymsp);\n"); (*plineno)++;
+        }
+        oprintf(out, "    goto yyG%d;\n", rp->lhs->index); (*plineno)++;
+    }
+
+    /* One block for each non-terminal: the gotos on it.  States with no
+    ** entry for it in the tables get the answer from the tables. */
+    for (j = lemp.nterminal; j < lemp.nsymbol; j++) {
+        std::map<int, std::vector<int>> cases;
+        if (!isLhs[j]) continue;
+        for (i = 0; i < lemp.nxstate; i++) {
+            stp = lemp.sorted[i];
+            if (stp->iNtOfst == NO_OFFSET) continue;
+            const int v = comb_reduce_action(comb, stp->iNtOfst, -1, j);
+            if (v >= 0) cases[v].push_back(i);
+        }
+        oprintf(out, "yyG%d: /* %s */\n", j, lemp.symbols[j]->name); (*plineno)++;
+        oprintf(out, "    yymsp->major = %d;\n", j); (*plineno)++;
+        if (!cases.empty()) {
+            oputs(out, "    switch (yymsp[-1].stateno) {\n"); (*plineno)++;
+            for (const auto& c : cases) {
+                threaded_cases(out, plineno, c.second);
+                oprintf(out, " yymsp->stateno = %d; ", c.first);
+                threaded_jump(out, lemp, c.first, true);
+                oputc(out, '\n'); (*plineno)++;
+            }
+            oputs(out, "    }\n"); (*plineno)++;
+        }
+        oprintf(out, "    yymsp->stateno = yyact = yy_find_reduce_action(yymsp[-1].stateno, %d);\n", j);
+        (*plineno)++;
+        oputs(out, "    goto yyDispatch;\n"); (*plineno)++;
+    }
+    oputs(out, "}\n"); (*plineno)++;
+}
+
 /* Generate C source code for the parser */
 void ReportTable(
     lemon& lemp,
     int mhflag,     /* Output in makeheaders format if true */
     int sqlFlag     /* Generate the *.sql file too */
 ) {
-    FILE* out, * in, * sql;
+    outfile* out, * sql;
+    tplt_in in;
     char line[LINESIZE];
     int  lineno;
     state* stp;
@@ -4244,8 +5534,14 @@ void ReportTable(
     const char* name;
     int mnTknOfst, mxTknOfst;
     int mnNtOfst, mxNtOfst;
-    axset* ax;
+    std::vector<axset> ax;
     const char* prefix;
+    int nShift, nReduce;  /* States with a yy_shift_ofst[] / yy_reduce_ofst[] */
+    bool dense;           /* Write dense matrices instead of comb tables */
+    combtab comb;         /* The comb tables, for dense and threaded output */
+    const bool cpp = genp->opt.cplusplus;  /* Write the C++ parser of lempar.hpp */
+    const bool threaded = genp->opt.threaded && !cpp;
+    const char* zStatic = cpp ? "static constexpr" : "static const";  /* For the tables */
 
     lemp.minShiftReduce = lemp.nstate;
     lemp.errAction = lemp.minShiftReduce + lemp.nrule;
@@ -4254,24 +5550,19 @@ void ReportTable(
     lemp.minReduce = lemp.noAction + 1;
     lemp.maxAction = lemp.minReduce + lemp.nrule;
 
-    in = tplt_open(lemp);
-    if (in == nullptr) return;
-    out = file_open(lemp, ".c", "wb");
-    if (out == nullptr) {
-        fclose(in);
-        return;
-    }
+    if (tplt_open(lemp, in)) return;
+    out = file_open(lemp, cpp ? ".hpp" : ".c");
+    if (out == nullptr) return;
     if (sqlFlag == 0) {
         sql = nullptr;
     }
     else {
-        sql = file_open(lemp, ".sql", "wb");
+        sql = file_open(lemp, ".sql");
         if (sql == nullptr) {
-            fclose(in);
-            fclose(out);
+            file_close(out);
             return;
         }
-        fprintf(sql,
+        oprintf(sql,
             "BEGIN;\n"
             "CREATE TABLE symbol(\n"
             "  id INTEGER PRIMARY KEY,\n"
@@ -4282,20 +5573,20 @@ void ReportTable(
             ");\n"
         );
         for (i = 0; i < lemp.nsymbol; i++) {
-            fprintf(sql,
+            oprintf(sql,
                 "INSERT INTO symbol(id,name,isTerminal,fallback)"
                 "VALUES(%d,'%s',%s",
                 i, lemp.symbols[i]->name,
                 i < lemp.nterminal ? "TRUE" : "FALSE"
             );
             if (lemp.symbols[i]->fallback) {
-                fprintf(sql, ",%d);\n", lemp.symbols[i]->fallback->index);
+                oprintf(sql, ",%d);\n", lemp.symbols[i]->fallback->index);
             }
             else {
-                fprintf(sql, ",NULL);\n");
+                oputs(sql, ",NULL);\n");
             }
         }
-        fprintf(sql,
+        oprintf(sql,
             "CREATE TABLE rule(\n"
             "  ruleid INTEGER PRIMARY KEY,\n"
             "  lhs INTEGER REFERENCES symbol(id),\n"
@@ -4309,16 +5600,16 @@ void ReportTable(
         );
         for (i = 0, rp = lemp.rule; rp; rp = rp->next, i++) {
             assert(i == rp->iRule);
-            fprintf(sql,
+            oprintf(sql,
                 "INSERT INTO rule(ruleid,lhs,txt)VALUES(%d,%d,'",
                 rp->iRule, rp->lhs->index
             );
             writeRuleText(sql, rp);
-            fprintf(sql, "');\n");
+            oputs(sql, "');\n");
             for (j = 0; j < rp->nrhs; j++) {
                 const symbol* sp = rp->rhs[j];
                 if (sp->type != symbol_type::MULTITERMINAL) {
-                    fprintf(sql,
+                    oprintf(sql,
                         "INSERT INTO rulerhs(ruleid,pos,sym)VALUES(%d,%d,%d);\n",
                         i, j, sp->index
                     );
@@ -4326,7 +5617,7 @@ void ReportTable(
                 else {
                     int k;
                     for (k = 0; k < sp->nsubsym; k++) {
-                        fprintf(sql,
+                        oprintf(sql,
                             "INSERT INTO rulerhs(ruleid,pos,sym)VALUES(%d,%d,%d);\n",
                             i, j, sp->subsym[k]->index
                         );
@@ -4334,11 +5625,11 @@ void ReportTable(
                 }
             }
         }
-        fprintf(sql, "COMMIT;\n");
+        oputs(sql, "COMMIT;\n");
     }
     lineno = 1;
 
-    fprintf(out,
+    oprintf(out,
         "/* This file is automatically generated by Lemon from input grammar\n"
         "** source file \"%s\". */\n", lemp.filename); lineno += 2;
 
@@ -4363,8 +5654,8 @@ void ReportTable(
     tplt_print(out, lemp, lemp.include, &lineno);
     if (mhflag) {
         char* incName = file_makename(lemp, ".h");
-        fprintf(out, "#include \"%s\"\n", incName); lineno++;
-        delete[] incName;
+        oprintf(out, "#include \"%s\"\n", incName); lineno++;
+        lemon_free(incName);
     }
     tplt_xfer(lemp.name, in, out, &lineno);
 
@@ -4372,99 +5663,128 @@ void ReportTable(
     if (lemp.tokenprefix) prefix = lemp.tokenprefix;
     else                   prefix = "";
     if (mhflag) {
-        fprintf(out, "#if INTERFACE\n"); lineno++;
+        oputs(out, "#if INTERFACE\n"); lineno++;
     }
     else {
-        fprintf(out, "#ifndef %s%s\n", prefix, lemp.symbols[1]->name);
+        oprintf(out, "#ifndef %s%s\n", prefix, lemp.symbols[1]->name);
     }
     for (i = 1; i < lemp.nterminal; i++) {
-        fprintf(out, "#define %s%-30s %2d\n", prefix, lemp.symbols[i]->name, i);
+        oprintf(out, "#define %s%-30s %2d\n", prefix, lemp.symbols[i]->name, i);
         lineno++;
     }
-    fprintf(out, "#endif\n"); lineno++;
+    oputs(out, "#endif\n"); lineno++;
     tplt_xfer(lemp.name, in, out, &lineno);
 
     /* Generate the defines */
-    fprintf(out, "#define YYCODETYPE %s\n",
+    oprintf(out, "#define YYCODETYPE %s\n",
         minimum_size_type(0, lemp.nsymbol, &szCodeType)); lineno++;
-    fprintf(out, "#define YYNOCODE %d\n", lemp.nsymbol);  lineno++;
-    fprintf(out, "#define YYACTIONTYPE %s\n",
+    oprintf(out, "#define YYNOCODE %d\n", lemp.nsymbol);  lineno++;
+    oprintf(out, "#define YYACTIONTYPE %s\n",
         minimum_size_type(0, lemp.maxAction, &szActionType)); lineno++;
     if (lemp.wildcard) {
-        fprintf(out, "#define YYWILDCARD %d\n",
+        oprintf(out, "#define YYWILDCARD %d\n",
             lemp.wildcard->index); lineno++;
     }
     print_stack_union(out, lemp, &lineno, mhflag);
-    fprintf(out, "#ifndef YYSTACKDEPTH\n"); lineno++;
+    oputs(out, "#ifndef YYSTACKDEPTH\n"); lineno++;
     if (lemp.stacksize) {
-        fprintf(out, "#define YYSTACKDEPTH %s\n", lemp.stacksize);  lineno++;
+        oprintf(out, "#define YYSTACKDEPTH %s\n", lemp.stacksize);  lineno++;
     }
     else {
-        fprintf(out, "#define YYSTACKDEPTH 100\n");  lineno++;
+        oputs(out, "#define YYSTACKDEPTH 100\n");  lineno++;
     }
-    fprintf(out, "#endif\n"); lineno++;
+    oputs(out, "#endif\n"); lineno++;
     if (mhflag) {
-        fprintf(out, "#if INTERFACE\n"); lineno++;
+        oputs(out, "#if INTERFACE\n"); lineno++;
     }
     name = lemp.name ? lemp.name : "Parse";
     if (lemp.arg && lemp.arg[0]) {
         i = lemonStrlen(lemp.arg);
         while (i >= 1 && ISSPACE(lemp.arg[i - 1])) i--;
         while (i >= 1 && (ISALNUM(lemp.arg[i - 1]) || lemp.arg[i - 1] == '_')) i--;
-        fprintf(out, "#define %sARG_SDECL %s;\n", name, lemp.arg);  lineno++;
-        fprintf(out, "#define %sARG_PDECL ,%s\n", name, lemp.arg);  lineno++;
-        fprintf(out, "#define %sARG_PARAM ,%s\n", name, &lemp.arg[i]);  lineno++;
-        fprintf(out, "#define %sARG_FETCH %s=yypParser->%s;\n",
-            name, lemp.arg, &lemp.arg[i]);  lineno++;
-        fprintf(out, "#define %sARG_STORE yypParser->%s=%s;\n",
-            name, &lemp.arg[i], &lemp.arg[i]);  lineno++;
+        oprintf(out, "#define %sARG_SDECL %s;\n", name, lemp.arg);  lineno++;
+        oprintf(out, "#define %sARG_PDECL ,%s\n", name, lemp.arg);  lineno++;
+        if (cpp) {
+            oprintf(out, "#define %sARG_STORE this->%s=%s;\n",
+                name, &lemp.arg[i], &lemp.arg[i]);  lineno++;
+        }
+        else {
+            oprintf(out, "#define %sARG_PARAM ,%s\n", name, &lemp.arg[i]);  lineno++;
+            oprintf(out, "#define %sARG_FETCH %s=yypParser->%s;\n",
+                name, lemp.arg, &lemp.arg[i]);  lineno++;
+            oprintf(out, "#define %sARG_STORE yypParser->%s=%s;\n",
+                name, &lemp.arg[i], &lemp.arg[i]);  lineno++;
+        }
+    }
+    else if (cpp) {
+        oprintf(out, "#define %sARG_SDECL\n", name); lineno++;
+        oprintf(out, "#define %sARG_PDECL\n", name); lineno++;
+        oprintf(out, "#define %sARG_STORE\n", name); lineno++;
     }
     else {
-        fprintf(out, "#define %sARG_SDECL\n", name); lineno++;
-        fprintf(out, "#define %sARG_PDECL\n", name); lineno++;
-        fprintf(out, "#define %sARG_PARAM\n", name); lineno++;
-        fprintf(out, "#define %sARG_FETCH\n", name); lineno++;
-        fprintf(out, "#define %sARG_STORE\n", name); lineno++;
+        oprintf(out, "#define %sARG_SDECL\n", name); lineno++;
+        oprintf(out, "#define %sARG_PDECL\n", name); lineno++;
+        oprintf(out, "#define %sARG_PARAM\n", name); lineno++;
+        oprintf(out, "#define %sARG_FETCH\n", name); lineno++;
+        oprintf(out, "#define %sARG_STORE\n", name); lineno++;
+    }
+    if (cpp) {
+        /* The parser class is a template on the type of the %extra_context,
+        ** and keeps the context as a member under its declared name */
+        if (lemp.ctx && lemp.ctx[0]) {
+            int k;
+            i = lemonStrlen(lemp.ctx);
+            while (i >= 1 && ISSPACE(lemp.ctx[i - 1])) i--;
+            k = i;
+            while (i >= 1 && (ISALNUM(lemp.ctx[i - 1]) || lemp.ctx[i - 1] == '_')) i--;
+            oprintf(out, "#define %sCTX_TYPE %.*s\n", name, i, lemp.ctx);  lineno++;
+            oprintf(out, "#define %sCTX_SDECL Context %.*s;\n", name, k - i, &lemp.ctx[i]);  lineno++;
+            oprintf(out, "#define %sCTX_CDECL Context %.*s\n", name, k - i, &lemp.ctx[i]);  lineno++;
+            oprintf(out, "#define %sCTX_STORE this->%.*s=%.*s;\n",
+                name, k - i, &lemp.ctx[i], k - i, &lemp.ctx[i]);  lineno++;
+        }
+        else {
+            oprintf(out, "#define %sCTX_TYPE void\n", name); lineno++;
+            oprintf(out, "#define %sCTX_SDECL\n", name); lineno++;
+            oprintf(out, "#define %sCTX_CDECL\n", name); lineno++;
+            oprintf(out, "#define %sCTX_STORE\n", name); lineno++;
+        }
     }
-    if (lemp.ctx && lemp.ctx[0]) {
+    else if (lemp.ctx && lemp.ctx[0]) {
         i = lemonStrlen(lemp.ctx);
         while (i >= 1 && ISSPACE(lemp.ctx[i - 1])) i--;
         while (i >= 1 && (ISALNUM(lemp.ctx[i - 1]) || lemp.ctx[i - 1] == '_')) i--;
-        fprintf(out, "#define %sCTX_SDECL %s;\n", name, lemp.ctx);  lineno++;
-        fprintf(out, "#define %sCTX_PDECL ,%s\n", name, lemp.ctx);  lineno++;
-        fprintf(out, "#define %sCTX_PARAM ,%s\n", name, &lemp.ctx[i]);  lineno++;
-        fprintf(out, "#define %sCTX_FETCH %s=yypParser->%s;\n",
+        oprintf(out, "#define %sCTX_SDECL %s;\n", name, lemp.ctx);  lineno++;
+        oprintf(out, "#define %sCTX_PDECL ,%s\n", name, lemp.ctx);  lineno++;
+        oprintf(out, "#define %sCTX_PARAM ,%s\n", name, &lemp.ctx[i]);  lineno++;
+        oprintf(out, "#define %sCTX_FETCH %s=yypParser->%s;\n",
             name, lemp.ctx, &lemp.ctx[i]);  lineno++;
-        fprintf(out, "#define %sCTX_STORE yypParser->%s=%s;\n",
+        oprintf(out, "#define %sCTX_STORE yypParser->%s=%s;\n",
             name, &lemp.ctx[i], &lemp.ctx[i]);  lineno++;
     }
     else {
-        fprintf(out, "#define %sCTX_SDECL\n", name); lineno++;
-        fprintf(out, "#define %sCTX_PDECL\n", name); lineno++;
-        fprintf(out, "#define %sCTX_PARAM\n", name); lineno++;
-        fprintf(out, "#define %sCTX_FETCH\n", name); lineno++;
-        fprintf(out, "#define %sCTX_STORE\n", name); lineno++;
+        oprintf(out, "#define %sCTX_SDECL\n", name); lineno++;
+        oprintf(out, "#define %sCTX_PDECL\n", name); lineno++;
+        oprintf(out, "#define %sCTX_PARAM\n", name); lineno++;
+        oprintf(out, "#define %sCTX_FETCH\n", name); lineno++;
+        oprintf(out, "#define %sCTX_STORE\n", name); lineno++;
     }
     if (mhflag) {
-        fprintf(out, "#endif\n"); lineno++;
+        oputs(out, "#endif\n"); lineno++;
     }
     if (lemp.errsym && lemp.errsym->useCnt) {
-        fprintf(out, "#define YYERRORSYMBOL %d\n", lemp.errsym->index); lineno++;
-        fprintf(out, "#define YYERRSYMDT yy%d\n", lemp.errsym->dtnum); lineno++;
+        oprintf(out, "#define YYERRORSYMBOL %d\n", lemp.errsym->index); lineno++;
+        oprintf(out, "#define YYERRSYMDT yy%d\n", lemp.errsym->dtnum); lineno++;
     }
     if (lemp.has_fallback) {
-        fprintf(out, "#define YYFALLBACK 1\n");  lineno++;
+        oputs(out, "#define YYFALLBACK 1\n");  lineno++;
     }
 
     /* Compute the action table, but do not output it yet.  The action
     ** table must be computed before generating the YYNSTATE macro because
     ** we need to know how many states can be eliminated.
     */
-    ax = (axset*)calloc(lemp.nxstate * 2, sizeof(ax[0]));
-    if (ax == nullptr) {
-        fprintf(stderr, "malloc failed\n");
-        exit(1);
-    }
+    ax.resize(lemp.nxstate * 2);
     for (i = 0; i < lemp.nxstate; i++) {
         stp = lemp.sorted[i];
         ax[i * 2].stp = stp;
@@ -4474,55 +5794,34 @@ void ReportTable(
         ax[i * 2 + 1].isTkn = 0;
         ax[i * 2 + 1].nAction = stp->nNtAct;
     }
-    mxTknOfst = mnTknOfst = 0;
-    mxNtOfst = mnNtOfst = 0;
-    /* In an effort to minimize the action table size, use the heuristic
-    ** of placing the largest action sets first */
     for (i = 0; i < lemp.nxstate * 2; i++) ax[i].iOrder = i;
-    
-    //previously a qsort()
-    std::sort(ax, ax + lemp.nxstate * 2);
-    
-    pActtab = acttab_alloc(lemp.nsymbol, lemp.nterminal);
-    for (i = 0; i < lemp.nxstate * 2 && ax[i].nAction>0; i++) {
-        stp = ax[i].stp;
-        if (ax[i].isTkn) {
-            for (ap = stp->ap; ap; ap = ap->next) {
-                int action;
-                if (ap->sp->index >= lemp.nterminal) continue;
-                action = compute_action(lemp, ap);
-                if (action < 0) continue;
-                acttab_action(pActtab, ap->sp->index, action);
-            }
-            stp->iTknOfst = acttab_insert(pActtab, 1);
-            if (stp->iTknOfst < mnTknOfst) mnTknOfst = stp->iTknOfst;
-            if (stp->iTknOfst > mxTknOfst) mxTknOfst = stp->iTknOfst;
-        }
-        else {
-            for (ap = stp->ap; ap; ap = ap->next) {
-                int action;
-                if (ap->sp->index < lemp.nterminal) continue;
-                if (ap->sp->index == lemp.nsymbol) continue;
-                action = compute_action(lemp, ap);
-                if (action < 0) continue;
-                acttab_action(pActtab, ap->sp->index, action);
+    if (genp->cached) {
+        pActtab = acttab_restore(lemp.nsymbol, lemp.nterminal, genp->packed);
+        for (auto& x : ax) x.iOfst = x.isTkn ? x.stp->iTknOfst : x.stp->iNtOfst;
+    }
+    else {
+        pActtab = PackActions(lemp, ax);
+        if (genp->opt.cache) {
+            genp->packed.clear();
+            for (i = 0; i < pActtab->nAction; i++) {
+                genp->packed.push_back(pActtab->aAction[i].lookahead);
+                genp->packed.push_back(pActtab->aAction[i].action);
             }
-            stp->iNtOfst = acttab_insert(pActtab, 0);
-            if (stp->iNtOfst < mnNtOfst) mnNtOfst = stp->iNtOfst;
-            if (stp->iNtOfst > mxNtOfst) mxNtOfst = stp->iNtOfst;
         }
-#if 0  /* Uncomment for a trace of how the yy_action[] table fills out */
-        { int jj, nn;
-        for (jj = nn = 0; jj < pActtab->nAction; jj++) {
-            if (pActtab->aAction[jj].action < 0) nn++;
+    }
+    mxTknOfst = mnTknOfst = 0;
+    mxNtOfst = mnNtOfst = 0;
+    for (const auto& x : ax) {
+        if (x.nAction <= 0) continue;
+        if (x.isTkn) {
+            if (x.iOfst < mnTknOfst) mnTknOfst = x.iOfst;
+            if (x.iOfst > mxTknOfst) mxTknOfst = x.iOfst;
         }
-        printf("%4d: State %3d %s n: %2d size: %5d freespace: %d\n",
-            i, stp->statenum, ax[i].isTkn ? "Token" : "Var  ",
-            ax[i].nAction, pActtab->nAction, nn);
+        else {
+            if (x.iOfst < mnNtOfst) mnNtOfst = x.iOfst;
+            if (x.iOfst > mxNtOfst) mxNtOfst = x.iOfst;
         }
-#endif
     }
-    free(ax);
 
     /* Mark rules that are actually used for reduce actions after all
     ** optimizations have been applied
@@ -4536,169 +5835,229 @@ void ReportTable(
         }
     }
 
+    /* Small grammars get dense matrices indexed by state and symbol,
+    ** if they fit in the budget.  These replace the comb tables below,
+    ** so a -T template that predates YYDENSE always gets comb tables.
+    */
+    nShift = lemp.nxstate;
+    while (nShift > 0 && lemp.sorted[nShift - 1]->iTknOfst == NO_OFFSET) nShift--;
+    nReduce = lemp.nxstate;
+    while (nReduce > 0 && lemp.sorted[nReduce - 1]->iNtOfst == NO_OFFSET) nReduce--;
+    sz = (nShift * lemp.nterminal + nReduce * (lemp.nsymbol - lemp.nterminal)) * szActionType;
+    dense = in.t->dense && genp->opt.denseBudget > 0 && nShift > 0 && nReduce > 0
+        && sz <= genp->opt.denseBudget;
+
     /* Finish rendering the constants now that the action table has
     ** been computed */
-    fprintf(out, "#define YYNSTATE             %d\n", lemp.nxstate);  lineno++;
-    fprintf(out, "#define YYNRULE              %d\n", lemp.nrule);  lineno++;
-    fprintf(out, "#define YYNRULE_WITH_ACTION  %d\n", lemp.nruleWithAction);
+    oprintf(out, "#define YYNSTATE             %d\n", lemp.nxstate);  lineno++;
+    oprintf(out, "#define YYNRULE              %d\n", lemp.nrule);  lineno++;
+    oprintf(out, "#define YYNRULE_WITH_ACTION  %d\n", lemp.nruleWithAction);
     lineno++;
-    fprintf(out, "#define YYNTOKEN             %d\n", lemp.nterminal); lineno++;
-    fprintf(out, "#define YY_MAX_SHIFT         %d\n", lemp.nxstate - 1); lineno++;
+    oprintf(out, "#define YYNTOKEN             %d\n", lemp.nterminal); lineno++;
+    oprintf(out, "#define YY_MAX_SHIFT         %d\n", lemp.nxstate - 1); lineno++;
     i = lemp.minShiftReduce;
-    fprintf(out, "#define YY_MIN_SHIFTREDUCE   %d\n", i); lineno++;
+    oprintf(out, "#define YY_MIN_SHIFTREDUCE   %d\n", i); lineno++;
     i += lemp.nrule;
-    fprintf(out, "#define YY_MAX_SHIFTREDUCE   %d\n", i - 1); lineno++;
-    fprintf(out, "#define YY_ERROR_ACTION      %d\n", lemp.errAction); lineno++;
-    fprintf(out, "#define YY_ACCEPT_ACTION     %d\n", lemp.accAction); lineno++;
-    fprintf(out, "#define YY_NO_ACTION         %d\n", lemp.noAction); lineno++;
-    fprintf(out, "#define YY_MIN_REDUCE        %d\n", lemp.minReduce); lineno++;
+    oprintf(out, "#define YY_MAX_SHIFTREDUCE   %d\n", i - 1); lineno++;
+    oprintf(out, "#define YY_ERROR_ACTION      %d\n", lemp.errAction); lineno++;
+    oprintf(out, "#define YY_ACCEPT_ACTION     %d\n", lemp.accAction); lineno++;
+    oprintf(out, "#define YY_NO_ACTION         %d\n", lemp.noAction); lineno++;
+    oprintf(out, "#define YY_MIN_REDUCE        %d\n", lemp.minReduce); lineno++;
     i = lemp.minReduce + lemp.nrule;
-    fprintf(out, "#define YY_MAX_REDUCE        %d\n", i - 1); lineno++;
+    oprintf(out, "#define YY_MAX_REDUCE        %d\n", i - 1); lineno++;
+    if (dense) {
+        oputs(out, "#define YYDENSE 1\n"); lineno++;
+    }
+    if (threaded) {
+        oputs(out, "#define YYTHREADED 1\n"); lineno++;
+    }
     tplt_xfer(lemp.name, in, out, &lineno);
 
-    /* Now output the action table and its associates:
-    **
-    **  yy_action[]        A single table containing all actions.
-    **  yy_lookahead[]     A table containing the lookahead for each entry in
-    **                     yy_action.  Used to detect hash collisions.
-    **  yy_shift_ofst[]    For each state, the offset into yy_action for
-    **                     shifting terminals.
-    **  yy_reduce_ofst[]   For each state, the offset into yy_action for
-    **                     shifting non-terminals after a reduce.
-    **  yy_default[]       Default action for each state.
-    */
+    if (dense || threaded) comb = comb_tables(lemp, pActtab);
+    if (dense) {
+        std::vector<int> row;
+        lemp.nactiontab = acttab_action_size(pActtab);
+        lemp.nlookaheadtab = acttab_lookahead_size(pActtab);
 
-    /* Output the yy_action table */
-    lemp.nactiontab = n = acttab_action_size(pActtab);
-    lemp.tablesize += n * szActionType;
-    fprintf(out, "#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
-    fprintf(out, "static const YYACTIONTYPE yy_action[] = {\n"); lineno++;
-    for (i = j = 0; i < n; i++) {
-        int action = acttab_yyaction(pActtab, i);
-        if (action < 0) action = lemp.noAction;
-        if (j == 0) fprintf(out, " /* %5d */ ", i);
-        fprintf(out, " %4d,", action);
-        if (j == 9 || i == n - 1) {
-            fprintf(out, "\n"); lineno++;
-            j = 0;
-        }
-        else {
-            j++;
+        /* Output yy_dense_action[][] */
+        oprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", nShift - 1); lineno++;
+        oprintf(out, "%s YYACTIONTYPE yy_dense_action[YY_SHIFT_COUNT + 1][YYNTOKEN] = {\n", zStatic);
+        lineno++;
+        lemp.tablesize += nShift * lemp.nterminal * szActionType;
+        for (i = 0; i < nShift; i++) {
+            stp = lemp.sorted[i];
+            const int ofst = stp->iTknOfst == NO_OFFSET ? lemp.nactiontab : stp->iTknOfst;
+            const int dflt = stp->iDfltReduce < 0 ? lemp.errAction : stp->iDfltReduce + lemp.minReduce;
+            row.clear();
+            for (j = 0; j < lemp.nterminal; j++) row.push_back(comb_shift_action(lemp, comb, ofst, dflt, j));
+            dense_row(out, &lineno, i, row);
+        }
+        oputs(out, "};\n"); lineno++;
+
+        /* Output yy_dense_goto[][] */
+        oprintf(out, "#define YY_REDUCE_COUNT (%d)\n", nReduce - 1); lineno++;
+        oprintf(out, "%s YYACTIONTYPE yy_dense_goto[YY_REDUCE_COUNT + 1][YYNOCODE - YYNTOKEN] = {\n", zStatic);
+        lineno++;
+        lemp.tablesize += nReduce * (lemp.nsymbol - lemp.nterminal) * szActionType;
+        for (i = 0; i < nReduce; i++) {
+            stp = lemp.sorted[i];
+            const int ofst = stp->iNtOfst == NO_OFFSET ? mnNtOfst - 1 : stp->iNtOfst;
+            const int dflt = stp->iDfltReduce < 0 ? lemp.errAction : stp->iDfltReduce + lemp.minReduce;
+            row.clear();
+            for (j = lemp.nterminal; j < lemp.nsymbol; j++) row.push_back(comb_reduce_action(comb, ofst, dflt, j));
+            dense_row(out, &lineno, i, row);
         }
+        oputs(out, "};\n"); lineno++;
     }
-    fprintf(out, "};\n"); lineno++;
+    else {
 
-    /* Output the yy_lookahead table */
-    lemp.nlookaheadtab = n = acttab_lookahead_size(pActtab);
-    lemp.tablesize += n * szCodeType;
-    fprintf(out, "static const YYCODETYPE yy_lookahead[] = {\n"); lineno++;
-    for (i = j = 0; i < n; i++) {
-        int la = acttab_yylookahead(pActtab, i);
-        if (la < 0) la = lemp.nsymbol;
-        if (j == 0) fprintf(out, " /* %5d */ ", i);
-        fprintf(out, " %4d,", la);
-        if (j == 9) {
-            fprintf(out, "\n"); lineno++;
-            j = 0;
-        }
-        else {
-            j++;
-        }
-    }
-    /* Add extra entries to the end of the yy_lookahead[] table so that
-    ** yy_shift_ofst[]+iToken will always be a valid index into the array,
-    ** even for the largest possible value of yy_shift_ofst[] and iToken. */
-    nLookAhead = lemp.nterminal + lemp.nactiontab;
-    while (i < nLookAhead) {
-        if (j == 0) fprintf(out, " /* %5d */ ", i);
-        fprintf(out, " %4d,", lemp.nterminal);
-        if (j == 9) {
-            fprintf(out, "\n"); lineno++;
-            j = 0;
+        /* Now output the action table and its associates:
+        **
+        **  yy_action[]        A single table containing all actions.
+        **  yy_lookahead[]     A table containing the lookahead for each entry in
+        **                     yy_action.  Used to detect hash collisions.
+        **  yy_shift_ofst[]    For each state, the offset into yy_action for
+        **                     shifting terminals.
+        **  yy_reduce_ofst[]   For each state, the offset into yy_action for
+        **                     shifting non-terminals after a reduce.
+        **  yy_default[]       Default action for each state.
+        */
+
+        /* Output the yy_action table */
+        lemp.nactiontab = n = acttab_action_size(pActtab);
+        lemp.tablesize += n * szActionType;
+        oprintf(out, "#define YY_ACTTAB_COUNT (%d)\n", n); lineno++;
+        oprintf(out, "%s YYACTIONTYPE yy_action[] = {\n", zStatic); lineno++;
+        for (i = j = 0; i < n; i++) {
+            int action = acttab_yyaction(pActtab, i);
+            if (action < 0) action = lemp.noAction;
+            if (j == 0) table_row(out, i);
+            table_entry(out, action);
+            if (j == 9 || i == n - 1) {
+                oputs(out, "\n"); lineno++;
+                j = 0;
+            }
+            else {
+                j++;
+            }
         }
-        else {
-            j++;
+        oputs(out, "};\n"); lineno++;
+
+        /* Output the yy_lookahead table */
+        lemp.nlookaheadtab = n = acttab_lookahead_size(pActtab);
+        lemp.tablesize += n * szCodeType;
+        oprintf(out, "%s YYCODETYPE yy_lookahead[] = {\n", zStatic); lineno++;
+        for (i = j = 0; i < n; i++) {
+            int la = acttab_yylookahead(pActtab, i);
+            if (la < 0) la = lemp.nsymbol;
+            if (j == 0) table_row(out, i);
+            table_entry(out, la);
+            if (j == 9) {
+                oputs(out, "\n"); lineno++;
+                j = 0;
+            }
+            else {
+                j++;
+            }
         }
-        i++;
-    }
-    if (j > 0) { fprintf(out, "\n"); lineno++; }
-    fprintf(out, "};\n"); lineno++;
-
-    /* Output the yy_shift_ofst[] table */
-    n = lemp.nxstate;
-    while (n > 0 && lemp.sorted[n - 1]->iTknOfst == NO_OFFSET) n--;
-    fprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n - 1); lineno++;
-    fprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); lineno++;
-    fprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); lineno++;
-    fprintf(out, "static const %s yy_shift_ofst[] = {\n",
-        minimum_size_type(mnTknOfst, lemp.nterminal + lemp.nactiontab, &sz));
-    lineno++;
-    lemp.tablesize += n * sz;
-    for (i = j = 0; i < n; i++) {
-        int ofst;
-        stp = lemp.sorted[i];
-        ofst = stp->iTknOfst;
-        if (ofst == NO_OFFSET) ofst = lemp.nactiontab;
-        if (j == 0) fprintf(out, " /* %5d */ ", i);
-        fprintf(out, " %4d,", ofst);
-        if (j == 9 || i == n - 1) {
-            fprintf(out, "\n"); lineno++;
-            j = 0;
+        /* Add extra entries to the end of the yy_lookahead[] table so that
+        ** yy_shift_ofst[]+iToken will always be a valid index into the array,
+        ** even for the largest possible value of yy_shift_ofst[] and iToken. */
+        nLookAhead = lemp.nterminal + lemp.nactiontab;
+        while (i < nLookAhead) {
+            if (j == 0) table_row(out, i);
+            table_entry(out, lemp.nterminal);
+            if (j == 9) {
+                oputs(out, "\n"); lineno++;
+                j = 0;
+            }
+            else {
+                j++;
+            }
+            i++;
         }
-        else {
-            j++;
-        }
-    }
-    fprintf(out, "};\n"); lineno++;
-
-    /* Output the yy_reduce_ofst[] table */
-    n = lemp.nxstate;
-    while (n > 0 && lemp.sorted[n - 1]->iNtOfst == NO_OFFSET) n--;
-    fprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n - 1); lineno++;
-    fprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
-    fprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
-    fprintf(out, "static const %s yy_reduce_ofst[] = {\n",
-        minimum_size_type(mnNtOfst - 1, mxNtOfst, &sz)); lineno++;
-    lemp.tablesize += n * sz;
-    for (i = j = 0; i < n; i++) {
-        int ofst;
-        stp = lemp.sorted[i];
-        ofst = stp->iNtOfst;
-        if (ofst == NO_OFFSET) ofst = mnNtOfst - 1;
-        if (j == 0) fprintf(out, " /* %5d */ ", i);
-        fprintf(out, " %4d,", ofst);
-        if (j == 9 || i == n - 1) {
-            fprintf(out, "\n"); lineno++;
-            j = 0;
+        if (j > 0) { oputs(out, "\n"); lineno++; }
+        oputs(out, "};\n"); lineno++;
+
+        /* Output the yy_shift_ofst[] table */
+        n = lemp.nxstate;
+        while (n > 0 && lemp.sorted[n - 1]->iTknOfst == NO_OFFSET) n--;
+        oprintf(out, "#define YY_SHIFT_COUNT    (%d)\n", n - 1); lineno++;
+        oprintf(out, "#define YY_SHIFT_MIN      (%d)\n", mnTknOfst); lineno++;
+        oprintf(out, "#define YY_SHIFT_MAX      (%d)\n", mxTknOfst); lineno++;
+        oprintf(out, "%s %s yy_shift_ofst[] = {\n", zStatic,
+            minimum_size_type(mnTknOfst, lemp.nterminal + lemp.nactiontab, &sz));
+        lineno++;
+        lemp.tablesize += n * sz;
+        for (i = j = 0; i < n; i++) {
+            int ofst;
+            stp = lemp.sorted[i];
+            ofst = stp->iTknOfst;
+            if (ofst == NO_OFFSET) ofst = lemp.nactiontab;
+            if (j == 0) table_row(out, i);
+            table_entry(out, ofst);
+            if (j == 9 || i == n - 1) {
+                oputs(out, "\n"); lineno++;
+                j = 0;
+            }
+            else {
+                j++;
+            }
         }
-        else {
-            j++;
+        oputs(out, "};\n"); lineno++;
+
+        /* Output the yy_reduce_ofst[] table */
+        n = lemp.nxstate;
+        while (n > 0 && lemp.sorted[n - 1]->iNtOfst == NO_OFFSET) n--;
+        oprintf(out, "#define YY_REDUCE_COUNT (%d)\n", n - 1); lineno++;
+        oprintf(out, "#define YY_REDUCE_MIN   (%d)\n", mnNtOfst); lineno++;
+        oprintf(out, "#define YY_REDUCE_MAX   (%d)\n", mxNtOfst); lineno++;
+        oprintf(out, "%s %s yy_reduce_ofst[] = {\n", zStatic,
+            minimum_size_type(mnNtOfst - 1, mxNtOfst, &sz)); lineno++;
+        lemp.tablesize += n * sz;
+        for (i = j = 0; i < n; i++) {
+            int ofst;
+            stp = lemp.sorted[i];
+            ofst = stp->iNtOfst;
+            if (ofst == NO_OFFSET) ofst = mnNtOfst - 1;
+            if (j == 0) table_row(out, i);
+            table_entry(out, ofst);
+            if (j == 9 || i == n - 1) {
+                oputs(out, "\n"); lineno++;
+                j = 0;
+            }
+            else {
+                j++;
+            }
         }
+        oputs(out, "};\n"); lineno++;
     }
-    fprintf(out, "};\n"); lineno++;
 
-    /* Output the default action table */
-    fprintf(out, "static const YYACTIONTYPE yy_default[] = {\n"); lineno++;
-    n = lemp.nxstate;
-    lemp.tablesize += n * szActionType;
-    for (i = j = 0; i < n; i++) {
-        stp = lemp.sorted[i];
-        if (j == 0) fprintf(out, " /* %5d */ ", i);
-        if (stp->iDfltReduce < 0) {
-            fprintf(out, " %4d,", lemp.errAction);
-        }
-        else {
-            fprintf(out, " %4d,", stp->iDfltReduce + lemp.minReduce);
-        }
-        if (j == 9 || i == n - 1) {
-            fprintf(out, "\n"); lineno++;
-            j = 0;
-        }
-        else {
-            j++;
+    /* Output the default action table.  Dense tables only need it to
+    ** recover from errors. */
+    if (!dense || (lemp.errsym && lemp.errsym->useCnt)) {
+        oprintf(out, "%s YYACTIONTYPE yy_default[] = {\n", zStatic); lineno++;
+        n = lemp.nxstate;
+        lemp.tablesize += n * szActionType;
+        for (i = j = 0; i < n; i++) {
+            stp = lemp.sorted[i];
+            if (j == 0) table_row(out, i);
+            if (stp->iDfltReduce < 0) {
+                table_entry(out, lemp.errAction);
+            }
+            else {
+                table_entry(out, stp->iDfltReduce + lemp.minReduce);
+            }
+            if (j == 9 || i == n - 1) {
+                oputs(out, "\n"); lineno++;
+                j = 0;
+            }
+            else {
+                j++;
+            }
         }
+        oputs(out, "};\n"); lineno++;
     }
-    fprintf(out, "};\n"); lineno++;
     tplt_xfer(lemp.name, in, out, &lineno);
 
     /* Generate the table of fallback tokens.
@@ -4712,10 +6071,10 @@ void ReportTable(
         for (i = 0; i <= mx; i++) {
             const symbol* p = lemp.symbols[i];
             if (p->fallback == nullptr) {
-                fprintf(out, "    0,  /* %10s => nothing */\n", p->name);
+                oprintf(out, "    0,  /* %10s => nothing */\n", p->name);
             }
             else {
-                fprintf(out, "  %3d,  /* %10s => %s */\n", p->fallback->index,
+                oprintf(out, "  %3d,  /* %10s => %s */\n", p->fallback->index,
                     p->name, p->fallback->name);
             }
             lineno++;
@@ -4727,7 +6086,7 @@ void ReportTable(
     */
     for (i = 0; i < lemp.nsymbol; i++) {
         lemon_sprintf(line, "\"%s\",", lemp.symbols[i]->name);
-        fprintf(out, "  /* %4d */ \"%s\",\n", i, lemp.symbols[i]->name); lineno++;
+        oprintf(out, "  /* %4d */ \"%s\",\n", i, lemp.symbols[i]->name); lineno++;
     }
     tplt_xfer(lemp.name, in, out, &lineno);
 
@@ -4737,9 +6096,9 @@ void ReportTable(
     */
     for (i = 0, rp = lemp.rule; rp; rp = rp->next, i++) {
         assert(rp->iRule == i);
-        fprintf(out, " /* %3d */ \"", i);
+        oprintf(out, " /* %3d */ \"", i);
         writeRuleText(out, rp);
-        fprintf(out, "\",\n"); lineno++;
+        oputs(out, "\",\n"); lineno++;
     }
     tplt_xfer(lemp.name, in, out, &lineno);
 
@@ -4753,15 +6112,15 @@ void ReportTable(
             const symbol* sp = lemp.symbols[i];
             if (sp == nullptr || sp->type != symbol_type::TERMINAL) continue;
             if (once) {
-                fprintf(out, "      /* TERMINAL Destructor */\n"); lineno++;
+                oputs(out, "      /* TERMINAL Destructor */\n"); lineno++;
                 once = 0;
             }
-            fprintf(out, "    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+            oprintf(out, "    case %d: /* %s */\n", sp->index, sp->name); lineno++;
         }
         for (i = 0; i < lemp.nsymbol && lemp.symbols[i]->type != symbol_type::TERMINAL; i++);
         if (i < lemp.nsymbol) {
             emit_destructor_code(out, lemp.symbols[i], lemp, &lineno);
-            fprintf(out, "      break;\n"); lineno++;
+            oputs(out, "      break;\n"); lineno++;
         }
     }
     if (lemp.vardest) {
@@ -4772,22 +6131,22 @@ void ReportTable(
             if (sp == nullptr || sp->type == symbol_type::TERMINAL ||
                 sp->index <= 0 || sp->destructor != nullptr) continue;
             if (once) {
-                fprintf(out, "      /* Default NON-TERMINAL Destructor */\n"); lineno++;
+                oputs(out, "      /* Default NON-TERMINAL Destructor */\n"); lineno++;
                 once = 0;
             }
-            fprintf(out, "    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+            oprintf(out, "    case %d: /* %s */\n", sp->index, sp->name); lineno++;
             dflt_sp = sp;
         }
         if (dflt_sp != nullptr) {
             emit_destructor_code(out, dflt_sp, lemp, &lineno);
         }
-        fprintf(out, "      break;\n"); lineno++;
+        oputs(out, "      break;\n"); lineno++;
     }
     for (i = 0; i < lemp.nsymbol; i++) {
         const symbol* sp = lemp.symbols[i];
         if (sp == nullptr || sp->type == symbol_type::TERMINAL || sp->destructor == nullptr) continue;
         if (sp->destLineno < 0) continue;  /* Already emitted */
-        fprintf(out, "    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+        oprintf(out, "    case %d: /* %s */\n", sp->index, sp->name); lineno++;
 
         /* Combine duplicate destructors into a single case */
         for (j = i + 1; j < lemp.nsymbol; j++) {
@@ -4795,17 +6154,37 @@ void ReportTable(
             if (sp2 && sp2->type != symbol_type::TERMINAL && sp2->destructor
                 && sp2->dtnum == sp->dtnum
                 && strcmp(sp->destructor, sp2->destructor) == 0) {
-                fprintf(out, "    case %d: /* %s */\n",
+                oprintf(out, "    case %d: /* %s */\n",
                     sp2->index, sp2->name); lineno++;
                 sp2->destLineno = -1;  /* Avoid emitting this destructor again */
             }
         }
 
         emit_destructor_code(out, lemp.symbols[i], lemp, &lineno);
-        fprintf(out, "      break;\n"); lineno++;
+        oputs(out, "      break;\n"); lineno++;
     }
     tplt_xfer(lemp.name, in, out, &lineno);
 
+    /* For C++, generate the cases of yy_release(), which destroys or moves
+    ** the value of every symbol, grouped by the member that holds it */
+    if (cpp) {
+        std::map<int, std::vector<const symbol*>> members;
+        for (i = 1; i < lemp.nsymbol; i++) {
+            const symbol* sp = lemp.symbols[i];
+            if (sp->type == symbol_type::MULTITERMINAL) continue;
+            members[stack_dtnum(lemp, sp)].push_back(sp);
+        }
+        for (const auto& m : members) {
+            for (const symbol* sp : m.second) {
+                oprintf(out, "    case %d: /* %s */\n", sp->index, sp->name); lineno++;
+            }
+            oprintf(out, "      if (yyq) yy_relocate(yyp->yy%d, yyq->yy%d);\n", m.first, m.first); lineno++;
+            oprintf(out, "      else yy_destroy(yyp->yy%d);\n", m.first); lineno++;
+            oputs(out, "      break;\n"); lineno++;
+        }
+        tplt_xfer(lemp.name, in, out, &lineno);
+    }
+
     /* Generate code which executes whenever the parser stack overflows */
     tplt_print(out, lemp, lemp.overflow, &lineno);
     tplt_xfer(lemp.name, in, out, &lineno);
@@ -4817,15 +6196,15 @@ void ReportTable(
     ** sequentially beginning with 0.
     */
     for (i = 0, rp = lemp.rule; rp; rp = rp->next, i++) {
-        fprintf(out, "  %4d,  /* (%d) ", rp->lhs->index, i);
+        oprintf(out, "  %4d,  /* (%d) ", rp->lhs->index, i);
         rule_print(out, rp);
-        fprintf(out, " */\n"); lineno++;
+        oputs(out, " */\n"); lineno++;
     }
     tplt_xfer(lemp.name, in, out, &lineno);
     for (i = 0, rp = lemp.rule; rp; rp = rp->next, i++) {
-        fprintf(out, "  %3d,  /* (%d) ", -rp->nrhs, i);
+        oprintf(out, "  %3d,  /* (%d) ", -rp->nrhs, i);
         rule_print(out, rp);
-        fprintf(out, " */\n"); lineno++;
+        oputs(out, " */\n"); lineno++;
     }
     tplt_xfer(lemp.name, in, out, &lineno);
 
@@ -4834,8 +6213,8 @@ void ReportTable(
     for (rp = lemp.rule; rp; rp = rp->next) {
         i += translate_code(lemp, *rp);
     }
-    if (i) {
-        fprintf(out, "        YYMINORTYPE yylhsminor;\n"); lineno++;
+    if (i && !cpp) {
+        oputs(out, "        YYMINORTYPE yylhsminor;\n"); lineno++;
     }
     /* First output rules other than the default: rule */
     for (rp = lemp.rule; rp; rp = rp->next) {
@@ -4845,43 +6224,43 @@ void ReportTable(
             /* No C code actions, so this will be part of the "default:" rule */
             continue;
         }
-        fprintf(out, "      case %d: /* ", rp->iRule);
+        oprintf(out, "      case %d: /* ", rp->iRule);
         writeRuleText(out, rp);
-        fprintf(out, " */\n"); lineno++;
+        oputs(out, " */\n"); lineno++;
         for (rp2 = rp->next; rp2; rp2 = rp2->next) {
             if (rp2->code == rp->code && rp2->codePrefix == rp->codePrefix
                 && rp2->codeSuffix == rp->codeSuffix) {
-                fprintf(out, "      case %d: /* ", rp2->iRule);
+                oprintf(out, "      case %d: /* ", rp2->iRule);
                 writeRuleText(out, rp2);
-                fprintf(out, " */ yytestcase(yyruleno==%d);\n", rp2->iRule); lineno++;
+                oprintf(out, " */ yytestcase(yyruleno==%d);\n", rp2->iRule); lineno++;
                 rp2->codeEmitted = Boolean::LEMON_TRUE;
             }
         }
         emit_code(out, rp, lemp, &lineno);
-        fprintf(out, "        break;\n"); lineno++;
+        oputs(out, "        break;\n"); lineno++;
         rp->codeEmitted = Boolean::LEMON_TRUE;
     }
     /* Finally, output the default: rule.  We choose as the default: all
     ** empty actions. */
-    fprintf(out, "      default:\n"); lineno++;
+    oputs(out, "      default:\n"); lineno++;
     for (rp = lemp.rule; rp; rp = rp->next) {
         if (rp->codeEmitted == Boolean::LEMON_TRUE) continue;
         assert(rp->noCode == Boolean::LEMON_TRUE);
-        fprintf(out, "      /* (%d) ", rp->iRule);
+        oprintf(out, "      /* (%d) ", rp->iRule);
         writeRuleText(out, rp);
         if (rp->neverReduce == Boolean::LEMON_TRUE) {
-            fprintf(out, " (NEVER REDUCES) */ assert(yyruleno!=%d);\n",
+            oprintf(out, " (NEVER REDUCES) */ assert(yyruleno!=%d);\n",
                 rp->iRule); lineno++;
         }
         else if (rp->doesReduce == Boolean::LEMON_TRUE) {
-            fprintf(out, " */ yytestcase(yyruleno==%d);\n", rp->iRule); lineno++;
+            oprintf(out, " */ yytestcase(yyruleno==%d);\n", rp->iRule); lineno++;
         }
         else {
-            fprintf(out, " (OPTIMIZED OUT) */ assert(yyruleno!=%d);\n",
+            oprintf(out, " (OPTIMIZED OUT) */ assert(yyruleno!=%d);\n",
                 rp->iRule); lineno++;
         }
     }
-    fprintf(out, "        break;\n"); lineno++;
+    oputs(out, "        break;\n"); lineno++;
     tplt_xfer(lemp.name, in, out, &lineno);
 
     /* Generate code which executes if a parse fails */
@@ -4896,48 +6275,36 @@ void ReportTable(
     tplt_print(out, lemp, lemp.accept, &lineno);
     tplt_xfer(lemp.name, in, out, &lineno);
 
+    /* Append the direct-threaded parser, which the template declares */
+    if (threaded) {
+        oputs(out, "\n"); lineno++;
+        ReportThreaded(out, &lineno, lemp, comb);
+    }
+
     /* Append any addition code the user desires */
     tplt_print(out, lemp, lemp.extracode, &lineno);
 
     acttab_free(pActtab);
-    fclose(in);
-    fclose(out);
-    if (sql) fclose(sql);
+    file_close(out);
+    if (sql) file_close(sql);
     return;
 }
 
 /* Generate a header file for the parser */
 void ReportHeader(lemon& lemp)
 {
-    FILE* out, * in;
+    outfile* out;
     const char* prefix;
-    char line[LINESIZE];
-    char pattern[LINESIZE];
     int i;
 
     if (lemp.tokenprefix) prefix = lemp.tokenprefix;
     else                    prefix = "";
-    in = file_open(lemp, ".h", "rb");
-    if (in) {
-        int nextChar;
-        for (i = 1; i < lemp.nterminal && fgets(line, LINESIZE, in); i++) {
-            lemon_sprintf(pattern, "#define %s%-30s %3d\n",
-                prefix, lemp.symbols[i]->name, i);
-            if (strcmp(line, pattern)) break;
-        }
-        nextChar = fgetc(in);
-        fclose(in);
-        if (i == lemp.nterminal && nextChar == EOF) {
-            /* No change in the file.  Don't rewrite it. */
-            return;
-        }
-    }
-    out = file_open(lemp, ".h", "wb");
+    out = file_open(lemp, ".h");
     if (out) {
         for (i = 1; i < lemp.nterminal; i++) {
-            fprintf(out, "#define %s%-30s %3d\n", prefix, lemp.symbols[i]->name, i);
+            oprintf(out, "#define %s%-30s %3d\n", prefix, lemp.symbols[i]->name, i);
         }
-        fclose(out);
+        file_close(out);
     }
     return;
 }
@@ -5129,59 +6496,495 @@ void ResortStates(lemon& lemp)
 }
 
 
+/***************** The automaton cache **************************************/
+/*
+** With -K the automaton of a run that had no errors and no conflicts is
+** saved in the ".lcache" file, under a hash of everything in the grammar
+** that it depends on: the symbols with their precedence, associativity
+** and fallbacks, the rules, which rules have code and which never reduce,
+** the wildcard, the start symbol and the options that change the tables.
+** The code of the actions, the %include and the destructors are not in
+** the hash.  When the hash of a later run agrees, the states, actions,
+** default reduces and packed yy_action[] table are read back instead of
+** being computed, so that an edit to an action only reruns ReportTable()
+** and ReportHeader().
+**
+** After the magic, the hash, the number of integers that follow and a
+** checksum of them, the file holds 32-bit integers in the byte order of
+** the machine:
+**
+**     nstate nxstate nrule nsymbol
+**     for each rule:    precsym lhsStart canReduce
+**     for each symbol:  lambda, the size of the first-set, its members
+**     for each state, in the order of lemp.sorted[]:
+**                       statenum nTknAct nNtAct iTknOfst iNtOfst
+**                       iDfltReduce pDfltReduce autoReduce
+**                       the number of configurations, rule and dot of each
+**                       the number in the basis, the position of each
+**                       the number of actions, sp type x spOpt of each
+**     the number of yy_action[] slots, lookahead and action of each
+**
+** Symbols, rules and states are given by their index, iRule and statenum,
+** or -1 for none.
+*/
+static const char cacheMagic[8] = { 'l', 'e', 'm', 'o', 'n', 'K', 'C', '2' };
+
+/* True if the x of an action of this type is a rule, not a state */
+PRIVATE int action_has_rule(e_action type)
+{
+    switch (type) {
+    case e_action::REDUCE:
+    case e_action::SHIFTREDUCE:
+    case e_action::SRCONFLICT:
+    case e_action::RRCONFLICT:
+    case e_action::RD_RESOLVED:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+/* True if the x of an action of this type is a state */
+PRIVATE int action_has_state(e_action type)
+{
+    return type == e_action::SHIFT || type == e_action::SSCONFLICT
+        || type == e_action::SH_RESOLVED;
+}
+
+/* Hash the parts of the grammar that the automaton depends on.  This
+** must be done before analyse() fills in the precedence of the rules. */
+uint64_t Cache_key(const lemon& lemp)
+{
+    std::string key(cacheMagic, sizeof(cacheMagic));
+    auto put = [&key](int v) { key.append((const char*)&v, sizeof(v)); };
+    auto putstr = [&](const char* z) {
+        put(z ? lemonStrlen(z) : -1);
+        if (z) key.append(z);
+    };
+    const rule* rp;
+    int i;
+
+    put(genp->opt.noCompress);
+    put(genp->opt.noResort);
+    put((int)genp->opt.packing);
+    put(genp->opt.packing == e_packing::SEARCH ? genp->opt.packMoves : 0);
+    put(lemp.nsymbol);
+    put(lemp.nterminal);
+    put(lemp.nrule);
+    put((int)lemp.symbols.size());
+    for (const symbol* sp : lemp.symbols) {
+        putstr(sp->name);
+        put((int)sp->type);
+        put(sp->prec);
+        put((int)sp->assoc);
+        put(sp->fallback ? sp->fallback->index : -1);
+        put(sp->nsubsym);
+        for (i = 0; i < sp->nsubsym; i++) put(sp->subsym[i]->index);
+    }
+    put(lemp.wildcard ? lemp.wildcard->index : -1);
+    putstr(lemp.start);
+    for (rp = lemp.rule; rp; rp = rp->next) {
+        put(rp->index);
+        put(rp->iRule);
+        put(rp->lhs->index);
+        put(rp->nrhs);
+        for (i = 0; i < rp->nrhs; i++) put(rp->rhs[i]->index);
+        put(rp->precsym ? rp->precsym->index : -1);
+        put(rp->noCode == Boolean::LEMON_TRUE);
+        put(rp->neverReduce == Boolean::LEMON_TRUE);
+    }
+    return strhash(key);
+}
+
+/* Write the automaton to the cache.  The cache only saves time, so a
+** failure to write it is not an error. */
+void Cache_save(lemon& lemp)
+{
+    std::vector<int32_t> v;
+    std::vector<config*> cfg;
+    const rule* rp;
+    int i, j;
+
+    v.push_back(lemp.nstate);
+    v.push_back(lemp.nxstate);
+    v.push_back(lemp.nrule);
+    v.push_back((int)lemp.symbols.size());
+    for (rp = lemp.rule; rp; rp = rp->next) {
+        v.push_back(rp->precsym ? rp->precsym->index : -1);
+        v.push_back(rp->lhsStart);
+        v.push_back(rp->canReduce == Boolean::LEMON_TRUE);
+    }
+    for (const symbol* sp : lemp.symbols) {
+        v.push_back(sp->lambda == Boolean::LEMON_TRUE);
+        size_t n = v.size();
+        v.push_back(0);
+        if (sp->type == symbol_type::NONTERMINAL && sp->firstset) {
+            for (j = SetNext(sp->firstset, 0); j >= 0 && j < lemp.nterminal;
+                j = SetNext(sp->firstset, j + 1)) {
+                v.push_back(j);
+            }
+        }
+        v[n] = (int32_t)(v.size() - n - 1);
+    }
+    for (i = 0; i < lemp.nstate; i++) {
+        const state* stp = lemp.sorted[i];
+        v.push_back(stp->statenum);
+        v.push_back(stp->nTknAct);
+        v.push_back(stp->nNtAct);
+        v.push_back(stp->iTknOfst);
+        v.push_back(stp->iNtOfst);
+        v.push_back(stp->iDfltReduce);
+        v.push_back(stp->pDfltReduce ? stp->pDfltReduce->iRule : -1);
+        v.push_back(stp->autoReduce);
+        cfg.clear();
+        for (config* cfp = stp->cfp; cfp; cfp = cfp->next) cfg.push_back(cfp);
+        v.push_back((int)cfg.size());
+        for (const config* cfp : cfg) {
+            v.push_back(cfp->rp->iRule);
+            v.push_back(cfp->dot);
+        }
+        size_t n = v.size();
+        v.push_back(0);
+        for (config* bp = stp->bp; bp; bp = bp->bp) {
+            v.push_back((int)(std::find(cfg.begin(), cfg.end(), bp) - cfg.begin()));
+        }
+        v[n] = (int32_t)(v.size() - n - 1);
+        n = v.size();
+        v.push_back(0);
+        for (const action* ap = stp->ap; ap; ap = ap->next) {
+            v.push_back(ap->sp->index);
+            v.push_back((int)ap->type);
+            if (action_has_rule(ap->type)) v.push_back(ap->x.rp->iRule);
+            else if (action_has_state(ap->type)) v.push_back(ap->x.stp->statenum);
+            else v.push_back(-1);
+            v.push_back(ap->spOpt ? ap->spOpt->index : -1);
+        }
+        v[n] = (int32_t)((v.size() - n - 1) / 4);
+    }
+    v.push_back((int)genp->packed.size() / 2);
+    v.insert(v.end(), genp->packed.begin(), genp->packed.end());
+
+    char* name = file_makename(lemp, ".lcache");
+    std::string tmp = std::string(name) + ".tmp";
+    FILE* fp = fopen(tmp.c_str(), "wb");
+    if (fp) {
+        uint64_t hdr[3];
+        hdr[0] = genp->cacheKey;
+        hdr[1] = v.size();
+        hdr[2] = strhash(std::string_view((const char*)v.data(), v.size() * sizeof(v[0])));
+        int ok = fwrite(cacheMagic, sizeof(cacheMagic), 1, fp) == 1
+            && fwrite(hdr, sizeof(hdr), 1, fp) == 1
+            && fwrite(v.data(), sizeof(v[0]), v.size(), fp) == v.size();
+        ok = fclose(fp) == 0 && ok;
+        remove(name);
+        if (!ok || rename(tmp.c_str(), name) != 0) remove(tmp.c_str());
+    }
+    lemon_free(name);
+}
+
+/* Integers read from the cache.  Any value that is out of range or past
+** the end marks the whole cache as bad. */
+struct cachereader {
+    const char* z;
+    size_t n;
+    size_t i = 0;
+    int bad = 0;
+
+    /* The next integer, which must be at least lo and less than hi */
+    int next(int lo = INT32_MIN, int hi = INT32_MAX) {
+        int32_t v;
+        if (n - i < sizeof(v)) {
+            bad = 1;
+            return lo;
+        }
+        memcpy(&v, z + i, sizeof(v));
+        i += sizeof(v);
+        if (v < lo || v >= hi) {
+            bad = 1;
+            return lo;
+        }
+        return v;
+    }
+
+    /* The size of a list of items of k integers each */
+    int count(int k) {
+        return next(0, (int)((n - i) / (sizeof(int32_t) * k) + 1));
+    }
+};
+
+/* Read the automaton from the cache, if the cache is for a grammar with
+** the same structure.  Return true on success.  Nothing in the state
+** vector changes unless all of the cache is good. */
+int Cache_load(lemon& lemp)
+{
+    srcmap map;
+    char* name = file_makename(lemp, ".lcache");
+    int rc = map.open(name);
+    lemon_free(name);
+    uint64_t hdr[3];
+    const size_t nHdr = sizeof(cacheMagic) + sizeof(hdr);
+    if (rc || map.n < nHdr || memcmp(map.z, cacheMagic, sizeof(cacheMagic)) != 0) {
+        return 0;
+    }
+    memcpy(hdr, map.z + sizeof(cacheMagic), sizeof(hdr));
+    if (hdr[0] != genp->cacheKey || hdr[1] * sizeof(int32_t) != map.n - nHdr
+        || hdr[2] != strhash(std::string_view(map.z + nHdr, map.n - nHdr))) {
+        return 0;
+    }
+
+    cachereader r{ map.z + nHdr, map.n - nHdr };
+    const int nsym = (int)lemp.symbols.size();
+    std::vector<rule*> rules;
+    for (rule* rp = lemp.rule; rp; rp = rp->next) rules.push_back(rp);
+    int nstate = r.next(1, INT32_MAX);
+    int nxstate = r.next(0, nstate + 1);
+    if (r.next() != lemp.nrule || r.next() != nsym || r.bad) return 0;
+    if ((size_t)nstate > (r.n - r.i) / (8 * sizeof(int32_t))) return 0;
+
+    /* The rules and symbols are only changed at the end */
+    std::vector<int> ruleinfo, syminfo;
+    for (int i = 0; i < lemp.nrule; i++) {
+        ruleinfo.push_back(r.next(-1, nsym));
+        ruleinfo.push_back(r.next(0, 2));
+        ruleinfo.push_back(r.next(0, 2));
+    }
+    for (int i = 0; i < nsym; i++) {
+        syminfo.push_back(r.next(0, 2));
+        int n = r.count(1);
+        syminfo.push_back(n);
+        while (n-- > 0) syminfo.push_back(r.next(0, lemp.nterminal));
+    }
+
+    /* The states are new, so they are filled in as they are read.  A
+    ** shift may be to a state that comes later, so those wait until the
+    ** end. */
+    std::vector<state*> sorted(nstate), bynum(nstate, nullptr);
+    std::vector<std::pair<action*, int>> shifts;
+    std::vector<config*> cfg;
+    for (state*& stp : sorted) {
+        stp = State_new();
+        int num = r.next(0, nstate);
+        if (bynum[num]) r.bad = 1;
+        bynum[num] = stp;
+        stp->statenum = num;
+        stp->nTknAct = r.next();
+        stp->nNtAct = r.next();
+        stp->iTknOfst = r.next();
+        stp->iNtOfst = r.next();
+        stp->iDfltReduce = r.next();
+        int iRule = r.next(-1, lemp.nrule);
+        stp->pDfltReduce = iRule >= 0 ? rules[iRule] : nullptr;
+        stp->autoReduce = r.next(0, 2);
+
+        config** cfpp = &stp->cfp;
+        cfg.clear();
+        for (int n = r.count(2); n > 0 && !r.bad; n--) {
+            config* cfp = (config*)pool_alloc(bldp->pools[POOL_CONFIG], sizeof(config));
+            cfp->rp = rules[r.next(0, lemp.nrule)];
+            cfp->dot = r.next(0, cfp->rp->nrhs + 1);
+            cfp->stp = stp;
+            cfp->status = cfgstatus::COMPLETE;
+            *cfpp = cfp;
+            cfpp = &cfp->next;
+            cfg.push_back(cfp);
+        }
+        config** bpp = &stp->bp;
+        for (int n = r.count(1); n > 0 && !r.bad; n--) {
+            config* bp = cfg.empty() ? nullptr : cfg[r.next(0, (int)cfg.size())];
+            if (bp == nullptr || bp->bp || bpp == &bp->bp) {
+                r.bad = 1;
+                break;
+            }
+            *bpp = bp;
+            bpp = &bp->bp;
+        }
+        action** app = &stp->ap;
+        for (int n = r.count(4); n > 0 && !r.bad; n--) {
+            action* ap = Action_new();
+            ap->sp = lemp.symbols[r.next(0, nsym)];
+            ap->type = (e_action)r.next(0, (int)e_action::SHIFTREDUCE + 1);
+            int x = r.next(-1, INT32_MAX);
+            if (action_has_rule(ap->type)) {
+                if (x < 0 || x >= lemp.nrule) r.bad = 1;
+                else ap->x.rp = rules[x];
+            }
+            else if (action_has_state(ap->type)) {
+                shifts.push_back({ ap, x });
+            }
+            int iOpt = r.next(-1, nsym);
+            ap->spOpt = iOpt >= 0 ? lemp.symbols[iOpt] : nullptr;
+            *app = ap;
+            app = &ap->next;
+        }
+        if (r.bad) return 0;
+    }
+    for (auto& [ap, num] : shifts) {
+        if (num < 0 || num >= nstate) return 0;
+        ap->x.stp = bynum[num];
+    }
+    std::vector<int> packed;
+    for (int n = r.count(2) * 2; n > 0; n--) packed.push_back(r.next());
+    if (r.bad || r.i != r.n) return 0;
+
+    /* Everything was read, so the state vector can take it */
+    for (int i = 0; i < lemp.nrule; i++) {
+        rule* rp = rules[i];
+        rp->precsym = ruleinfo[i * 3] >= 0 ? lemp.symbols[ruleinfo[i * 3]] : nullptr;
+        rp->lhsStart = ruleinfo[i * 3 + 1];
+        rp->canReduce = ruleinfo[i * 3 + 2] ? Boolean::LEMON_TRUE : Boolean::LEMON_FALSE;
+    }
+    size_t k = 0;
+    for (symbol* sp : lemp.symbols) {
+        sp->lambda = syminfo[k++] ? Boolean::LEMON_TRUE : Boolean::LEMON_FALSE;
+        int n = syminfo[k++];
+        if (sp->type == symbol_type::NONTERMINAL) {
+            sp->firstset = SetNew();
+            for (int i = 0; i < n; i++) SetAdd(sp->firstset, syminfo[k + i]);
+        }
+        k += n;
+    }
+    lemp.nstate = nstate;
+    lemp.nxstate = nxstate;
+    lemp.sorted = (state**)lemon_calloc(nstate, sizeof(state*));
+    MemoryCheck(lemp.sorted);
+    std::copy(sorted.begin(), sorted.end(), lemp.sorted);
+    genp->packed = std::move(packed);
+    return 1;
+}
+
 /***************** From the file "set.c" ************************************/
 /*
 ** Set manipulation routines for the LEMON parser generator.
 */
 
-static int size = 0;
-
+/*
+** A set holds one bit per element, packed into 64-bit words.  The
+** number of words is rounded up to a multiple of four so that the
+** vector kernels below never need a scalar tail.
+*/
 /* Set the set size */
 void SetSize(int n)
 {
-    size = n + 1;
+    genp->setsize = n + 1;
+    genp->setwords = ((genp->setsize + 63) / 64 + 3) & ~3;
 }
 
-/* Allocate a new set */
-char* SetNew(void) {
-    char* s;
-    s = (char*)calloc(size, 1);
+/* Allocate a new set.  Every set of a generator has the same size, so
+** a single free list serves as the size class for recycled sets.  The
+** follow sets of configurations do not come from here; see newconfig(). */
+setword* SetNew(void) {
+    setword* s = bldp->setfreelist;
     if (s == nullptr) {
-        memory_error();
+        return (setword*)pool_alloc(bldp->pools[POOL_SET],
+            genp->setwords * sizeof(setword));
     }
+    bldp->setfreelist = (setword*)(uintptr_t)s[0];
+    memset(s, 0, genp->setwords * sizeof(setword));
     return s;
 }
 
 /* Deallocate a set */
-void SetFree(char* s)
+void SetFree(setword* s)
 {
-    delete[] s;
+    s[0] = (setword)(uintptr_t)bldp->setfreelist;
+    bldp->setfreelist = s;
 }
 
 /* Add a new element to the set.  Return TRUE if the element was added
 ** and FALSE if it was already there. */
-int SetAdd(char* s, int e)
+int SetAdd(setword* s, int e)
 {
+    setword bit;
     int rv;
-    assert(e >= 0 && e < size);
-    rv = s[e];
-    s[e] = 1;
+    assert(e >= 0 && e < genp->setsize);
+    bit = setword{ 1 } << (e & 63);
+    rv = (s[e >> 6] & bit) != 0;
+    s[e >> 6] |= bit;
     return !rv;
 }
 
 /* Add every element of s2 to s1.  Return TRUE if s1 changes. */
-int SetUnion(char* s1, const char* s2)
+int SetUnion(setword* s1, const setword* s2)
 {
-    int i, progress;
-    progress = 0;
-    for (i = 0; i < size; i++) {
-        if (s2[i] == 0) continue;
-        if (s1[i] == 0) {
-            progress = 1;
-            s1[i] = 1;
-        }
+    const int setwords = genp->setwords;
+    int i, rc;
+#if defined(SET_AVX2)
+    __m256i fresh = _mm256_setzero_si256();
+    for (i = 0; i < setwords; i += 4) {
+        __m256i a = _mm256_loadu_si256((const __m256i*)(s1 + i));
+        __m256i b = _mm256_loadu_si256((const __m256i*)(s2 + i));
+        fresh = _mm256_or_si256(fresh, _mm256_andnot_si256(a, b));
+        _mm256_storeu_si256((__m256i*)(s1 + i), _mm256_or_si256(a, b));
+    }
+    rc = !_mm256_testz_si256(fresh, fresh);
+#elif defined(SET_SSE2)
+    __m128i fresh = _mm_setzero_si128();
+    for (i = 0; i < setwords; i += 2) {
+        __m128i a = _mm_loadu_si128((const __m128i*)(s1 + i));
+        __m128i b = _mm_loadu_si128((const __m128i*)(s2 + i));
+        fresh = _mm_or_si128(fresh, _mm_andnot_si128(a, b));
+        _mm_storeu_si128((__m128i*)(s1 + i), _mm_or_si128(a, b));
+    }
+    rc = _mm_movemask_epi8(_mm_cmpeq_epi8(fresh, _mm_setzero_si128())) != 0xffff;
+#else
+    setword fresh = 0;
+    for (i = 0; i < setwords; i++) {
+        fresh |= s2[i] & ~s1[i];
+        s1[i] |= s2[i];
+    }
+    rc = fresh != 0;
+#endif
+    bldp->work.nunion++;
+    bldp->work.nunionChanged += rc;
+    return rc;
+}
+
+/* Return the index of the lowest set bit of a non-zero word */
+static int SetCtz(setword w)
+{
+#if defined(_MSC_VER)
+    unsigned long i;
+#if defined(_M_X64) || defined(_M_ARM64)
+    _BitScanForward64(&i, w);
+#else
+    if (!_BitScanForward(&i, (unsigned long)w)) {
+        _BitScanForward(&i, (unsigned long)(w >> 32));
+        i += 32;
+    }
+#endif
+    return (int)i;
+#else
+    return __builtin_ctzll(w);
+#endif
+}
+
+/* Return the number of set bits in a word */
+static int SetPopcount(setword w)
+{
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_ARM64))
+    return (int)__popcnt64(w);
+#elif defined(_MSC_VER)
+    return (int)(__popcnt((unsigned)w) + __popcnt((unsigned)(w >> 32)));
+#else
+    return __builtin_popcountll(w);
+#endif
+}
+
+/* Return the smallest element of the set that is not less than e,
+** or -1 if there is none.  Use this to walk the members of a set
+** in increasing order. */
+int SetNext(const setword* s, int e)
+{
+    int i;
+    setword w;
+    if (e >= genp->setsize) return -1;
+    i = e >> 6;
+    w = s[i] & (~setword{ 0 } << (e & 63));
+    while (w == 0) {
+        if (++i >= genp->setwords) return -1;
+        w = s[i];
     }
-    return progress;
+    return (i << 6) + SetCtz(w);
 }
 /********************** From the file "table.c" ****************************/
 /*
@@ -5196,47 +6999,136 @@ int SetUnion(char* s1, const char* s2)
 ** Code for processing tables in the LEMON parser generator.
 */
 
-static std::unordered_set<std::string> x1a_set;
+/* Strings are interned in an open addressing hash table with linear
+** probing.  Each distinct string gets a dense id, in the order first
+** seen, and its bytes are copied once into a pool that lives as long
+** as the generator.  The scanner interns every token it reads, so that
+** afterwards a symbol can be found from the id of its name without
+** hashing the name again.
+*/
+
+/* Hash the bytes of a string, eight at a time */
+PRIVATE uint64_t strhash(std::string_view y)
+{
+    uint64_t h = 0x9e3779b97f4a7c15ull ^ y.size();
+    uint64_t w;
+    size_t i, n = y.size();
+    for (i = 0; i + 8 <= n; i += 8) {
+        memcpy(&w, y.data() + i, 8);
+        h = (h ^ w) * 0xff51afd7ed558ccdull;
+        h ^= h >> 32;
+    }
+    w = 0;
+    memcpy(&w, y.data() + i, n - i);
+    h = (h ^ w) * 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 29;
+    return h;
+}
+
+/* Return the slot of the string table which holds y, whose hash is h,
+** or the empty slot where y would go */
+PRIVATE x1node* Strsafe_slot(std::string_view y, uint64_t h)
+{
+    unsigned mask = genp->x1size - 1;
+    unsigned i = (unsigned)h & mask;
+    x1node* np;
+    for (np = &genp->x1a[i]; np->id >= 0; np = &genp->x1a[i]) {
+        if (np->hash == h && np->len == (int)y.size()
+            && memcmp(genp->x1str[np->id], y.data(), y.size()) == 0) break;
+        i = (i + 1) & mask;
+    }
+    return np;
+}
+
+/* Return the id of the string y, interning it if this is the first
+** time it has been seen */
+int Strsafe_id(std::string_view y)
+{
+    uint64_t h = strhash(y);
+    x1node* np = Strsafe_slot(y, h);
+    char* z;
+    if (np->id >= 0) return np->id;
+    if (2 * (genp->x1str.size() + 1) > (size_t)genp->x1size) {
+        /* Need to make the hash table bigger */
+        int i, arrSize = genp->x1size * 2;
+        x1node* ht = (x1node*)lemon_calloc(arrSize, sizeof(x1node));
+        if (ht == nullptr) memory_error();
+        for (i = 0; i < arrSize; i++) ht[i].id = -1;
+        for (i = 0; i < genp->x1size; i++) {
+            unsigned j;
+            if (genp->x1a[i].id < 0) continue;
+            j = (unsigned)genp->x1a[i].hash & (arrSize - 1);
+            while (ht[j].id >= 0) j = (j + 1) & (arrSize - 1);
+            ht[j] = genp->x1a[i];
+        }
+        lemon_free(genp->x1a);
+        genp->x1a = ht;
+        genp->x1size = arrSize;
+        np = Strsafe_slot(y, h);
+    }
+    z = (char*)pool_alloc(genp->x1pool, y.size() + 1);
+    memcpy(z, y.data(), y.size());
+    z[y.size()] = 0;
+    np->hash = h;
+    np->len = (int)y.size();
+    np->id = (int)genp->x1str.size();
+    genp->x1str.push_back(z);
+    genp->x1sym.push_back(-1);
+    return np->id;
+}
+
+/* Return the id of the string y, or -1 if it has never been interned */
+int Strsafe_lookup(std::string_view y)
+{
+    return Strsafe_slot(y, strhash(y))->id;
+}
+
+/* Return the interned string with the given id */
+const char* Strsafe_str(int id)
+{
+    return genp->x1str[id];
+}
 
-/* Works like strdup, sort of.  Save a string in malloced memory, but
-** keep strings in a table so that the same string is not in more
-** than one place.
+/* Works like strdup, sort of.  Save a string in memory that lasts as
+** long as the generator, but keep strings in a table so that the same
+** string is not in more than one place.
 */
 const char* Strsafe(std::string_view y)
 {
     if (y.empty()) return nullptr;
-    auto [z, inserted] = x1a_set.emplace(y);
-    if (z == x1a_set.end())
-    {
-        memory_error();
-    }
-
-    return z->data();
+    return Strsafe_str(Strsafe_id(y));
 }
 
 /* Allocate a new associative array */
 void Strsafe_init(void) {
-    x1a_set.clear();
-    x1a_set.reserve(1024);
+    int i;
+    genp->x1str.clear();
+    genp->x1sym.clear();
+    genp->x1size = 1024;
+    genp->x1a = (x1node*)lemon_calloc(genp->x1size, sizeof(x1node));
+    if (genp->x1a == nullptr) memory_error();
+    for (i = 0; i < genp->x1size; i++) genp->x1a[i].id = -1;
 }
 
 namespace Symbol
 {
-static std::map<std::string_view, Symbol::symbol> x2a_map;
-
-/* Return a pointer to the (terminal or nonterminal) symbol "x".
-** Create a new symbol if this is the first time "x" has been seen.
+/* Return a pointer to the (terminal or nonterminal) symbol whose name
+** is the interned string with the given id.  Create a new symbol if
+** this is the first time the name has been seen.
 */
-symbol* Symbol_new(const char* x)
+symbol* Symbol_fromid(int id)
 {
     symbol* sp;
 
-    sp = Symbol_find(x);
-    if (sp == nullptr) {
+    if (genp->x1sym[id] >= 0) {
+        sp = &genp->x2a[genp->x1sym[id]];
+    }
+    else {
         symbol s;
+        const char* x = Strsafe_str(id);
 
-        s.name = Strsafe(x);
-        s.index = x2a_map.size()+1; //index in the order as found
+        s.name = x;
+        s.index = genp->x2a.size()+1; //index in the order as found
         s.type = ISUPPER(*x) ? symbol_type::TERMINAL : symbol_type::NONTERMINAL;
         s.rule = nullptr;
         s.fallback = nullptr;
@@ -5253,13 +7145,22 @@ symbol* Symbol_new(const char* x)
         s.nsubsym = 0;
         s.subsym = nullptr;
 
-        auto [inserted_s, e] = x2a_map.emplace(s.name, s);
-        sp = &inserted_s->second;
+        genp->x1sym[id] = (int)genp->x2a.size();
+        genp->x2a.push_back(s);
+        sp = &genp->x2a.back();
     }
     ++sp->useCnt;
     return sp;
 }
 
+/* Return a pointer to the (terminal or nonterminal) symbol "x".
+** Create a new symbol if this is the first time "x" has been seen.
+*/
+symbol* Symbol_new(const char* x)
+{
+    return Symbol_fromid(Strsafe_id(x));
+}
+
 /* Compare two symbols for sorting purposes.  Return negative,
 ** zero, or positive if a is less then, equal to, or greater
 ** than b.
@@ -5284,34 +7185,34 @@ bool Symbolcmpp(const symbol* a, const symbol* b)
 
 /* Allocate a new associative array */
 void Symbol_init(void) {
-    x2a_map.clear();
+    genp->x2a.clear();
 }
 
 /* Return a pointer to data assigned to the given key.  Return NULL
 ** if no such key. */
 symbol* Symbol_find(std::string_view key)
 {
-    auto res = x2a_map.find(key);
-    return (res != x2a_map.end()) ? &res->second : nullptr;
+    int id = Strsafe_lookup(key);
+    if (id < 0 || genp->x1sym[id] < 0) return nullptr;
+    return &genp->x2a[genp->x1sym[id]];
 }
 
 /* Return the size of the array */
 int Symbol_count()
 {
-    return x2a_map.size();
+    return genp->x2a.size();
 }
 
-/* Return an array of pointers to all data in the table.
-** The array is obtained from malloc.  Return NULL if memory allocation
-** problems, or if the array is empty. */
+/* Return an array of pointers to all data in the table, in the
+** order the symbols were first seen. */
 std::vector<symbol*> Symbol_arrayof()
 {
     std::vector<symbol*> vs;
-    vs.reserve(x2a_map.size());
+    vs.reserve(genp->x2a.size());
 
-    std::transform(x2a_map.begin(), x2a_map.end(), std::back_inserter(vs), [](auto& e)
+    std::transform(genp->x2a.begin(), genp->x2a.end(), std::back_inserter(vs), [](auto& e)
         {
-            return &e.second;
+            return &e;
         });
 
     return vs;
@@ -5332,12 +7233,11 @@ int Configcmp(const char* _a, const char* _b)
     return x;
 }
 
-/* Hash a configuration */
-PRIVATE unsigned confighash(const config* a)
+/* Hash the key of a configuration, its rule number and dot */
+PRIVATE unsigned confighash(int index, int dot)
 {
-    unsigned h = 0;
-    h = h * 571 + a->rp->index * 37 + a->dot;
-    return h;
+    uint64_t k = ((uint64_t)(unsigned)index << 32) | (unsigned)dot;
+    return (unsigned)((k * 0x9e3779b97f4a7c15ull) >> 32);
 }
 }
 
@@ -5358,187 +7258,212 @@ PRIVATE int statecmp(config* a, config* b)
     return rc;
 }
 
-/* Hash a state */
-PRIVATE unsigned statehash(config* a)
+/* Return the fingerprint of the basis a.  This is a 64-bit hash of the
+** rule and dot of every configuration.  It is worked out once for each
+** basis, stored on the state, and compared before any call to statecmp(),
+** so the lists of two bases are only walked when they almost surely
+** match. */
+uint64_t State_fingerprint(config* a)
 {
-    unsigned h = 0;
+    uint64_t h = 0xcbf29ce484222325ull;
     while (a) {
-        h = h * 571 + a->rp->index * 37 + a->dot;
+        h ^= ((uint64_t)a->rp->index << 16) | (uint64_t)a->dot;
+        h *= 0x100000001b3ull;
         a = a->bp;
     }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccdull;
+    h ^= h >> 33;
+    h *= 0xc4ceb9fe1a85ec53ull;
+    h ^= h >> 33;
     return h;
 }
 
 /* Allocate a new state structure */
 state* State_new()
 {
-    state* newstate;
-    newstate = (state*)calloc(1, sizeof(state));
-    MemoryCheck(newstate);
-    return newstate;
+    return (state*)pool_alloc(bldp->pools[POOL_STATE], sizeof(state));
 }
 
-/* There is one instance of this structure for every data element
-** in an associative array of type "x3".
-*/
+/* One slot of the state table.  A slot is empty if data is NULL.  The
+** fingerprint is copied into the slot so that a probe does not have to
+** touch the state itself until the fingerprints agree. */
 struct s_x3node {
-    state* data;                  /* The data */
-    config* key;                   /* The key */
-    s_x3node* next;   /* Next entry with the same hash */
-    s_x3node** from;  /* Previous link */
+    uint64_t fp;   /* Fingerprint of the basis of data */
+    state* data;   /* The data */
 };
 
 using x3node = s_x3node;
 
-/* There is one instance of the following structure for each
-** associative array of type "x3".
+/* There is one instance of the following structure for each shard of
+** the state table.  The slots are an open addressing hash table with
+** linear probing, kept no more than half full.
 */
 struct s_x3 {
     int size;               /* The number of available slots. */
                             /*   Must be a power of 2 greater than or */
                             /*   equal to 1 */
     int count;              /* Number of currently slots filled */
-    s_x3node* tbl;  /* The data stored here */
-    s_x3node** ht;  /* Hash table for lookups */
+    s_x3node* ht;   /* Hash table for lookups */
 };
 
-/* There is only one instance of the array, which is the following */
-static s_x3* x3a;
+/* The state table is split into X3SHARDS independent arrays, each guarded
+** by its own lock, so that several threads can build states at once.
+** The shard of a key is taken from the high bits of its fingerprint,
+** leaving the low bits to pick a slot within the shard. */
+
+/* Return the shard which holds keys with the fingerprint fp */
+PRIVATE unsigned x3shard(uint64_t fp)
+{
+    return (unsigned)(fp >> 58);
+}
 
 /* Allocate a new associative array */
 void State_init(void) {
-    if (x3a) return;
-    x3a = new s_x3;
-    if (x3a) {
-        x3a->size = 128;
-        x3a->count = 0;
-        x3a->tbl = (x3node*)calloc(128, sizeof(x3node) + sizeof(x3node*));
-        if (x3a->tbl == nullptr) {
-            delete x3a;
-            x3a = nullptr;
-        }
-        else {
-            int i;
-            x3a->ht = (x3node**)&(x3a->tbl[128]);
-            for (i = 0; i < 128; i++) x3a->ht[i] = nullptr;
+    int i;
+    if (genp->x3a) return;
+    genp->x3a = (s_x3*)lemon_calloc(X3SHARDS, sizeof(s_x3));
+    if (genp->x3a == nullptr) {
+        memory_error();
+    }
+    for (i = 0; i < X3SHARDS; i++) {
+        genp->x3a[i].size = 32;
+        genp->x3a[i].count = 0;
+        genp->x3a[i].ht = (x3node*)lemon_calloc(32, sizeof(x3node));
+        if (genp->x3a[i].ht == nullptr) {
+            memory_error();
         }
     }
 }
-/* Insert a new record into the array.  Return TRUE if successful.
-** Prior data with the same key is NOT overwritten */
-int State_insert(state* data, config* key)
+
+/* Return the lock that must be held while looking up or inserting
+** a key with the fingerprint fp in the table from more than one thread */
+std::mutex& State_lock(uint64_t fp)
+{
+    return genp->x3lock[x3shard(fp)];
+}
+
+/* Insert a new state into the array, keyed by its basis and fingerprint.
+** Return TRUE if successful.  Prior data with the same key is NOT
+** overwritten */
+int State_insert(state* data)
 {
     x3node* np;
+    s_x3* x3;
     unsigned h;
-    unsigned ph;
 
-    if (x3a == nullptr) return 0;
-    ph = statehash(key);
-    h = ph & (x3a->size - 1);
-    np = x3a->ht[h];
-    while (np) {
-        if (statecmp(np->key, key) == 0) {
-            /* An existing entry with the same key is found. */
-            /* Fail because overwrite is not allows. */
-            return 0;
-        }
-        np = np->next;
+    if (genp->x3a == nullptr) return 0;
+    x3 = &genp->x3a[x3shard(data->fingerprint)];
+    if (State_find(data->bp, data->fingerprint)) {
+        /* An existing entry with the same key is found. */
+        /* Fail because overwrite is not allows. */
+        return 0;
     }
-    if (x3a->count >= x3a->size) {
+    if (2 * (x3->count + 1) > x3->size) {
         /* Need to make the hash table bigger */
         int i, arrSize;
-        s_x3 array;
-        array.size = arrSize = x3a->size * 2;
-        array.count = x3a->count;
-        array.tbl = (x3node*)calloc(arrSize, sizeof(x3node) + sizeof(x3node*));
-        if (array.tbl == 0) return 0;  /* Fail due to malloc failure */
-        array.ht = (x3node**)&(array.tbl[arrSize]);
-        for (i = 0; i < arrSize; i++) array.ht[i] = nullptr;
-        for (i = 0; i < x3a->count; i++) {
-            x3node* oldnp, * newnp;
-            oldnp = &(x3a->tbl[i]);
-            h = statehash(oldnp->key) & (arrSize - 1);
-            newnp = &(array.tbl[i]);
-            if (array.ht[h]) array.ht[h]->from = &(newnp->next);
-            newnp->next = array.ht[h];
-            newnp->key = oldnp->key;
-            newnp->data = oldnp->data;
-            newnp->from = &(array.ht[h]);
-            array.ht[h] = newnp;
-        }
-        free(x3a->tbl);
-        *x3a = array;
+        x3node* ht;
+        arrSize = x3->size * 2;
+        ht = (x3node*)lemon_calloc(arrSize, sizeof(x3node));
+        if (ht == nullptr) return 0;  /* Fail due to malloc failure */
+        for (i = 0; i < x3->size; i++) {
+            if (x3->ht[i].data == nullptr) continue;
+            h = (unsigned)x3->ht[i].fp & (arrSize - 1);
+            while (ht[h].data) h = (h + 1) & (arrSize - 1);
+            ht[h] = x3->ht[i];
+        }
+        lemon_free(x3->ht);
+        x3->ht = ht;
+        x3->size = arrSize;
     }
     /* Insert the new data */
-    h = ph & (x3a->size - 1);
-    np = &(x3a->tbl[x3a->count++]);
-    np->key = key;
+    h = (unsigned)data->fingerprint & (x3->size - 1);
+    while (x3->ht[h].data) h = (h + 1) & (x3->size - 1);
+    np = &x3->ht[h];
+    np->fp = data->fingerprint;
     np->data = data;
-    if (x3a->ht[h]) x3a->ht[h]->from = &(np->next);
-    np->next = x3a->ht[h];
-    x3a->ht[h] = np;
-    np->from = &(x3a->ht[h]);
+    x3->count++;
     return 1;
 }
 
-/* Return a pointer to data assigned to the given key.  Return NULL
-** if no such key. */
-state* State_find(config* key)
+/* Return a pointer to the state whose basis is key, where fp is the
+** fingerprint of key.  Return NULL if no such key. */
+state* State_find(config* key, uint64_t fp)
 {
     unsigned h;
-    x3node* np;
+    s_x3* x3;
 
-    if (x3a == nullptr) return nullptr;
-    h = statehash(key) & (x3a->size - 1);
-    np = x3a->ht[h];
-    while (np) {
-        if (statecmp(np->key, key) == 0) break;
-        np = np->next;
+    if (genp->x3a == nullptr) return nullptr;
+    x3 = &genp->x3a[x3shard(fp)];
+    h = (unsigned)fp & (x3->size - 1);
+    for (; x3->ht[h].data; h = (h + 1) & (x3->size - 1)) {
+        bldp->work.nstateProbe++;
+        if (x3->ht[h].fp == fp && statecmp(x3->ht[h].data->bp, key) == 0) {
+            return x3->ht[h].data;
+        }
     }
-    return np ? np->data : nullptr;
+    return nullptr;
 }
 
-/* Return an array of pointers to all data in the table.
-** The array is obtained from malloc.  Return NULL if memory allocation
-** problems, or if the array is empty. */
+/* Return an array of pointers to all data in the table, indexed by
+** state number.  The array is obtained from malloc.  Return NULL if
+** memory allocation problems, or if the array is empty. */
 state** State_arrayof(void)
 {
     state** array;
-    int i, arrSize;
-    if (x3a == nullptr) return nullptr;
-    arrSize = x3a->count;
-    array = (state**)calloc(arrSize, sizeof(state*));
+    int i, j, arrSize;
+    if (genp->x3a == nullptr) return nullptr;
+    arrSize = 0;
+    for (i = 0; i < X3SHARDS; i++) arrSize += genp->x3a[i].count;
+    array = (state**)lemon_calloc(arrSize, sizeof(state*));
     if (array) {
-        for (i = 0; i < arrSize; i++) array[i] = x3a->tbl[i].data;
+        for (i = 0; i < X3SHARDS; i++) {
+            for (j = 0; j < genp->x3a[i].size; j++) {
+                state* stp = genp->x3a[i].ht[j].data;
+                if (stp == nullptr) continue;
+                assert(stp->statenum >= 0 && stp->statenum < arrSize);
+                array[stp->statenum] = stp;
+            }
+        }
     }
     return array;
 }
 
-/* There is one instance of this structure for every data element
-** in an associative array of type "x4".
+/* One slot of the configuration table.  The key, a rule number and a
+** dot, is copied into the slot so that probes never touch the config.
+** A slot only holds data if its epoch is the epoch of the table; any
+** other slot is empty.
 */
 struct s_x4node {
-    config* data;                  /* The data */
-    s_x4node* next;   /* Next entry with the same hash */
-    s_x4node** from;  /* Previous link */
+    unsigned epoch;    /* Epoch in which this slot was filled */
+    int index;         /* Rule number of data */
+    int dot;           /* Dot of data */
+    config* data;      /* The data */
 };
 
 using x4node = s_x4node;
 
 /* There is one instance of the following structure for each
-** associative array of type "x4".
+** associative array of type "x4".  The slots are an open addressing
+** hash table with linear probing, kept no more than half full.
+**
+** The table is cleared once for every successor of every state, but
+** it only grows to fit the largest state.  Rather than zero all of the
+** slots each time, Configtable_clear() starts a new epoch, which makes
+** every slot filled before it empty at once.
 */
 struct s_x4 {
     int size;               /* The number of available slots. */
                             /*   Must be a power of 2 greater than or */
                             /*   equal to 1 */
     int count;              /* Number of currently slots filled */
-    s_x4node* tbl;  /* The data stored here */
-    s_x4node** ht;  /* Hash table for lookups */
+    unsigned epoch;         /* Slots filled in other epochs are empty */
+    s_x4node* ht;   /* Hash table for lookups */
 };
 
-/* There is only one instance of the array, which is the following */
-static s_x4* x4a;
+/* Each thread that builds states has its own instance of the array,
+** kept in its cfgbuilder */
+#define x4a (bldp->x4a)
 
 }
 
@@ -5547,20 +7472,16 @@ namespace Configtable
 /* Allocate a new associative array */
 void Configtable_init(void) {
     if (x4a) return;
-    x4a = new s_x4;
+    x4a = (s_x4*)lemon_calloc(1, sizeof(s_x4));
     if (x4a) {
         x4a->size = 64;
         x4a->count = 0;
-        x4a->tbl = (x4node*)calloc(64, sizeof(x4node) + sizeof(x4node*));
-        if (x4a->tbl == 0) {
-            delete x4a;
+        x4a->epoch = 1;
+        x4a->ht = (x4node*)lemon_calloc(64, sizeof(x4node));
+        if (x4a->ht == nullptr) {
+            lemon_free(x4a);
             x4a = 0;
         }
-        else {
-            int i;
-            x4a->ht = (x4node**)&(x4a->tbl[64]);
-            for (i = 0; i < 64; i++) x4a->ht[i] = nullptr;
-        }
     }
 }
 
@@ -5570,52 +7491,40 @@ int Configtable_insert(config* data)
 {
     x4node* np;
     unsigned h;
-    unsigned ph;
 
     if (x4a == nullptr) return 0;
-    ph = confighash(data);
-    h = ph & (x4a->size - 1);
-    np = x4a->ht[h];
-    while (np) {
-        if (Config::Configcmp((const char*)np->data, (const char*)data) == 0) {
-            /* An existing entry with the same key is found. */
-            /* Fail because overwrite is not allows. */
-            return 0;
-        }
-        np = np->next;
-    }
-    if (x4a->count >= x4a->size) {
+    if (Configtable_find(data)) {
+        /* An existing entry with the same key is found. */
+        /* Fail because overwrite is not allows. */
+        return 0;
+    }
+    if (2 * (x4a->count + 1) > x4a->size) {
         /* Need to make the hash table bigger */
         int i, arrSize;
-        s_x4 array;
-        array.size = arrSize = x4a->size * 2;
-        array.count = x4a->count;
-        array.tbl = (x4node*)calloc(arrSize, sizeof(x4node) + sizeof(x4node*));
-        if (array.tbl == nullptr) return 0;  /* Fail due to malloc failure */
-        array.ht = (x4node**)&(array.tbl[arrSize]);
-        for (i = 0; i < arrSize; i++) array.ht[i] = nullptr;
-        for (i = 0; i < x4a->count; i++) {
-            x4node* oldnp, * newnp;
-            oldnp = &(x4a->tbl[i]);
-            h = confighash(oldnp->data) & (arrSize - 1);
-            newnp = &(array.tbl[i]);
-            if (array.ht[h]) array.ht[h]->from = &(newnp->next);
-            newnp->next = array.ht[h];
-            newnp->data = oldnp->data;
-            newnp->from = &(array.ht[h]);
-            array.ht[h] = newnp;
-        }
-        free(x4a->tbl);
-        *x4a = array;
+        x4node* ht;
+        arrSize = x4a->size * 2;
+        ht = (x4node*)lemon_calloc(arrSize, sizeof(x4node));
+        if (ht == nullptr) return 0;  /* Fail due to malloc failure */
+        for (i = 0; i < x4a->size; i++) {
+            np = &x4a->ht[i];
+            if (np->epoch != x4a->epoch) continue;
+            h = confighash(np->index, np->dot) & (arrSize - 1);
+            while (ht[h].epoch == x4a->epoch) h = (h + 1) & (arrSize - 1);
+            ht[h] = *np;
+        }
+        lemon_free(x4a->ht);
+        x4a->ht = ht;
+        x4a->size = arrSize;
     }
     /* Insert the new data */
-    h = ph & (x4a->size - 1);
-    np = &(x4a->tbl[x4a->count++]);
+    h = confighash(data->rp->index, data->dot) & (x4a->size - 1);
+    while (x4a->ht[h].epoch == x4a->epoch) h = (h + 1) & (x4a->size - 1);
+    np = &x4a->ht[h];
+    np->epoch = x4a->epoch;
+    np->index = data->rp->index;
+    np->dot = data->dot;
     np->data = data;
-    if (x4a->ht[h]) x4a->ht[h]->from = &(np->next);
-    np->next = x4a->ht[h];
-    x4a->ht[h] = np;
-    np->from = &(x4a->ht[h]);
+    x4a->count++;
     return 1;
 }
 
@@ -5623,28 +7532,39 @@ int Configtable_insert(config* data)
 ** if no such key. */
 config* Configtable_find(const config* key)
 {
-    int h;
+    unsigned h;
     x4node* np;
+    int index = key->rp->index;
 
     if (x4a == nullptr) return nullptr;
-    h = confighash(key) & (x4a->size - 1);
-    np = x4a->ht[h];
-    while (np) {
-        if (Config::Configcmp((const char*)np->data, (const char*)key) == 0) break;
-        np = np->next;
+    h = confighash(index, key->dot) & (x4a->size - 1);
+    for (np = &x4a->ht[h]; np->epoch == x4a->epoch; np = &x4a->ht[h]) {
+        bldp->work.nconfigProbe++;
+        if (np->index == index && np->dot == key->dot) return np->data;
+        h = (h + 1) & (x4a->size - 1);
     }
-    return np ? np->data : nullptr;
+    return nullptr;
 }
 
 /* Remove all data from the table.  Pass each data to the function "f"
-** as it is removed.  ("f" may be null to avoid this step.) */
+** as it is removed.  ("f" may be null to avoid this step.)  Without "f"
+** this takes constant time. */
 void Configtable_clear(int(*f)(config*))
 {
     int i;
     if (x4a == nullptr || x4a->count == 0) return;
-    if (f) for (i = 0; i < x4a->count; i++) (*f)(x4a->tbl[i].data);
-    for (i = 0; i < x4a->size; i++) x4a->ht[i] = nullptr;
+    if (f) {
+        for (i = 0; i < x4a->size; i++) {
+            if (x4a->ht[i].epoch == x4a->epoch) (*f)(x4a->ht[i].data);
+        }
+    }
     x4a->count = 0;
+    if (++x4a->epoch == 0) {
+        /* The epoch has wrapped, so old stamps could come back to life */
+        for (i = 0; i < x4a->size; i++) x4a->ht[i].epoch = 0;
+        x4a->epoch = 1;
+    }
     return;
 }
-}
\ No newline at end of file
+}
+#undef x4a
@@ -2,12 +2,20 @@
 
 #define _CRT_SECURE_NO_DEPRECATE
 
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+
 enum class Boolean
 {
     LEMON_FALSE = 0,
     LEMON_TRUE = 1
 };
 
+/* Sets of terminals are bitsets packed into 64-bit words */
+using setword = std::uint64_t;
+
 namespace Rule
 {
 struct rule;
@@ -15,6 +23,7 @@ struct rule;
 using namespace Rule;
 
 struct lemon;
+struct genctx;
 
 namespace Action
 {
@@ -76,11 +85,11 @@ struct symbol {
     const char* name;        /* Name of the symbol */
     int index;               /* Index number for this symbol */
     symbol_type type;        /* Symbols are all either TERMINALS or NTs */
-    rule* rule;              /* Linked list of rules of this (if an NT) */
+    Rule::rule* rule;        /* Linked list of rules of this (if an NT) */
     symbol* fallback;        /* fallback token in case this token doesn't parse */
     int prec;                /* Precedence if defined (-1 otherwise) */
     e_assoc assoc;           /* Associativity if precedence is defined */
-    char* firstset;          /* First-set for all rules of this symbol */
+    setword* firstset;       /* First-set for all rules of this symbol */
     Boolean lambda;          /* True if NT and can generate an empty string */
     int useCnt;              /* Number of times used */
     char* destructor;        /* Code which executes whenever this symbol is
@@ -152,13 +161,14 @@ enum class cfgstatus {
 struct config {
     rule* rp;         /* The rule upon which the configuration is based */
     int dot;                 /* The parse point */
-    char* fws;               /* Follow-set for this configuration only */
+    setword* fws;            /* Follow-set for this configuration only */
     plink* fplp;      /* Follow-set forward propagation links */
     plink* bplp;      /* Follow-set backwards propagation links */
     state* stp;       /* Pointer to state which contains this */
     cfgstatus status;   /* used during followset and shift computations */
     config* next;     /* Next configuration in the state */
     config* bp;       /* The next basis configuration */
+    int index;        /* Vertex number in the follow-set propagation graph */
 };
 
 }
@@ -210,12 +220,15 @@ struct state {
     int iDfltReduce;         /* Default action is to REDUCE by this rule */
     rule* pDfltReduce;/* The default REDUCE rule. */
     int autoReduce;          /* True if this is an auto-reduce state */
+    uint64_t fingerprint;    /* Hash of the basis, from State_fingerprint() */
 };
 
 state* State_new();
 void State_init();
-int State_insert(state*, config*);
-state* State_find(config*);
+uint64_t State_fingerprint(config*);
+std::mutex& State_lock(uint64_t);
+int State_insert(state*);
+state* State_find(config*, uint64_t);
 state** State_arrayof();
 }
 using namespace State;
@@ -234,6 +247,43 @@ using namespace Plink;
 
 #include <vector>
 
+/* Strategies for packing the transaction sets into the action table */
+enum class e_packing {
+    FIRST_FIT,               /* Largest sets first, each at the first hole */
+    BEST_FIT,                /* Largest sets first, each at the tightest hole */
+    DISPLACE,                /* Widest sets first, each at the tightest hole */
+    SEARCH                   /* Best of a fixed number of orders tried */
+};
+
+/* The steps of a run, each of which is timed for -J */
+enum class e_phase {
+    PARSE,
+    FIRST_SETS,
+    STATES,
+    LINKS,
+    FOLLOW_SETS,
+    ACTIONS,
+    COMPRESS,
+    RESORT,
+    REPORT_OUTPUT,
+    REPORT_TABLE,
+    REPORT_HEADER,
+    COUNT
+};
+
+/* The work done by a run, counted for -J */
+struct workcount {
+    int64_t nconfig = 0;          /* Configurations created */
+    int64_t nplink = 0;           /* Follow-set propagation links created */
+    int64_t nunion = 0;           /* Calls to SetUnion() */
+    int64_t nunionChanged = 0;    /* Calls to SetUnion() that grew the set */
+    int64_t nfirstComp = 0;       /* Components of the first-set graph */
+    int64_t nfollowComp = 0;      /* Components of the follow-set graph */
+    int64_t nstateProbe = 0;      /* Slots probed by State_find() */
+    int64_t nconfigProbe = 0;     /* Slots probed by Configtable_find() */
+    int64_t nactOffset = 0;       /* Offsets tried by acttab_insert() */
+};
+
 /* The state vector for the entire parser generator is recorded as
 ** follows.  (LEMON uses no global variables and makes little use of
 ** static variables.  Fields in the following structure can be thought
@@ -284,7 +334,85 @@ struct lemon {
     int printPreprocessed         = 0;            /* Show preprocessor output on stdout */
     int has_fallback              = 0;            /* True if any %fallback is seen in the grammar */
     int nolinenosflag             = 0;            /* True if #line statements should not be printed */
+    int nthread                   = 0;            /* Number of threads that build the LR(0) states */
+    int firstsetusec              = 0;            /* Microseconds spent in FindFirstSets */
+    int nArenaObj                 = 0;            /* Objects carved from the pools */
+    int nArenaChunk               = 0;            /* Chunks allocated for the pools */
+    int arenaKB                   = 0;            /* Kilobytes in those chunks */
+    int arenaUsedKB               = 0;            /* Kilobytes carved from them */
+    int npacking                  = 0;            /* Action table packings tried */
+    int packusec                  = 0;            /* Microseconds spent packing */
+    int nunchanged                = 0;            /* Output files left as they were */
+    int phaseusec[(int)e_phase::COUNT] = {};      /* Microseconds in each step */
+    workcount work;                               /* Work done by all threads */
     char* argv0                   = nullptr;      /* Name of the program */
+
+    class Generator;                              /* Library interface, below */
+};
+
+/*
+** The parser generator as a library.  A Generator owns everything that
+** one run of LEMON builds, and frees all of it when it is destroyed.
+** Generators share no state, so several may run at once on different
+** threads.
+**
+** Set the options when constructing it, then call the phases in order:
+**
+**     parse()     Read the grammar and number its symbols and rules
+**     analyse()   Build the LR(0) automaton, follow-sets and actions
+**     compress()  Compress the action tables and renumber the states
+**     emit()      Write the .c (or .hpp), .h and .out files
+**
+** Each phase returns the number of errors seen so far.  Do not go on
+** to the later phases if parse() reports errors.
+*/
+class lemon::Generator {
+public:
+    struct Options {
+        std::vector<std::string> defines;     /* %ifdef macros, as with -D */
+        std::string outputDir;                /* Output directory, as with -d */
+        std::string templateName;             /* Driver template, as with -T; empty for the built-in lempar.c or lempar.hpp */
+        std::string argv0;                    /* Name of the program */
+        int nthread = 1;                      /* Threads used by analyse(), as with -j */
+        bool basisOnly = false;               /* -b */
+        bool noCompress = false;              /* -c */
+        bool printPreprocessed = false;       /* -E */
+        bool noLineNumbers = false;           /* -l */
+        bool makeHeaders = false;             /* -m */
+        bool showPrecedenceConflict = false;  /* -p */
+        bool quiet = false;                   /* -q */
+        bool noResort = false;                /* -r */
+        bool sql = false;                     /* -S */
+        bool cache = false;                   /* Reuse the automaton in the .lcache file, as with -K */
+        bool threaded = false;                /* Write the states as code too, as with -G */
+        bool cplusplus = false;               /* Write a header-only C++ parser, as with -X.  Ignores threaded */
+        bool inMemory = false;                /* Keep outputs in memory, write no files */
+        e_packing packing = e_packing::FIRST_FIT;  /* Action table packing, as with -P */
+        int packMoves = 2000;                 /* Orders tried by e_packing::SEARCH */
+        int denseBudget = 4096;               /* Bytes allowed for dense action tables, as with -y */
+    };
+
+    explicit Generator(const Options& options);
+    Generator() : Generator(Options()) {}
+    ~Generator();
+    Generator(const Generator&) = delete;
+    Generator& operator=(const Generator&) = delete;
+
+    int parse(const char* filename);
+    void reprint();
+    int analyse();
+    int compress();
+    int emit();
+
+    /* The state vector: counts, symbols, rules and states */
+    const lemon& result() const;
+
+    /* Files produced by emit() when Options::inMemory is set, keyed by
+    ** the name they would have been written to */
+    const std::map<std::string, std::string>& outputs() const;
+
+private:
+    genctx* ctx;
 };
 
 #include <string_view>
@@ -294,6 +422,7 @@ namespace Symbol
 /* Routines for handling symbols of the grammar */
 
 symbol* Symbol_new(const char*);
+symbol* Symbol_fromid(int);
 bool Symbolcmpp(const symbol*, const symbol*);
 void Symbol_init(void);
 symbol* Symbol_find(std::string_view);
@@ -0,0 +1,590 @@
+/*
+** The command line program of the LEMON parser generator.  It gathers
+** the options into a lemon::Generator::Options, then runs the phases of
+** a lemon::Generator, which is built from lemon.cpp as a library.
+**
+** The author of this program disclaims copyright.
+*/
+
+#include "lemon.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <assert.h>
+#include <thread>
+
+#include <algorithm>
+#include <numeric>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+
+/*
+** Compilers are getting increasingly pedantic about type conversions
+** as C evolves ever closer to Ada....  To work around the latest problems
+** we have to define the following variant of strlen().
+*/
+#define lemonStrlen(X)   ((int)strlen(X))
+
+/****** From the file "option.h" ******************************************/
+enum option_type {
+    OPT_FLAG = 1, OPT_INT, OPT_DBL, OPT_STR,
+    OPT_FFLAG, OPT_FINT, OPT_FDBL, OPT_FSTR
+};
+struct s_options {
+    option_type type;
+    const char* label;
+    char* arg;
+    const char* message;
+};
+int    OptInit(char*&);
+int    OptNArgs();
+char* OptArg(int);
+void   OptErr(int);
+void   OptPrint();
+
+/**************** From the file "main.c" ************************************/
+/* The options of the generator, as gathered from the command line */
+static lemon::Generator::Options cliopt;
+
+/* This routine is called with the argument to each -D command-line option.
+** Add the macro defined to the list of defines.
+*/
+static void handle_D_option(char* z) {
+    cliopt.defines.push_back(z);
+}
+
+/* Rember the name of the output directory
+*/
+static void handle_d_option(const char* z) {
+    cliopt.outputDir = z;
+}
+
+/* The number of threads used to build the LR(0) states.  "-j" alone
+** uses one thread for each hardware thread.
+*/
+static void handle_j_option(const char* z) {
+    cliopt.nthread = atoi(z);
+    if (cliopt.nthread <= 0) cliopt.nthread = (int)std::thread::hardware_concurrency();
+    if (cliopt.nthread <= 0) cliopt.nthread = 1;
+}
+
+/* Select the packing strategy of the action table.  "search" may be
+** followed by ":N", the number of moves to try.
+*/
+static void handle_P_option(const char* z) {
+    if (strcmp(z, "first") == 0) {
+        cliopt.packing = e_packing::FIRST_FIT;
+    }
+    else if (strcmp(z, "best") == 0) {
+        cliopt.packing = e_packing::BEST_FIT;
+    }
+    else if (strcmp(z, "displace") == 0) {
+        cliopt.packing = e_packing::DISPLACE;
+    }
+    else if (strncmp(z, "search", 6) == 0 && (z[6] == 0 || z[6] == ':')) {
+        cliopt.packing = e_packing::SEARCH;
+        if (z[6] == ':') cliopt.packMoves = atoi(&z[7]);
+    }
+    else {
+        fprintf(stderr, "Unknown packing strategy \"%s\".  Use first, best, "
+            "displace or search[:N].\n", z);
+        exit(1);
+    }
+}
+
+/* The largest size in bytes for which dense action tables are generated
+** instead of comb-compressed ones.  "-y0" always compresses.
+*/
+static void handle_y_option(const char* z) {
+    cliopt.denseBudget = atoi(z);
+}
+
+static void handle_T_option(const char* z) {
+    cliopt.templateName = z;
+}
+
+/* The file that receives the timings and counters of the run, for -J */
+static std::string jsonName;
+
+static void handle_J_option(const char* z) {
+    jsonName = z;
+}
+
+/* Print a single line of the "Parser Stats" output
+*/
+static void stats_line(const char* zLabel, int iValue) {
+    const int nLabel = lemonStrlen(zLabel);
+    printf("  %s%.*s %5d\n", zLabel,
+        35 - nLabel, "................................",
+        iValue);
+}
+
+/* Write a string on "out" as a JSON string */
+static void json_string(FILE* out, const char* z)
+{
+    fputc('"', out);
+    for (; *z; z++) {
+        unsigned char c = (unsigned char)*z;
+        if (c == '"' || c == '\\') fprintf(out, "\\%c", c);
+        else if (c < 0x20) fprintf(out, "\\u%04x", c);
+        else fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+/* Write the time spent in each step of the run, the work counted in it
+** and the statistics of the "-s" report to the file "zFile", as JSON */
+static void stats_json(const lemon& lem, const char* zFile)
+{
+    static const char* const azPhase[] = {
+        "Parse", "FindFirstSets", "FindStates", "FindLinks", "FindFollowSets",
+        "FindActions", "CompressTables", "ResortStates", "ReportOutput",
+        "ReportTable", "ReportHeader"
+    };
+    static_assert(sizeof(azPhase) / sizeof(azPhase[0]) == (size_t)e_phase::COUNT,
+        "one name for each e_phase");
+    const workcount& w = lem.work;
+    const std::pair<const char*, int64_t> counters[] = {
+        { "configs", w.nconfig },
+        { "plinks", w.nplink },
+        { "set_unions", w.nunion },
+        { "set_unions_changed", w.nunionChanged },
+        { "first_set_components", w.nfirstComp },
+        { "follow_set_components", w.nfollowComp },
+        { "state_probes", w.nstateProbe },
+        { "config_probes", w.nconfigProbe },
+        { "acttab_offsets_tried", w.nactOffset },
+        { "packings_tried", lem.npacking },
+        { "arena_objects", lem.nArenaObj },
+        { "arena_chunks", lem.nArenaChunk },
+        { "arena_kb", lem.arenaKB },
+        { "arena_used_kb", lem.arenaUsedKB },
+        { "unchanged_files", lem.nunchanged },
+    };
+    const std::pair<const char*, int> totals[] = {
+        { "terminal_symbols", lem.nterminal },
+        { "nonterminal_symbols", lem.nsymbol - lem.nterminal },
+        { "rules", lem.nrule },
+        { "states", lem.nxstate },
+        { "conflicts", lem.nconflict },
+        { "action_table_entries", lem.nactiontab },
+        { "lookahead_table_entries", lem.nlookaheadtab },
+        { "table_size_bytes", lem.tablesize },
+    };
+    FILE* out = fopen(zFile, "wb");
+    if (out == nullptr) {
+        fprintf(stderr, "Can't open file \"%s\".\n", zFile);
+        return;
+    }
+    fputs("{\n  \"grammar\": ", out);
+    json_string(out, lem.filename ? lem.filename : "");
+    fprintf(out, ",\n  \"threads\": %d,\n  \"errors\": %d,\n", lem.nthread, lem.errorcnt);
+    fputs("  \"phase_usec\": {", out);
+    for (int i = 0; i < (int)e_phase::COUNT; i++) {
+        fprintf(out, "%s\n    \"%s\": %d", i ? "," : "", azPhase[i], lem.phaseusec[i]);
+    }
+    fputs("\n  },\n  \"counters\": {", out);
+    for (size_t i = 0; i < sizeof(counters) / sizeof(counters[0]); i++) {
+        fprintf(out, "%s\n    \"%s\": %lld", i ? "," : "", counters[i].first,
+            (long long)counters[i].second);
+    }
+    fputs("\n  },\n  \"totals\": {", out);
+    for (size_t i = 0; i < sizeof(totals) / sizeof(totals[0]); i++) {
+        fprintf(out, "%s\n    \"%s\": %d", i ? "," : "", totals[i].first, totals[i].second);
+    }
+    fputs("\n  }\n}\n", out);
+    fclose(out);
+}
+
+static char** g_argv;
+static std::vector<s_options> op;
+static FILE* errstream;
+
+/* The main program.  Parse the command line and do it... */
+int main(int argc, char** argv) {
+    static int version = 0;
+    static int rpflag = 0;
+    static int basisflag = 0;
+    static int compress = 0;
+    static int quiet = 0;
+    static int statistics = 0;
+    static int mhflag = 0;
+    static int nolinenosflag = 0;
+    static int noResort = 0;
+    static int sqlFlag = 0;
+    static int printPP = 0;
+    static int showPrecedenceConflict = 0;
+    static int cache = 0;
+    static int threaded = 0;
+    static int cplusplus = 0;
+
+    op = {
+      {OPT_FLAG, "b", (char*)&basisflag, "Print only the basis in report."},
+      {OPT_FLAG, "c", (char*)&compress, "Don't compress the action table."},
+      {OPT_FSTR, "d", (char*)&handle_d_option, "Output directory.  Default '.'"},
+      {OPT_FSTR, "D", (char*)handle_D_option, "Define an %ifdef macro."},
+      {OPT_FLAG, "E", (char*)&printPP, "Print input file after preprocessing."},
+      {OPT_FSTR, "f", 0, "Ignored.  (Placeholder for -f compiler options.)"},
+      {OPT_FLAG, "g", (char*)&rpflag, "Print grammar without actions."},
+      {OPT_FLAG, "G", (char*)&threaded, "Also write the parser states as direct-threaded code."},
+      {OPT_FSTR, "I", 0, "Ignored.  (Placeholder for '-I' compiler options.)"},
+      {OPT_FSTR, "j", (char*)handle_j_option, "Build states on N threads.  Default 1."},
+      {OPT_FSTR, "J", (char*)handle_J_option, "Write per-step timings and counters as JSON."},
+      {OPT_FLAG, "K", (char*)&cache, "Reuse the automaton cached in the .lcache file."},
+      {OPT_FLAG, "m", (char*)&mhflag, "Output a makeheaders compatible file."},
+      {OPT_FLAG, "l", (char*)&nolinenosflag, "Do not print #line statements."},
+      {OPT_FSTR, "O", 0, "Ignored.  (Placeholder for '-O' compiler options.)"},
+      {OPT_FSTR, "P", (char*)handle_P_option,
+                      "Action table packing: first, best, displace or search[:N]."},
+      {OPT_FLAG, "p", (char*)&showPrecedenceConflict,
+                      "Show conflicts resolved by precedence rules"},
+      {OPT_FLAG, "q", (char*)&quiet, "(Quiet) Don't print the report file."},
+      {OPT_FLAG, "r", (char*)&noResort, "Do not sort or renumber states"},
+      {OPT_FLAG, "s", (char*)&statistics,
+                                     "Print parser stats to standard output."},
+      {OPT_FLAG, "S", (char*)&sqlFlag,
+                      "Generate the *.sql file describing the parser tables."},
+      {OPT_FLAG, "x", (char*)&version, "Print the version number."},
+      {OPT_FSTR, "T", (char*)handle_T_option, "Specify a template file."},
+      {OPT_FSTR, "y", (char*)handle_y_option, "Dense tables up to N bytes, if the template has them.  Default 4096."},
+      {OPT_FSTR, "W", 0, "Ignored.  (Placeholder for '-W' compiler options.)"},
+      {OPT_FLAG, "X", (char*)&cplusplus, "Write a header-only C++ parser (.hpp) instead of C."}
+    };
+    int exitcode;
+
+    (void)argc;
+    OptInit(*argv);
+    if (version) {
+        printf("Lemon version 1.0\n");
+        exit(0);
+    }
+    if (OptNArgs() != 1) {
+        fprintf(stderr, "Exactly one filename argument is required.\n");
+        exit(1);
+    }
+    cliopt.argv0 = argv[0];
+    cliopt.basisOnly = basisflag != 0;
+    cliopt.noCompress = compress != 0;
+    cliopt.printPreprocessed = printPP != 0;
+    cliopt.noLineNumbers = nolinenosflag != 0;
+    cliopt.makeHeaders = mhflag != 0;
+    cliopt.showPrecedenceConflict = showPrecedenceConflict != 0;
+    cliopt.quiet = quiet != 0;
+    cliopt.noResort = noResort != 0;
+    cliopt.sql = sqlFlag != 0;
+    cliopt.cache = cache != 0;
+    cliopt.threaded = threaded != 0;
+    cliopt.cplusplus = cplusplus != 0;
+
+    lemon::Generator gen(cliopt);
+    const lemon& lem = gen.result();
+
+    /* Parse the input file */
+    gen.parse(OptArg(0));
+    if (printPP || lem.errorcnt) {
+        if (!jsonName.empty()) stats_json(lem, jsonName.c_str());
+        exit(lem.errorcnt);
+    }
+
+    /* Generate a reprint of the grammar, if requested on the command line */
+    if (rpflag) {
+        gen.reprint();
+    }
+    else {
+        gen.analyse();
+        gen.compress();
+        gen.emit();
+    }
+    if (!jsonName.empty()) stats_json(lem, jsonName.c_str());
+    if (statistics) {
+        printf("Parser statistics:\n");
+        stats_line("terminal symbols", lem.nterminal);
+        stats_line("non-terminal symbols", lem.nsymbol - lem.nterminal);
+        stats_line("total symbols", lem.nsymbol);
+        stats_line("rules", lem.nrule);
+        stats_line("states", lem.nxstate);
+        stats_line("conflicts", lem.nconflict);
+        stats_line("action table entries", lem.nactiontab);
+        stats_line("lookahead table entries", lem.nlookaheadtab);
+        stats_line("total table size (bytes)", lem.tablesize);
+        stats_line("packings tried", lem.npacking);
+        stats_line("packing time (microseconds)", lem.packusec);
+        stats_line("first-set time (microseconds)", lem.firstsetusec);
+        stats_line("arena objects", lem.nArenaObj);
+        stats_line("arena chunks", lem.nArenaChunk);
+        stats_line("arena size (KB)", lem.arenaKB);
+        stats_line("arena used (KB)", lem.arenaUsedKB);
+        stats_line("unchanged files not rewritten", lem.nunchanged);
+    }
+    if (lem.nconflict > 0) {
+        fprintf(stderr, "%d parsing conflicts.\n", lem.nconflict);
+    }
+
+    /* return 0 on success, 1 on failure. */
+    exitcode = ((lem.errorcnt > 0) || (lem.nconflict > 0)) ? 1 : 0;
+    exit(exitcode);
+    return (exitcode);
+}
+
+/************************ From the file "option.c" **************************/
+
+
+#define ISOPT(X) ((X)[0]=='-'||(X)[0]=='+'||strchr((X),'=')!=0)
+
+/*
+** Print the command line with a carrot pointing to the k-th character
+** of the n-th field.
+*/
+static void errline(int n, int k)
+{
+    int spcnt, i;
+    if (g_argv[0])
+    {
+        std::cerr << g_argv[0];
+    }
+    spcnt = lemonStrlen(g_argv[0]) + 1;
+    for (i = 1; i < n && g_argv[i]; i++) {
+        std::cerr << " " << g_argv[i];
+        spcnt += lemonStrlen(g_argv[i]) + 1;
+    }
+    spcnt += k;
+    for (; g_argv[i]; i++)
+    {
+        std::cerr << " " << g_argv[i];
+    }
+    if (spcnt < 20) {
+        std::cerr << "\n" << std::setw(spcnt) << "" << "^-- here\n";
+    }
+    else {
+        std::cerr << "\n" << std::setw(spcnt - 7) << "" << "here --^\n";
+    }
+}
+
+/*
+** Return the index of the N-th non-switch argument.  Return -1
+** if N is out of range.
+*/
+static int argindex(int n)
+{
+    int i;
+    int dashdash = 0;
+    if (g_argv != nullptr && *g_argv != nullptr) {
+        for (i = 1; g_argv[i]; i++) {
+            if (dashdash || !ISOPT(g_argv[i])) {
+                if (n == 0) return i;
+                n--;
+            }
+            if (strcmp(g_argv[i], "--") == 0) dashdash = 1;
+        }
+    }
+    return -1;
+}
+
+static char emsg[] = "Command line syntax error: ";
+
+/*
+** Process a flag command line argument.
+*/
+static int handleflags(int i)
+{
+    int v;
+    int errcnt = 0;
+    int j;
+    for (j = 0; j < op.size(); j++) {
+        if (strncmp(&g_argv[i][1], op[j].label, lemonStrlen(op[j].label)) == 0) break;
+    }
+    v = g_argv[i][0] == '-' ? 1 : 0;
+    if (op[j].label == nullptr) {
+        std::cerr << emsg << "undefined option.\n";
+        errline(i, 1);
+        errcnt++;
+    }
+    else if (op[j].arg == nullptr) {
+        /* Ignore this option */
+    }
+    else if (op[j].type == OPT_FLAG) {
+        *((int*)op[j].arg) = v;
+    }
+    else if (op[j].type == OPT_FFLAG) {
+        (*(void(*)(int))(op[j].arg))(v);
+    }
+    else if (op[j].type == OPT_FSTR) {
+        (*(void(*)(char*))(op[j].arg))(&g_argv[i][2]);
+    }
+    else {
+        std::cerr << emsg << "missing argument on switch.\n";
+        errline(i, 1);
+
+        errcnt++;
+    }
+    return errcnt;
+}
+
+/*
+** Process a command line switch which has an argument.
+*/
+static int handleswitch(int i)
+{
+    int lv = 0;
+    double dv = 0.0;
+    char* sv = nullptr, * end;
+    char* cp;
+    int j;
+    int errcnt = 0;
+    cp = strchr(g_argv[i], '=');
+    assert(cp != nullptr);
+    *cp = 0;
+    for (j = 0; j < op.size(); j++) {
+        if (strcmp(g_argv[i], op[j].label) == 0) break;
+    }
+    *cp = '=';
+    if (op[j].label == nullptr) {
+        std::cerr << emsg << "undefined option.\n";
+        errline(i, 0);
+
+        errcnt++;
+    }
+    else {
+        cp++;
+        switch (op[j].type) {
+        case OPT_FLAG:
+        case OPT_FFLAG:
+            std::cerr << emsg << "option requires an argument.\n";
+            errline(i, 0);
+
+            errcnt++;
+            break;
+        case OPT_DBL:
+        case OPT_FDBL:
+            dv = strtod(cp, &end);
+            if (*end) {
+                std::cerr << emsg << "illegal character in floating-point argument.\n";
+                errline(i, (int)((char*)end - (char*)g_argv[i]));
+
+                errcnt++;
+            }
+            break;
+        case OPT_INT:
+        case OPT_FINT:
+            lv = strtol(cp, &end, 0);
+            if (*end) {
+
+                    std::cerr << emsg << "illegal character in integer argument.\n";
+                    errline(i, (int)((char*)end - (char*)g_argv[i]));
+                errcnt++;
+            }
+            break;
+        case OPT_STR:
+        case OPT_FSTR:
+            sv = cp;
+            break;
+        }
+        switch (op[j].type) {
+        case OPT_FLAG:
+        case OPT_FFLAG:
+            break;
+        case OPT_DBL:
+            *(double*)(op[j].arg) = dv;
+            break;
+        case OPT_FDBL:
+            (*(void(*)(double))(op[j].arg))(dv);
+            break;
+        case OPT_INT:
+            *(int*)(op[j].arg) = lv;
+            break;
+        case OPT_FINT:
+            (*(void(*)(int))(op[j].arg))((int)lv);
+            break;
+        case OPT_STR:
+            *(char**)(op[j].arg) = sv;
+            break;
+        case OPT_FSTR:
+            (*(void(*)(char*))(op[j].arg))(sv);
+            break;
+        }
+    }
+    return errcnt;
+}
+
+int OptInit(char*& a)
+{
+    int errcnt = 0;
+    g_argv = &a;
+    if (g_argv && *g_argv) {
+        int i;
+        for (i = 1; g_argv[i]; i++) {
+            if (g_argv[i][0] == '+' || g_argv[i][0] == '-') {
+                errcnt += handleflags(i);
+            }
+            else if (strchr(g_argv[i], '=')) {
+                errcnt += handleswitch(i);
+            }
+        }
+    }
+    if (errcnt > 0) {
+        std::cerr << "Valid command line options for \"" << a << "\" are:\n";
+        OptPrint();
+        exit(1);
+    }
+    return 0;
+}
+
+int OptNArgs(void) {
+    int cnt = 0;
+    int dashdash = 0;
+    int i;
+    if (g_argv != nullptr && g_argv[0] != nullptr) {
+        for (i = 1; g_argv[i]; i++) {
+            if (dashdash || !ISOPT(g_argv[i])) cnt++;
+            if (strcmp(g_argv[i], "--") == 0) dashdash = 1;
+        }
+    }
+    return cnt;
+}
+
+char* OptArg(int n)
+{
+    int i;
+    i = argindex(n);
+    return i >= 0 ? g_argv[i] : nullptr;
+}
+
+void OptErr(int n)
+{
+    int i;
+    i = argindex(n);
+    if (i >= 0) errline(i, 0);
+}
+
+void OptPrint() {
+
+    auto type_name = [](auto type) {
+        switch (type) {
+        case OPT_FLAG:
+        case OPT_FFLAG:
+            return "";
+        //case OPT_INT:
+        //case OPT_FINT:
+        //    return "<integer>";
+        //case OPT_DBL:
+        //case OPT_FDBL:
+        //    return "<real>";
+        case OPT_STR:
+        case OPT_FSTR:
+            return "<string>";
+        }
+
+        return "";
+    };
+
+    size_t max = std::transform_reduce(op.begin(), op.end(), size_t{0}, [](auto x, auto y) { return std::max(x, y); }, [&](const auto& e) {
+            return strlen(e.label) + strlen(type_name(e.type));
+        });
+
+    std::for_each(op.begin(), op.end(), [&](const auto& e) {
+        std::cerr << "  -" << e.label << std::setw(max - strlen(e.label)) << type_name(e.type) << "   " << e.message << "\n";
+    });
+}
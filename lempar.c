@@ -60,7 +60,8 @@
 **                       which is ParseTOKENTYPE.  The entry in the union
 **                       for terminal symbols is called "yy0".
 **    YYSTACKDEPTH       is the maximum depth of the parser's stack.  If
-**                       zero the stack is dynamically sized using realloc()
+**                       zero the stack is dynamically sized using realloc(),
+**                       or grows as a chain of segments with YYSTACKSEGMENTS
 **    ParseARG_SDECL     A static variable declaration for the %extra_argument
 **    ParseARG_PDECL     A parameter declaration for the %extra_argument
 **    ParseARG_PARAM     Code to pass %extra_argument as a subroutine parameter
@@ -80,6 +81,10 @@
 **    YY_NO_ACTION       The yy_action[] code for no-op
 **    YY_MIN_REDUCE      Minimum value for reduce actions
 **    YY_MAX_REDUCE      Maximum value for reduce actions
+**    YYDENSE            If defined, the action tables are dense matrices
+**                       indexed by state and symbol
+**    YYTHREADED         If defined, the states of the parser are also
+**                       written out as code, in yy_threaded()
 */
 #ifndef INTERFACE
 # define INTERFACE 1
@@ -151,6 +156,14 @@
 **                     shifting non-terminals after a reduce.
 **  yy_default[]       Default action for each state.
 **
+** Small grammars are generated with YYDENSE defined instead.  Then the
+** first four tables are replaced by two matrices that give the action
+** with a single indexed load:
+**
+**  yy_dense_action[S][X]  The action for terminal X in state S, with any
+**                         fallback or wildcard token already applied.
+**  yy_dense_goto[S][X]    The action for non-terminal YYNTOKEN+X in state S.
+**
 *********** Begin parsing tables **********************************************/
 %%
 /********** End of lemon-generated parsing tables *****************************/
@@ -200,6 +213,37 @@ struct yyStackEntry {
 };
 typedef struct yyStackEntry yyStackEntry;
 
+/* A stack without a fixed YYSTACKDEPTH is an array of YYSTACKINIT
+** entries, which is grown with realloc() whenever it is full.
+**
+** If YYSTACKSEGMENTS is defined, it is instead a chain of segments that
+** grows without moving the entries already on it.  Each new segment is at
+** least twice the size of the one below it, and YYSTACKINIT is the size
+** of the first.  When a segment is full, as many entries as the longest
+** right-hand side of a rule are copied from its top to the bottom of the
+** next, so that the right-hand side of any rule, and the entry under it,
+** are always in a single segment.  They are copied back when the stack
+** shrinks below them again.  Segments are kept for reuse until the
+** parser is finalized.  This spares a deep stack the copy of realloc(),
+** where realloc() cannot grow it in place, at the cost of fresh memory
+** for each new segment and of a test on each reduce.  The large segments
+** are usually handed back to the system when a parser is finalized, so
+** that a program which makes a parser for each deep input is slower with
+** them.
+**
+** Either way, ParseReserve() can make the stack large enough for a known
+** depth in advance.
+*/
+#if YYSTACKDEPTH<=0
+# ifndef YYSTACKINIT
+#  define YYSTACKINIT 100
+# endif
+# ifdef YYSTACKSEGMENTS
+#  define YYNSTACKSEG 24
+static int yyMaxRhs(void);
+# endif
+#endif
+
 /* The state of the parser is completely contained in an instance of
 ** the following structure */
 struct yyParser {
@@ -212,10 +256,22 @@ struct yyParser {
 #endif
     ParseARG_SDECL                /* A place to hold %extra_argument */
         ParseCTX_SDECL                /* A place to hold %extra_context */
-#if YYSTACKDEPTH<=0
-        int yystksz;                  /* Current side of the stack */
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+    yyStackEntry* yystack;        /* The current segment of the stack */
+    yyStackEntry* yystackEnd;     /* Last entry in the current segment */
+    yyStackEntry* yystackLow;     /* Go back a segment if yytos drops below */
+    int yystkbase;                /* Depth of yystack[0] in the whole stack */
+    int yystkseg;                 /* Index of the current segment */
+    int yystknseg;                /* Number of segments allocated */
+    int yystkrhs;                 /* Entries shared by adjacent segments */
+    yyStackEntry* yystkmem[YYNSTACKSEG];  /* The segments, bottom one first */
+    int yystksz[YYNSTACKSEG];     /* Number of entries in each segment */
+    yyStackEntry yystk0;          /* The stack if no segment can be allocated */
+#elif YYSTACKDEPTH<=0
+    int yystksz;                  /* Current size of the stack */
     yyStackEntry* yystack;        /* The parser's stack */
-    yyStackEntry yystk0;          /* First stack entry */
+    yyStackEntry* yystackEnd;     /* Last entry in the stack */
+    yyStackEntry yystk0;          /* The stack if it cannot be allocated */
 #else
         yyStackEntry yystack[YYSTACKDEPTH];  /* The parser's stack */
     yyStackEntry* yystackEnd;            /* Last entry in the stack */
@@ -223,6 +279,13 @@ struct yyParser {
 };
 typedef struct yyParser yyParser;
 
+/* The depth of the stack, not counting the entry at the bottom */
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+# define yyStackDepth(P) ((P)->yystkbase + (int)((P)->yytos - (P)->yystack))
+#else
+# define yyStackDepth(P) ((int)((P)->yytos - (P)->yystack))
+#endif
+
 #ifndef NDEBUG
 #include <stdio.h>
 #include <assert.h>
@@ -273,38 +336,133 @@ static const char* const yyRuleName[] = {
 #endif /* NDEBUG */
 
 
-#if YYSTACKDEPTH<=0
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
 /*
-** Try to increase the size of the parser stack.  Return the number
-** of errors.  Return 0 on success.
+** Allocate segment iSeg of the stack, with room for at least n entries
+** and for twice as many as the segment below it.  Return non-zero if
+** that is not possible.
+*/
+static int yyAllocSegment(yyParser* p, int iSeg, int n) {
+    yyStackEntry* pNew;
+
+    if (iSeg > 0 && n < p->yystksz[iSeg - 1] * 2) n = p->yystksz[iSeg - 1] * 2;
+    if (n < p->yystkrhs * 2 + 2) n = p->yystkrhs * 2 + 2;
+    /* Keep every depth well within the range of an int */
+    if (iSeg >= YYNSTACKSEG || n > 0x10000000) return 1;
+    pNew = (yyStackEntry*)malloc(n * sizeof(pNew[0]));
+    if (pNew == 0) return 1;
+#ifndef NDEBUG
+    if (yyTraceFILE) {
+        fprintf(yyTraceFILE, "%sStack segment %d has %d entries.\n",
+            yyTracePrompt, iSeg, n);
+    }
+#endif
+    p->yystkmem[iSeg] = pNew;
+    p->yystksz[iSeg] = n;
+    if (p->yystknseg <= iSeg) p->yystknseg = iSeg + 1;
+    return 0;
+}
+
+/*
+** Move the parser to the next segment of the stack, allocating it if
+** need be.  The current segment must be full, with yytos at its last
+** entry or just past it.  Return the number of errors.  Return 0 on
+** success.
 */
 static int yyGrowStack(yyParser* p) {
-    int newSize;
-    int idx;
+    yyStackEntry* pOld = p->yystack;
+    int nPast = (int)(p->yytos - p->yystackEnd);  /* 1 if yytos is past the end */
+    int iSeg = p->yystkseg;
+    int i;
+
+    if (p->yystknseg == 0) {
+        /* ParseInit() could not allocate the first segment */
+        if (yyAllocSegment(p, 0, YYSTACKINIT)) return 1;
+        p->yystkmem[0][0] = p->yystk0;
+        p->yystack = p->yystackLow = p->yystkmem[0];
+        p->yystackEnd = &p->yystack[p->yystksz[0] - 1];
+        p->yytos = &p->yystack[nPast];
+        return 0;
+    }
+    if (iSeg + 1 == p->yystknseg && yyAllocSegment(p, iSeg + 1, 0)) return 1;
+    p->yystkbase += p->yystksz[iSeg] - p->yystkrhs;
+    p->yystkseg = ++iSeg;
+    p->yystack = p->yystkmem[iSeg];
+    p->yystackEnd = &p->yystack[p->yystksz[iSeg] - 1];
+    p->yystackLow = &p->yystack[p->yystkrhs];
+    for (i = 0; i < p->yystkrhs; i++) {
+        p->yystack[i] = pOld[p->yystksz[iSeg - 1] - p->yystkrhs + i];
+    }
+    p->yytos = &p->yystack[p->yystkrhs - 1 + nPast];
+    return 0;
+}
+
+/*
+** Go back to the segment below once yytos has dropped under yystackLow,
+** and return the new yytos.  The entries that are left in the current
+** segment replace the copies at the top of the one below.
+*/
+static yyStackEntry* yyShrinkStack(yyParser* p) {
+    yyStackEntry* pOld = p->yystack;
+    int n = (int)(p->yytos - pOld) + 1;  /* Entries left in this segment */
+    int iSeg = p->yystkseg;
+    int i;
+
+    if (iSeg == 0) return p->yytos;  /* Popped the bottom of the stack */
+    p->yystkseg = --iSeg;
+    p->yystack = p->yystkmem[iSeg];
+    p->yystackEnd = &p->yystack[p->yystksz[iSeg] - 1];
+    p->yystackLow = iSeg ? &p->yystack[p->yystkrhs] : p->yystack;
+    p->yystkbase -= p->yystksz[iSeg] - p->yystkrhs;
+    p->yytos = p->yystackEnd - p->yystkrhs;
+    for (i = 0; i < n; i++) *++p->yytos = pOld[i];
+    return p->yytos;
+}
+
+/* Update M, the top of the stack, after popping entries off the stack */
+# define yyStackPopped(P, M) if ((M) < (P)->yystackLow) (M) = yyShrinkStack(P)
+#elif YYSTACKDEPTH<=0
+/*
+** Resize the parser stack to hold n entries.  Return non-zero, leaving
+** the stack as it was, if that is not possible.
+*/
+static int yyResizeStack(yyParser* p, int n) {
+    int idx = (int)(p->yytos - p->yystack);
     yyStackEntry* pNew;
 
-    newSize = p->yystksz * 2 + 100;
-    idx = p->yytos ? (int)(p->yytos - p->yystack) : 0;
+    /* Keep every depth well within the range of an int */
+    if (n > 0x10000000) return 1;
     if (p->yystack == &p->yystk0) {
-        pNew = malloc(newSize * sizeof(pNew[0]));
+        pNew = malloc(n * sizeof(pNew[0]));
         if (pNew) pNew[0] = p->yystk0;
     }
     else {
-        pNew = realloc(p->yystack, newSize * sizeof(pNew[0]));
+        pNew = realloc(p->yystack, n * sizeof(pNew[0]));
     }
-    if (pNew) {
-        p->yystack = pNew;
-        p->yytos = &p->yystack[idx];
+    if (pNew == 0) return 1;
 #ifndef NDEBUG
-        if (yyTraceFILE) {
-            fprintf(yyTraceFILE, "%sStack grows from %d to %d entries.\n",
-                yyTracePrompt, p->yystksz, newSize);
-        }
-#endif
-        p->yystksz = newSize;
+    if (yyTraceFILE) {
+        fprintf(yyTraceFILE, "%sStack grows from %d to %d entries.\n",
+            yyTracePrompt, p->yystksz, n);
     }
-    return pNew == 0;
+#endif
+    p->yystack = pNew;
+    p->yystackEnd = &pNew[n - 1];
+    p->yytos = &pNew[idx];
+    p->yystksz = n;
+    return 0;
+}
+
+/*
+** Try to increase the size of the parser stack.  Return the number
+** of errors.  Return 0 on success.
+*/
+static int yyGrowStack(yyParser* p) {
+    return yyResizeStack(p, p->yystksz * 2 + 100);
 }
+# define yyStackPopped(P, M)
+#else
+# define yyStackPopped(P, M)
 #endif
 
 /* Datatype of the argument to the memory allocated passed as the
@@ -324,14 +482,25 @@ void ParseInit(void* yypRawParser ParseCTX_PDECL) {
 #ifdef YYTRACKMAXSTACKDEPTH
         yypParser->yyhwm = 0;
 #endif
-#if YYSTACKDEPTH<=0
-    yypParser->yytos = NULL;
-    yypParser->yystack = NULL;
-    yypParser->yystksz = 0;
-    if (yyGrowStack(yypParser)) {
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+    yypParser->yystkbase = 0;
+    yypParser->yystkseg = 0;
+    yypParser->yystknseg = 0;
+    yypParser->yystkrhs = yyMaxRhs();
+    if (yyAllocSegment(yypParser, 0, YYSTACKINIT)) {
+        yypParser->yystkmem[0] = &yypParser->yystk0;
+        yypParser->yystksz[0] = 1;
+    }
+    yypParser->yystack = yypParser->yystackLow = yypParser->yystkmem[0];
+    yypParser->yystackEnd = &yypParser->yystack[yypParser->yystksz[0] - 1];
+#elif YYSTACKDEPTH<=0
+    yypParser->yystack = malloc(YYSTACKINIT * sizeof(yypParser->yystack[0]));
+    yypParser->yystksz = YYSTACKINIT;
+    if (yypParser->yystack == 0) {
         yypParser->yystack = &yypParser->yystk0;
         yypParser->yystksz = 1;
     }
+    yypParser->yystackEnd = &yypParser->yystack[yypParser->yystksz - 1];
 #endif
 #ifndef YYNOERRORRECOVERY
     yypParser->yyerrcnt = -1;
@@ -395,8 +564,8 @@ static void yy_destructor(
             ** inside the C code.
             */
             /********* Begin destructor definitions ***************************************/
-            %%
-                /********* End destructor definitions *****************************************/
+%%
+            /********* End destructor definitions *****************************************/
         default:  break;   /* If no destructor action specified: do nothing */
         }
 }
@@ -412,6 +581,7 @@ static void yy_pop_parser_stack(yyParser* pParser) {
     assert(pParser->yytos != 0);
     assert(pParser->yytos > pParser->yystack);
     yytos = pParser->yytos--;
+    yyStackPopped(pParser, pParser->yytos);
 #ifndef NDEBUG
     if (yyTraceFILE) {
         fprintf(yyTraceFILE, "%sPopping %s\n",
@@ -428,7 +598,12 @@ static void yy_pop_parser_stack(yyParser* pParser) {
 void ParseFinalize(void* p) {
     yyParser* pParser = (yyParser*)p;
     while (pParser->yytos > pParser->yystack) yy_pop_parser_stack(pParser);
-#if YYSTACKDEPTH<=0
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+    {
+        int i;
+        for (i = 0; i < pParser->yystknseg; i++) free(pParser->yystkmem[i]);
+    }
+#elif YYSTACKDEPTH<=0
     if (pParser->yystack != &pParser->yystk0) free(pParser->yystack);
 #endif
 }
@@ -464,6 +639,50 @@ int ParseStackPeak(void* p) {
 }
 #endif
 
+/*
+** Make sure that the stack of a parser can reach the given depth without
+** allocating any more memory.  Return non-zero if it cannot, because
+** memory ran out or the depth is beyond a fixed YYSTACKDEPTH.
+**
+** A program that parses many similar inputs can build its parser with
+** YYTRACKMAXSTACKDEPTH and pass the ParseStackPeak() of earlier parsers
+** here, so that later ones never grow their stack while parsing.
+*/
+int ParseReserve(void* p, int depth) {
+    yyParser* pParser = (yyParser*)p;
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+    int iSeg = pParser->yystkseg;
+    int base = pParser->yystkbase;  /* Depth of segment iSeg's first entry */
+
+    if (pParser->yytos == pParser->yystkmem[0]) {
+        /* The stack is empty, so the first segment can be replaced by one
+        ** large enough for all of it */
+        yyStackEntry* pOld = pParser->yystkmem[0];
+        if (pParser->yystksz[0] > depth) return 0;
+        if (yyAllocSegment(pParser, 0, depth + 1)) return 1;
+        pParser->yystkmem[0][0] = pOld[0];
+        if (pOld != &pParser->yystk0) free(pOld);
+        pParser->yystack = pParser->yystackLow = pParser->yystkmem[0];
+        pParser->yystackEnd = &pParser->yystack[pParser->yystksz[0] - 1];
+        pParser->yytos = pParser->yystack;
+        return 0;
+    }
+    while (base + pParser->yystksz[iSeg] - 1 < depth) {
+        base += pParser->yystksz[iSeg] - pParser->yystkrhs;
+        iSeg++;
+        if (iSeg == pParser->yystknseg
+            && yyAllocSegment(pParser, iSeg, depth - base + 1)) return 1;
+    }
+    return 0;
+#elif YYSTACKDEPTH<=0
+    if (pParser->yystksz > depth) return 0;
+    return yyResizeStack(pParser, depth + 1);
+#else
+    (void)pParser;
+    return depth >= YYSTACKDEPTH;
+#endif
+}
+
 /* This array of booleans keeps track of the parser statement
 ** coverage.  The element yycoverage[X][Y] is set when the parser
 ** is in state X and has a lookahead token Y.  In a well-tested
@@ -483,12 +702,21 @@ static unsigned char yycoverage[YYNSTATE][YYNTOKEN];
 */
 #if defined(YYCOVERAGE)
 int ParseCoverage(FILE* out) {
-    int stateno, iLookAhead, i;
+    int stateno, iLookAhead;
+#ifndef YYDENSE
+    int i;
+#endif
     int nMissed = 0;
+#ifdef YYDENSE
+    for (stateno = 0; stateno <= YY_SHIFT_COUNT; stateno++) {
+        for (iLookAhead = 0; iLookAhead < YYNTOKEN; iLookAhead++) {
+            if (yy_dense_action[stateno][iLookAhead] == YY_ERROR_ACTION) continue;
+#else
     for (stateno = 0; stateno < YYNSTATE; stateno++) {
         i = yy_shift_ofst[stateno];
         for (iLookAhead = 0; iLookAhead < YYNTOKEN; iLookAhead++) {
             if (yy_lookahead[i + iLookAhead] != iLookAhead) continue;
+#endif
             if (yycoverage[stateno][iLookAhead] == 0) nMissed++;
             if (out) {
                 fprintf(out, "State %d lookahead %s %s\n", stateno,
@@ -509,13 +737,19 @@ static YYACTIONTYPE yy_find_shift_action(
     YYCODETYPE iLookAhead,    /* The look-ahead token */
     YYACTIONTYPE stateno      /* Current state number */
 ) {
+#ifndef YYDENSE
     int i;
+#endif
 
     if (stateno > YY_MAX_SHIFT) return stateno;
     assert(stateno <= YY_SHIFT_COUNT);
 #if defined(YYCOVERAGE)
     yycoverage[stateno][iLookAhead] = 1;
 #endif
+#ifdef YYDENSE
+    assert(iLookAhead < YYNTOKEN);
+    return yy_dense_action[stateno][iLookAhead];
+#else
     do {
         i = yy_shift_ofst[stateno];
         assert(i >= 0);
@@ -565,6 +799,7 @@ static YYACTIONTYPE yy_find_shift_action(
             return yy_action[i];
         }
     } while (1);
+#endif /* YYDENSE */
 }
 
 /*
@@ -575,7 +810,9 @@ static YYACTIONTYPE yy_find_reduce_action(
     YYACTIONTYPE stateno,     /* Current state number */
     YYCODETYPE iLookAhead     /* The look-ahead token */
 ) {
+#ifndef YYDENSE
     int i;
+#endif
 #ifdef YYERRORSYMBOL
     if (stateno > YY_REDUCE_COUNT) {
         return yy_default[stateno];
@@ -583,6 +820,10 @@ static YYACTIONTYPE yy_find_reduce_action(
 #else
     assert(stateno <= YY_REDUCE_COUNT);
 #endif
+#ifdef YYDENSE
+    assert(iLookAhead >= YYNTOKEN && iLookAhead < YYNOCODE);
+    return yy_dense_goto[stateno][iLookAhead - YYNTOKEN];
+#else
     i = yy_reduce_ofst[stateno];
     assert(iLookAhead != YYNOCODE);
     i += iLookAhead;
@@ -595,6 +836,7 @@ static YYACTIONTYPE yy_find_reduce_action(
     assert(yy_lookahead[i] == iLookAhead);
 #endif
     return yy_action[i];
+#endif /* YYDENSE */
 }
 
 /*
@@ -612,8 +854,8 @@ static void yyStackOverflow(yyParser* yypParser) {
     /* Here code is inserted which will execute if the parser
     ** stack every overflows */
     /******** Begin %stack_overflow code ******************************************/
-    %%
-        /******** End %stack_overflow code ********************************************/
+%%
+    /******** End %stack_overflow code ********************************************/
         ParseARG_STORE /* Suppress warning about unused %extra_argument var */
         ParseCTX_STORE
 }
@@ -641,9 +883,10 @@ static void yyTraceShift(yyParser* yypParser, int yyNewState, const char* zTag)
 #endif
 
 /*
-** Perform a shift action.
+** Perform a shift action.  Return non-zero, after reporting the
+** overflow, if there is no room on the stack.
 */
-static void yy_shift(
+static int yy_shift(
     yyParser* yypParser,          /* The parser to be shifted */
     YYACTIONTYPE yyNewState,      /* The new state to shift in */
     YYCODETYPE yyMajor,           /* The major token to shift in */
@@ -652,23 +895,23 @@ static void yy_shift(
     yyStackEntry* yytos;
     yypParser->yytos++;
 #ifdef YYTRACKMAXSTACKDEPTH
-    if ((int)(yypParser->yytos - yypParser->yystack) > yypParser->yyhwm) {
+    if (yyStackDepth(yypParser) > yypParser->yyhwm) {
         yypParser->yyhwm++;
-        assert(yypParser->yyhwm == (int)(yypParser->yytos - yypParser->yystack));
+        assert(yypParser->yyhwm == yyStackDepth(yypParser));
     }
 #endif
 #if YYSTACKDEPTH>0 
     if (yypParser->yytos > yypParser->yystackEnd) {
         yypParser->yytos--;
         yyStackOverflow(yypParser);
-        return;
+        return 1;
     }
 #else
-    if (yypParser->yytos >= &yypParser->yystack[yypParser->yystksz]) {
+    if (yypParser->yytos > yypParser->yystackEnd) {
         if (yyGrowStack(yypParser)) {
             yypParser->yytos--;
             yyStackOverflow(yypParser);
-            return;
+            return 1;
         }
     }
 #endif
@@ -680,6 +923,7 @@ static void yy_shift(
     yytos->major = yyMajor;
     yytos->minor.yy0 = yyMinor;
     yyTraceShift(yypParser, yyNewState, "Shift");
+    return 0;
 }
 
 /* For rule J, yyRuleInfoLhs[J] contains the symbol on the left-hand side
@@ -694,29 +938,39 @@ static const signed char yyRuleInfoNRhs[] = {
 %%
 };
 
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+/* Return the most symbols on the right-hand side of any rule, or 1 */
+static int yyMaxRhs(void) {
+    unsigned int i;
+    int n = 1;
+    for (i = 0; i < sizeof(yyRuleInfoNRhs) / sizeof(yyRuleInfoNRhs[0]); i++) {
+        if (-yyRuleInfoNRhs[i] > n) n = -yyRuleInfoNRhs[i];
+    }
+    return n;
+}
+#endif
+
 static void yy_accept(yyParser*);  /* Forward Declaration */
 
 /*
-** Perform a reduce action and the shift that must immediately
-** follow the reduce.
+** Run the code of rule yyruleno, the first half of a reduce.  The values
+** of the right-hand side are still on the stack.
 **
 ** The yyLookahead and yyLookaheadToken parameters provide reduce actions
 ** access to the lookahead token (if any).  The yyLookahead will be YYNOCODE
-** if the lookahead token has already been consumed.  As this procedure is
-** only called from one place, optimizing compilers will in-line it, which
-** means that the extra parameters have no performance impact.
+** if the lookahead token has already been consumed.  Unless YYTHREADED is
+** defined this procedure is only called from yy_reduce(), so optimizing
+** compilers will in-line it and the extra parameters have no performance
+** impact.
 */
-static YYACTIONTYPE yy_reduce(
+static void yy_reduce_action(
     yyParser* yypParser,         /* The parser */
     unsigned int yyruleno,       /* Number of the rule by which to reduce */
     int yyLookahead,             /* Lookahead token, or YYNOCODE if none */
     ParseTOKENTYPE yyLookaheadToken  /* Value of the lookahead token */
     ParseCTX_PDECL                   /* %extra_context */
 ) {
-    int yygoto;                     /* The next state */
-    YYACTIONTYPE yyact;             /* The next action */
     yyStackEntry* yymsp;            /* The top of the parser's stack */
-    int yysize;                     /* Amount to pop the stack */
     ParseARG_FETCH
     (void)yyLookahead;
     (void)yyLookaheadToken;
@@ -732,9 +986,30 @@ static YYACTIONTYPE yy_reduce(
         **     break;
         */
         /********** Begin reduce actions **********************************************/
-        %%
-            /********** End reduce actions ************************************************/
+%%
+        /********** End reduce actions ************************************************/
     };
+}
+
+/*
+** Perform a reduce action and the shift that must immediately
+** follow the reduce.  As this procedure is only called from one place,
+** optimizing compilers will in-line it.
+*/
+static YYACTIONTYPE yy_reduce(
+    yyParser* yypParser,         /* The parser */
+    unsigned int yyruleno,       /* Number of the rule by which to reduce */
+    int yyLookahead,             /* Lookahead token, or YYNOCODE if none */
+    ParseTOKENTYPE yyLookaheadToken  /* Value of the lookahead token */
+    ParseCTX_PDECL                   /* %extra_context */
+) {
+    int yygoto;                     /* The next state */
+    YYACTIONTYPE yyact;             /* The next action */
+    yyStackEntry* yymsp;            /* The top of the parser's stack */
+    int yysize;                     /* Amount to pop the stack */
+
+    yy_reduce_action(yypParser, yyruleno, yyLookahead, yyLookaheadToken ParseCTX_PARAM);
+    yymsp = yypParser->yytos;
     assert(yyruleno < sizeof(yyRuleInfoLhs) / sizeof(yyRuleInfoLhs[0]));
     yygoto = yyRuleInfoLhs[yyruleno];
     yysize = yyRuleInfoNRhs[yyruleno];
@@ -749,6 +1024,7 @@ static YYACTIONTYPE yy_reduce(
 
     yymsp += yysize + 1;
     yypParser->yytos = yymsp;
+    yyStackPopped(yypParser, yymsp);
     yymsp->stateno = (YYACTIONTYPE)yyact;
     yymsp->major = (YYCODETYPE)yygoto;
     yyTraceShift(yypParser, yyact, "... then shift");
@@ -773,8 +1049,8 @@ static void yy_parse_failed(
     /* Here code is inserted which will be executed whenever the
     ** parser fails */
     /************ Begin %parse_failure code ***************************************/
-    %%
-        /************ End %parse_failure code *****************************************/
+%%
+    /************ End %parse_failure code *****************************************/
         ParseARG_STORE /* Suppress warning about unused %extra_argument variable */
         ParseCTX_STORE
 }
@@ -792,7 +1068,7 @@ static void yy_syntax_error(
         ParseCTX_FETCH
 #define TOKEN yyminor
         /************ Begin %syntax_error code ****************************************/
-        %%
+%%
         /************ End %syntax_error code ******************************************/
         ParseARG_STORE /* Suppress warning about unused %extra_argument variable */
         ParseCTX_STORE
@@ -818,50 +1094,94 @@ static void yy_accept(
     /* Here code is inserted which will be executed whenever the
     ** parser accepts */
     /*********** Begin %parse_accept code *****************************************/
-    %%
-        /*********** End %parse_accept code *******************************************/
+%%
+    /*********** End %parse_accept code *******************************************/
         ParseARG_STORE /* Suppress warning about unused %extra_argument variable */
         ParseCTX_STORE
 }
 
-/* The main parser program.
-** The first argument is a pointer to a structure obtained from
-** "ParseAlloc" which describes the current state of the parser.
-** The second argument is the major token number.  The third is
-** the minor token.  The fourth optional argument is whatever the
-** user wants (and specified in the grammar) and is available for
-** use by the action routines.
-**
-** Inputs:
-** <ul>
-** <li> A pointer to the parser (an opaque structure.)
-** <li> The major token number.
-** <li> The minor token number.
-** <li> An option argument of a grammar-specified type.
-** </ul>
-**
-** Outputs:
-** None.
+/*
+** Make sure there is room on the stack for the left-hand side of a rule
+** with an empty right-hand side.  Return non-zero, after reporting the
+** overflow, if there is not.
 */
-void Parse(
-    void* yyp,                   /* The parser */
+static int yy_reduce_room(yyParser* yypParser) {
+#ifdef YYTRACKMAXSTACKDEPTH
+    if (yyStackDepth(yypParser) > yypParser->yyhwm) {
+        yypParser->yyhwm++;
+        assert(yypParser->yyhwm == yyStackDepth(yypParser));
+    }
+#endif
+#if YYSTACKDEPTH>0 
+    if (yypParser->yytos >= yypParser->yystackEnd) {
+        yyStackOverflow(yypParser);
+        return 1;
+    }
+#else
+    if (yypParser->yytos >= yypParser->yystackEnd) {
+        if (yyGrowStack(yypParser)) {
+            yyStackOverflow(yypParser);
+            return 1;
+        }
+    }
+#endif
+    return 0;
+}
+
+/* When YYTHREADED is defined the generator writes each state of the
+** parser as a block of code in yy_threaded(), at the end of the file.
+** It does all the reduces caused by one look-ahead token.  Blocks are
+** reached through a table of label addresses with GCC and Clang, or
+** through a switch with other compilers or if YYNOCOMPUTEDGOTO is
+** defined.  The tables above are still used to recover from syntax
+** errors, when tracing and to measure coverage.
+*/
+#ifdef YYTHREADED
+# if defined(__GNUC__) && !defined(YYNOCOMPUTEDGOTO)
+#  define YYCOMPUTEDGOTO 1
+# endif
+# if defined(YYCOVERAGE)
+#  define yyThreadedOn 0
+# elif defined(NDEBUG)
+#  define yyThreadedOn 1
+# else
+#  define yyThreadedOn (yyTraceFILE == 0)
+# endif
+static YYACTIONTYPE yy_threaded(yyParser*, YYCODETYPE, ParseTOKENTYPE ParseCTX_PDECL);
+#endif
+
+/* Force a function inline where the compiler allows it */
+#if defined(__GNUC__)
+# define YYINLINE __inline__ __attribute__((always_inline))
+#elif defined(_MSC_VER)
+# define YYINLINE __forceinline
+#else
+# define YYINLINE
+#endif
+
+/* Process a single token for Parse() and ParseBatch(), which have
+** already stored the %extra_argument.  It is forced inline so that each
+** of them keeps the parser state in registers.  Return true if the token
+** made the parser accept its input, hit a syntax error or overflow the
+** stack.
+*/
+static YYINLINE int yy_parse_token(
+    yyParser* yypParser,         /* The parser */
     int yymajor,                 /* The major token code number */
     ParseTOKENTYPE yyminor       /* The value for the token */
-    ParseARG_PDECL               /* Optional %extra_argument parameter */
+    ParseCTX_PDECL               /* Optional %extra_context parameter */
 ) {
     YYMINORTYPE yyminorunion;
     YYACTIONTYPE yyact;   /* The parser action. */
+    int yystop = 0;       /* True once the token has hit an error or overflow */
 #if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
     int yyendofinput;     /* True if we are at the end of input */
 #endif
 #ifdef YYERRORSYMBOL
     int yyerrorhit = 0;   /* True if yymajor has invoked an error */
 #endif
-    yyParser* yypParser = (yyParser*)yyp;  /* The parser */
-    ParseCTX_FETCH
-        ParseARG_STORE
 
-        assert(yypParser->yytos != 0);
+    assert(yypParser->yytos != 0);
 #if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
     yyendofinput = (yymajor == 0);
 #endif
@@ -883,6 +1203,17 @@ void Parse(
     while (1) { /* Exit by "break" */
         assert(yypParser->yytos >= yypParser->yystack);
         assert(yyact == yypParser->yytos->stateno);
+#ifdef YYTHREADED
+        if (yyThreadedOn) {
+            yyact = yy_threaded(yypParser, (YYCODETYPE)yymajor, yyminor ParseCTX_PARAM);
+            if (yyact == YY_NO_ACTION) { /* The stack overflowed */
+                yystop = 1;
+                break;
+            }
+            assert(yyact < YY_MIN_REDUCE);
+        }
+        else
+#endif
         yyact = yy_find_shift_action((YYCODETYPE)yymajor, yyact);
         if (yyact >= YY_MIN_REDUCE) {
             unsigned int yyruleno = yyact - YY_MIN_REDUCE; /* Reduce by this rule */
@@ -908,32 +1239,14 @@ void Parse(
             /* Check that the stack is large enough to grow by a single entry
             ** if the RHS of the rule is empty.  This ensures that there is room
             ** enough on the stack to push the LHS value */
-            if (yyRuleInfoNRhs[yyruleno] == 0) {
-#ifdef YYTRACKMAXSTACKDEPTH
-                if ((int)(yypParser->yytos - yypParser->yystack) > yypParser->yyhwm) {
-                    yypParser->yyhwm++;
-                    assert(yypParser->yyhwm ==
-                        (int)(yypParser->yytos - yypParser->yystack));
-                }
-#endif
-#if YYSTACKDEPTH>0 
-                if (yypParser->yytos >= yypParser->yystackEnd) {
-                    yyStackOverflow(yypParser);
-                    break;
-                }
-#else
-                if (yypParser->yytos >= &yypParser->yystack[yypParser->yystksz - 1]) {
-                    if (yyGrowStack(yypParser)) {
-                        yyStackOverflow(yypParser);
-                        break;
-                    }
-                }
-#endif
+            if (yyRuleInfoNRhs[yyruleno] == 0 && yy_reduce_room(yypParser)) {
+                yystop = 1;
+                break;
             }
             yyact = yy_reduce(yypParser, yyruleno, yymajor, yyminor ParseCTX_PARAM);
         }
         else if (yyact <= YY_MAX_SHIFTREDUCE) {
-            yy_shift(yypParser, yyact, (YYCODETYPE)yymajor, yyminor);
+            yystop = yy_shift(yypParser, yyact, (YYCODETYPE)yymajor, yyminor);
 #ifndef YYNOERRORRECOVERY
             yypParser->yyerrcnt--;
 #endif
@@ -942,11 +1255,12 @@ void Parse(
         else if (yyact == YY_ACCEPT_ACTION) {
             yypParser->yytos--;
             yy_accept(yypParser);
-            return;
+            return 1;
         }
         else {
             assert(yyact == YY_ERROR_ACTION);
             yyminorunion.yy0 = yyminor;
+            yystop = 1;
 #ifdef YYERRORSYMBOL
             int yymx;
 #endif
@@ -1054,14 +1368,96 @@ void Parse(
         yyStackEntry* i;
         char cDiv = '[';
         fprintf(yyTraceFILE, "%sReturn. Stack=", yyTracePrompt);
-        for (i = &yypParser->yystack[1]; i <= yypParser->yytos; i++) {
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+        {
+            /* Skip the copies at the top of each segment below this one */
+            int iSeg;
+            for (iSeg = 0; iSeg < yypParser->yystkseg; iSeg++) {
+                yyStackEntry* pSeg = yypParser->yystkmem[iSeg];
+                yyStackEntry* pEnd = &pSeg[yypParser->yystksz[iSeg] - yypParser->yystkrhs];
+                for (i = &pSeg[iSeg == 0]; i < pEnd; i++) {
+                    fprintf(yyTraceFILE, "%c%s", cDiv, yyTokenName[i->major]);
+                    cDiv = ' ';
+                }
+            }
+        }
+        i = &yypParser->yystack[yypParser->yystkseg == 0];
+#else
+        i = &yypParser->yystack[1];
+#endif
+        for (; i <= yypParser->yytos; i++) {
             fprintf(yyTraceFILE, "%c%s", cDiv, yyTokenName[i->major]);
             cDiv = ' ';
         }
         fprintf(yyTraceFILE, "]\n");
     }
 #endif
-    return;
+    return yystop;
+}
+
+/* The main parser program.
+** The first argument is a pointer to a structure obtained from
+** "ParseAlloc" which describes the current state of the parser.
+** The second argument is the major token number.  The third is
+** the minor token.  The fourth optional argument is whatever the
+** user wants (and specified in the grammar) and is available for
+** use by the action routines.
+**
+** Inputs:
+** <ul>
+** <li> A pointer to the parser (an opaque structure.)
+** <li> The major token number.
+** <li> The minor token number.
+** <li> An option argument of a grammar-specified type.
+** </ul>
+**
+** Outputs:
+** None.
+*/
+void Parse(
+    void* yyp,                   /* The parser */
+    int yymajor,                 /* The major token code number */
+    ParseTOKENTYPE yyminor       /* The value for the token */
+    ParseARG_PDECL               /* Optional %extra_argument parameter */
+) {
+    yyParser* yypParser = (yyParser*)yyp;  /* The parser */
+    ParseCTX_FETCH
+    ParseARG_STORE
+
+    yy_parse_token(yypParser, yymajor, yyminor ParseCTX_PARAM);
+}
+
+/* Feed an array of tokens to the parser.
+** This is the same as calling Parse() once for each of the n tokens in
+** the parallel arrays yymajors[] and yyminors[], except that the parser,
+** the %extra_context and the %extra_argument are loaded once for the
+** whole array rather than once per token.
+**
+** Outputs:
+** The number of tokens consumed.  This is n unless the parser accepts
+** its input, meets a syntax error or overflows its stack part way
+** through, in which case it stops after, and counts, the token that did
+** so.  The caller may carry on with the rest of the array in another
+** call.
+*/
+size_t ParseBatch(
+    void* yyp,                   /* The parser */
+    const int* yymajors,         /* The major token code numbers */
+    ParseTOKENTYPE const* yyminors, /* The values for the tokens */
+    size_t n                     /* Number of tokens */
+    ParseARG_PDECL               /* Optional %extra_argument parameter */
+) {
+    size_t yyi;
+    yyParser* yypParser = (yyParser*)yyp;  /* The parser */
+    ParseCTX_FETCH
+    ParseARG_STORE
+
+    for (yyi = 0; yyi < n; yyi++) {
+        if (yy_parse_token(yypParser, yymajors[yyi], yyminors[yyi] ParseCTX_PARAM)) {
+            return yyi + 1;
+        }
+    }
+    return n;
 }
 
 /*
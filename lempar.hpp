@@ -0,0 +1,1194 @@
+/*
+** 2000-05-29
+**
+** The author disclaims copyright to this source code.  In place of
+** a legal notice, here is a blessing:
+**
+**    May you do good and not evil.
+**    May you find forgiveness for yourself and forgive others.
+**    May you share freely, never taking more than you give.
+**
+*************************************************************************
+** C++ driver template for the LEMON parser generator.
+**
+** This is the template used with the -X option.  It has the same "%%"
+** sections as lempar.c, plus one that destroys or moves the semantic
+** value of any symbol, and produces a header that defines the parser as
+** the class template ParseParser<Context>.  Any "P-a-r-s-e" identifier
+** prefix (without the interstitial "-" characters) in this template is
+** changed into the value of the %name directive from the grammar.
+**
+** The semantic values on the stack are constructed, moved and destroyed
+** as C++ objects, so %type and %token_type may name any type that is
+** default-constructible and movable.  The %token_type must be copyable
+** too if the grammar uses the error symbol.  Reduce actions are member
+** functions of the class and the tables are static constexpr members of it.
+**
+** The following is the concatenation of all %include directives from the
+** input grammar file:
+*/
+/************ Begin %include sections from the grammar ************************/
+%%
+/**************** End of %include directives **********************************/
+#pragma once
+#include <stdio.h>
+#include <stddef.h>
+#include <assert.h>
+#include <new>
+#include <utility>
+
+/* These constants specify the various numeric values for terminal symbols.
+***************** Begin token definitions *************************************/
+%%
+/**************** End token definitions ***************************************/
+
+/* The next sections is a series of control #defines.  They have the same
+** meaning as in lempar.c, except for these:
+**    YYMINORTYPE        is a union with a member for every type of semantic
+**                       value, which the parser constructs and destroys
+**                       itself.
+**    ParseARG_SDECL     A member declaration for the %extra_argument
+**    ParseARG_PDECL     A parameter declaration for the %extra_argument
+**    ParseARG_STORE     Code to store the %extra_argument in the parser
+**    ParseCTX_TYPE      The declared type of the %extra_context, which is
+**                       the default for the Context template parameter
+**    ParseCTX_SDECL     A member declaration for the %extra_context
+**    ParseCTX_CDECL     The constructor parameter for the %extra_context
+**    ParseCTX_STORE     Code to store the %extra_context in the parser
+**
+** All but ParseTOKENTYPE and ParseMINORTYPE are undefined again at the
+** end of this file.
+*/
+/************* Begin control #defines *****************************************/
+%%
+/************* End control #defines *******************************************/
+#define YY_NLOOKAHEAD ((int)(sizeof(yy_lookahead)/sizeof(yy_lookahead[0])))
+
+/* Define the yytestcase() macro to be a no-op if is not already defined
+** otherwise.
+*/
+#ifndef yytestcase
+# define yytestcase(X)
+#endif
+
+/* Force a function inline where the compiler allows it */
+#if defined(__GNUC__)
+# define YYINLINE __inline__ __attribute__((always_inline))
+#elif defined(_MSC_VER)
+# define YYINLINE __forceinline
+#else
+# define YYINLINE inline
+#endif
+
+/* A stack without a fixed YYSTACKDEPTH starts with YYSTACKINIT entries.
+** It grows by moving every value to a larger array or, if YYSTACKSEGMENTS
+** is defined, as a chain of segments that leaves the values already on it
+** in place, as described in lempar.c.
+*/
+#if YYSTACKDEPTH<=0
+# ifndef YYSTACKINIT
+#  define YYSTACKINIT 100
+# endif
+# ifdef YYSTACKSEGMENTS
+#  define YYNSTACKSEG 24
+# endif
+#endif
+
+/* The parser.  Context is the type of the %extra_context, if there is
+** one.  It is given to the constructor, and reduce actions see it as a
+** member under the name the grammar declares for it.
+**
+** Use it like this:
+**
+**     ParseParser<> parser(context);
+**     while (more tokens) parser.parse(major, std::move(minor));
+**     parser.parse(0, ParseTOKENTYPE());
+*/
+template <class Context = ParseCTX_TYPE>
+class ParseParser {
+public:
+    /* Construct a parser ready for the first token */
+    explicit ParseParser(ParseCTX_CDECL) {
+        ParseCTX_STORE
+#ifdef YYTRACKMAXSTACKDEPTH
+        yyhwm = 0;
+#endif
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+        yystkbase = 0;
+        yystkseg = 0;
+        yystknseg = 0;
+        if (yyAllocSegment(0, YYSTACKINIT)) {
+            yystkmem[0] = &yystk0;
+            yystksz[0] = 1;
+        }
+        yystack = yystackLow = yystkmem[0];
+        yystackEnd = &yystack[yystksz[0] - 1];
+#elif YYSTACKDEPTH<=0
+        yystack = new (std::nothrow) yyStackEntry[YYSTACKINIT];
+        yystksz = YYSTACKINIT;
+        if (yystack == 0) {
+            yystack = &yystk0;
+            yystksz = 1;
+        }
+        yystackEnd = &yystack[yystksz - 1];
+#endif
+#ifndef YYNOERRORRECOVERY
+        yyerrcnt = -1;
+#endif
+        yytos = yystack;
+        yystack[0].stateno = 0;
+        yystack[0].major = 0;
+#if YYSTACKDEPTH>0
+        yystackEnd = &yystack[YYSTACKDEPTH - 1];
+#endif
+    }
+
+    /* Destroy the parser.  Destructors are called for all stack elements
+    ** before shutting the parser down. */
+    ~ParseParser() {
+        while (yytos > yystack) yy_pop_parser_stack();
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+        for (int i = 0; i < yystknseg; i++) delete[] yystkmem[i];
+#elif YYSTACKDEPTH<=0
+        if (yystack != &yystk0) delete[] yystack;
+#endif
+    }
+
+    /* The stack points into the parser itself */
+    ParseParser(const ParseParser&) = delete;
+    ParseParser& operator=(const ParseParser&) = delete;
+
+    /* Feed one token to the parser.  Its value is moved onto the stack,
+    ** or destroyed if the token is discarded. */
+    void parse(
+        int yymajor,                 /* The major token code number */
+        ParseTOKENTYPE yyminor       /* The value for the token */
+        ParseARG_PDECL               /* Optional %extra_argument parameter */
+    ) {
+        ParseARG_STORE
+        yy_parse_token(yymajor, yyminor);
+    }
+
+    /* Feed the n tokens in yymajors[] and yyminors[] to the parser, as
+    ** parse() would one at a time.  The values are moved from yyminors[].
+    ** Return the number of tokens consumed, which is less than n if the
+    ** parser accepted its input, met a syntax error or overflowed its
+    ** stack part way through.
+    */
+    size_t parseBatch(
+        const int* yymajors,         /* The major token code numbers */
+        ParseTOKENTYPE* yyminors,    /* The values for the tokens */
+        size_t n                     /* Number of tokens */
+        ParseARG_PDECL               /* Optional %extra_argument parameter */
+    ) {
+        size_t yyi;
+        ParseARG_STORE
+
+        for (yyi = 0; yyi < n; yyi++) {
+            if (yy_parse_token(yymajors[yyi], yyminors[yyi])) return yyi + 1;
+        }
+        return n;
+    }
+
+    /* Return the fallback token corresponding to canonical token iToken,
+    ** or 0 if iToken has no fallback. */
+    static int fallback(int iToken) {
+#ifdef YYFALLBACK
+        assert(iToken < (int)(sizeof(yyFallback) / sizeof(yyFallback[0])));
+        return yyFallback[iToken];
+#else
+        (void)iToken;
+        return 0;
+#endif
+    }
+
+#ifndef NDEBUG
+    /* Turn tracing on by giving a stream to which to write the trace and
+    ** a prompt to preface each trace message.  Tracing is turned off by
+    ** making either argument NULL.  It applies to every parser of this
+    ** grammar. */
+    static void trace(FILE* TraceFILE, const char* zTracePrompt) {
+        yyTraceFILE = TraceFILE;
+        yyTracePrompt = zTracePrompt;
+        if (yyTraceFILE == 0) yyTracePrompt = 0;
+        else if (yyTracePrompt == 0) yyTraceFILE = 0;
+    }
+#endif
+
+#ifdef YYTRACKMAXSTACKDEPTH
+    /* Return the peak depth of the stack */
+    int stackPeak() const {
+        return yyhwm;
+    }
+#endif
+
+    /* Make sure that the stack can reach the given depth without allocating
+    ** any more memory.  Return non-zero if it cannot, because memory ran
+    ** out or the depth is beyond a fixed YYSTACKDEPTH.  The stackPeak() of
+    ** earlier parsers is a good depth to give it.
+    */
+    int reserve(int depth) {
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+        int iSeg = yystkseg;
+        int base = yystkbase;  /* Depth of segment iSeg's first entry */
+
+        if (yytos == yystkmem[0]) {
+            /* The stack is empty, so the first segment can be replaced by
+            ** one large enough for all of it */
+            yyStackEntry* pOld = yystkmem[0];
+            if (yystksz[0] > depth) return 0;
+            if (yyAllocSegment(0, depth + 1)) return 1;
+            yystkmem[0][0].stateno = pOld[0].stateno;
+            yystkmem[0][0].major = pOld[0].major;
+            if (pOld != &yystk0) delete[] pOld;
+            yystack = yystackLow = yystkmem[0];
+            yystackEnd = &yystack[yystksz[0] - 1];
+            yytos = yystack;
+            return 0;
+        }
+        while (base + yystksz[iSeg] - 1 < depth) {
+            base += yystksz[iSeg] - yyMaxRhs();
+            iSeg++;
+            if (iSeg == yystknseg && yyAllocSegment(iSeg, depth - base + 1)) return 1;
+        }
+        return 0;
+#elif YYSTACKDEPTH<=0
+        if (yystksz > depth) return 0;
+        return yyResizeStack(depth + 1);
+#else
+        return depth >= YYSTACKDEPTH;
+#endif
+    }
+
+#if defined(YYCOVERAGE)
+    /* Write into out a description of every state/lookahead combination
+    ** that has not been used by the parser and is not a syntax error.
+    ** Return the number of missed state/lookahead combinations.
+    */
+    static int coverage(FILE* out) {
+        int stateno, iLookAhead;
+#ifndef YYDENSE
+        int i;
+#endif
+        int nMissed = 0;
+#ifdef YYDENSE
+        for (stateno = 0; stateno <= YY_SHIFT_COUNT; stateno++) {
+            for (iLookAhead = 0; iLookAhead < YYNTOKEN; iLookAhead++) {
+                if (yy_dense_action[stateno][iLookAhead] == YY_ERROR_ACTION) continue;
+#else
+        for (stateno = 0; stateno < YYNSTATE; stateno++) {
+            i = yy_shift_ofst[stateno];
+            for (iLookAhead = 0; iLookAhead < YYNTOKEN; iLookAhead++) {
+                if (yy_lookahead[i + iLookAhead] != iLookAhead) continue;
+#endif
+                if (yycoverage[stateno][iLookAhead] == 0) nMissed++;
+                if (out) {
+                    fprintf(out, "State %d lookahead %s %s\n", stateno,
+                        yyTokenName[iLookAhead],
+                        yycoverage[stateno][iLookAhead] ? "ok" : "missed");
+                }
+            }
+        }
+        return nMissed;
+    }
+#endif
+
+private:
+    /* The tables, in the same form as lempar.c describes.
+    *********** Begin parsing tables **********************************************/
+%%
+/********** End of lemon-generated parsing tables *****************************/
+
+#ifdef YYFALLBACK
+    /* Maps tokens (terminal symbols) into fallback tokens */
+    static constexpr YYCODETYPE yyFallback[] = {
+%%
+    };
+#endif /* YYFALLBACK */
+
+    /* A single element of the parser's stack.  The member of minor in use
+    ** is the one for the symbol major, and it is constructed for every
+    ** element above yystack[0]. */
+    struct yyStackEntry {
+        YYACTIONTYPE stateno;  /* The state-number, or reduce action in SHIFTREDUCE */
+        YYCODETYPE major;      /* The major token value.  This is the code
+                               ** number for the token at this stack level */
+        YYMINORTYPE minor;     /* The user-supplied minor token value.  This
+                               ** is the value of the token  */
+    };
+
+    yyStackEntry* yytos;          /* Pointer to top element of the stack */
+#ifdef YYTRACKMAXSTACKDEPTH
+    int yyhwm;                    /* High-water mark of the stack */
+#endif
+#ifndef YYNOERRORRECOVERY
+    int yyerrcnt;                 /* Shifts left before out of the error */
+#endif
+    ParseARG_SDECL                /* A place to hold %extra_argument */
+    ParseCTX_SDECL                /* A place to hold %extra_context */
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+    yyStackEntry* yystack;        /* The current segment of the stack */
+    yyStackEntry* yystackEnd;     /* Last entry in the current segment */
+    yyStackEntry* yystackLow;     /* Go back a segment if yytos drops below */
+    int yystkbase;                /* Depth of yystack[0] in the whole stack */
+    int yystkseg;                 /* Index of the current segment */
+    int yystknseg;                /* Number of segments allocated */
+    yyStackEntry* yystkmem[YYNSTACKSEG];  /* The segments, bottom one first */
+    int yystksz[YYNSTACKSEG];     /* Number of entries in each segment */
+    yyStackEntry yystk0;          /* The stack if no segment can be allocated */
+#elif YYSTACKDEPTH<=0
+    int yystksz;                  /* Number of entries in the stack */
+    yyStackEntry* yystack;        /* The parser's stack */
+    yyStackEntry* yystackEnd;     /* Last entry in the stack */
+    yyStackEntry yystk0;          /* The stack if it cannot be allocated */
+#else
+    yyStackEntry yystack[YYSTACKDEPTH];  /* The parser's stack */
+    yyStackEntry* yystackEnd;            /* Last entry in the stack */
+#endif
+
+#ifndef NDEBUG
+    static inline FILE* yyTraceFILE = 0;
+    static inline const char* yyTracePrompt = 0;
+#endif /* NDEBUG */
+
+#if defined(YYCOVERAGE) || !defined(NDEBUG)
+    /* For tracing shifts, the names of all terminals and nonterminals
+    ** are required.  The following table supplies these names */
+    static constexpr const char* yyTokenName[] = {
+%%
+    };
+#endif /* defined(YYCOVERAGE) || !defined(NDEBUG) */
+
+#ifndef NDEBUG
+    /* For tracing reduce actions, the names of all rules are required.
+    */
+    static constexpr const char* yyRuleName[] = {
+%%
+    };
+#endif /* NDEBUG */
+
+    /* The lifetime of the members of YYMINORTYPE, which the union leaves
+    ** to its user */
+    template <class T> static void yy_construct(T& yyv) {
+        ::new ((void*)&yyv) T;
+    }
+    template <class T> static void yy_destroy(T& yyv) {
+        yyv.~T();
+    }
+    template <class T> static void yy_relocate(T& yyfrom, T& yyto) {
+        ::new ((void*)&yyto) T(std::move(yyfrom));
+        yyfrom.~T();
+    }
+
+    /* The depth of the stack, not counting the entry at the bottom */
+    int yyStackDepth() const {
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+        return yystkbase + (int)(yytos - yystack);
+#else
+        return (int)(yytos - yystack);
+#endif
+    }
+
+#if YYSTACKDEPTH<=0
+    /* Move the stack entry *yyp, and its value, to *yyq */
+    static void yy_move_entry(yyStackEntry* yyp, yyStackEntry* yyq) {
+        yyq->stateno = yyp->stateno;
+        yyq->major = yyp->major;
+        yy_release(yyp->major, &yyp->minor, &yyq->minor);
+    }
+
+#endif
+
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+    /*
+    ** Allocate segment iSeg of the stack, with room for at least n entries
+    ** and for twice as many as the segment below it.  Return non-zero if
+    ** that is not possible.
+    */
+    int yyAllocSegment(int iSeg, int n) {
+        yyStackEntry* pNew;
+
+        if (iSeg > 0 && n < yystksz[iSeg - 1] * 2) n = yystksz[iSeg - 1] * 2;
+        if (n < yyMaxRhs() * 2 + 2) n = yyMaxRhs() * 2 + 2;
+        /* Keep every depth well within the range of an int */
+        if (iSeg >= YYNSTACKSEG || n > 0x10000000) return 1;
+        pNew = new (std::nothrow) yyStackEntry[n];
+        if (pNew == 0) return 1;
+#ifndef NDEBUG
+        if (yyTraceFILE) {
+            fprintf(yyTraceFILE, "%sStack segment %d has %d entries.\n",
+                yyTracePrompt, iSeg, n);
+        }
+#endif
+        yystkmem[iSeg] = pNew;
+        yystksz[iSeg] = n;
+        if (yystknseg <= iSeg) yystknseg = iSeg + 1;
+        return 0;
+    }
+
+    /*
+    ** Move the parser to the next segment of the stack, allocating it if
+    ** need be.  The current segment must be full, with yytos at its last
+    ** entry or just past it.  Return non-zero if that is not possible.
+    */
+    int yyGrowStack() {
+        constexpr int yyrhs = yyMaxRhs();
+        yyStackEntry* pOld = yystack;
+        int nPast = (int)(yytos - yystackEnd);  /* 1 if yytos is past the end */
+        int iSeg = yystkseg;
+        int i;
+
+        if (yystknseg == 0) {
+            /* The constructor could not allocate the first segment */
+            if (yyAllocSegment(0, YYSTACKINIT)) return 1;
+            yy_move_entry(&yystk0, &yystkmem[0][0]);
+            yystack = yystackLow = yystkmem[0];
+            yystackEnd = &yystack[yystksz[0] - 1];
+            yytos = &yystack[nPast];
+            return 0;
+        }
+        if (iSeg + 1 == yystknseg && yyAllocSegment(iSeg + 1, 0)) return 1;
+        yystkbase += yystksz[iSeg] - yyrhs;
+        yystkseg = ++iSeg;
+        yystack = yystkmem[iSeg];
+        yystackEnd = &yystack[yystksz[iSeg] - 1];
+        yystackLow = &yystack[yyrhs];
+        for (i = 0; i < yyrhs; i++) {
+            yy_move_entry(&pOld[yystksz[iSeg - 1] - yyrhs + i], &yystack[i]);
+        }
+        yytos = &yystack[yyrhs - 1 + nPast];
+        return 0;
+    }
+
+    /*
+    ** Go back to the segment below once yytos has dropped under yystackLow,
+    ** and return the new yytos.  The entries that are left in the current
+    ** segment move back to the top of the one below.
+    */
+    yyStackEntry* yyShrinkStack() {
+        constexpr int yyrhs = yyMaxRhs();
+        yyStackEntry* pOld = yystack;
+        int n = (int)(yytos - pOld) + 1;  /* Entries left in this segment */
+        int iSeg = yystkseg;
+        int i;
+
+        if (iSeg == 0) return yytos;  /* Popped the bottom of the stack */
+        yystkseg = --iSeg;
+        yystack = yystkmem[iSeg];
+        yystackEnd = &yystack[yystksz[iSeg] - 1];
+        yystackLow = iSeg ? &yystack[yyrhs] : yystack;
+        yystkbase -= yystksz[iSeg] - yyrhs;
+        yytos = yystackEnd - yyrhs;
+        for (i = 0; i < n; i++) yy_move_entry(&pOld[i], ++yytos);
+        return yytos;
+    }
+#elif YYSTACKDEPTH<=0
+    /*
+    ** Move the stack to a new array of n entries.  yytos may be just past
+    ** the end of the old one.  Return non-zero, leaving the stack as it
+    ** was, if that is not possible.
+    */
+    int yyResizeStack(int n) {
+        int idx = (int)(yytos - yystack);
+        int nLive = idx < yystksz ? idx + 1 : yystksz;  /* Entries to move */
+        yyStackEntry* pNew;
+
+        /* Keep every depth well within the range of an int */
+        if (n > 0x10000000) return 1;
+        pNew = new (std::nothrow) yyStackEntry[n];
+        if (pNew == 0) return 1;
+        for (int i = 0; i < nLive; i++) yy_move_entry(&yystack[i], &pNew[i]);
+        if (yystack != &yystk0) delete[] yystack;
+#ifndef NDEBUG
+        if (yyTraceFILE) {
+            fprintf(yyTraceFILE, "%sStack grows from %d to %d entries.\n",
+                yyTracePrompt, yystksz, n);
+        }
+#endif
+        yystack = pNew;
+        yystackEnd = &pNew[n - 1];
+        yytos = &pNew[idx];
+        yystksz = n;
+        return 0;
+    }
+
+    /* Double the size of the stack.  Return non-zero on failure. */
+    int yyGrowStack() {
+        return yyResizeStack(yystksz * 2 + 100);
+    }
+#endif
+
+    /* The following function runs the %destructor or %token_destructor
+    ** code for the semantic value of symbol yymajor.  The C++ object is
+    ** destroyed separately, by yy_release().
+    */
+    void yy_destructor(
+        YYCODETYPE yymajor,     /* Type code for object to destroy */
+        YYMINORTYPE* yypminor   /* The object to be destroyed */
+    ) {
+        (void)yypminor;
+        switch (yymajor) {
+            /********* Begin destructor definitions ***************************************/
+%%
+            /********* End destructor definitions *****************************************/
+        default:  break;   /* If no destructor action specified: do nothing */
+        }
+    }
+
+    /* Destroy the semantic value *yyp of symbol yymajor, first moving it
+    ** into *yyq if that is not NULL.
+    */
+    static void yy_release(
+        YYCODETYPE yymajor,     /* Type code for the value */
+        YYMINORTYPE* yyp,       /* The value */
+        YYMINORTYPE* yyq        /* Where to move it to, or NULL */
+    ) {
+        switch (yymajor) {
+            /********* Begin value types **************************************************/
+%%
+            /********* End value types ****************************************************/
+        default:  break;   /* Symbols that never carry a value */
+        }
+    }
+
+    /* Run the %token_destructor on a token that is thrown away */
+    void yy_discard(YYCODETYPE yymajor, ParseTOKENTYPE& yyminor) {
+        YYMINORTYPE yyminorunion;
+        ::new ((void*)&yyminorunion.yy0) ParseTOKENTYPE(std::move(yyminor));
+        yy_destructor(yymajor, &yyminorunion);
+        yy_destroy(yyminorunion.yy0);
+    }
+
+    /*
+    ** Pop the parser's stack once, destroying the value popped.
+    */
+    void yy_pop_parser_stack() {
+        yyStackEntry* yymsp;
+        assert(yytos != 0);
+        assert(yytos > yystack);
+        yymsp = yytos--;
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+        if (yytos < yystackLow) yyShrinkStack();
+#endif
+#ifndef NDEBUG
+        if (yyTraceFILE) {
+            fprintf(yyTraceFILE, "%sPopping %s\n",
+                yyTracePrompt,
+                yyTokenName[yymsp->major]);
+        }
+#endif
+        yy_destructor(yymsp->major, &yymsp->minor);
+        yy_release(yymsp->major, &yymsp->minor, 0);
+    }
+
+#if defined(YYCOVERAGE)
+    /* The element yycoverage[X][Y] is set when the parser is in state X
+    ** and has a lookahead token Y. */
+    static inline unsigned char yycoverage[YYNSTATE][YYNTOKEN];
+#endif
+
+    /*
+    ** Find the appropriate action for a parser given the terminal
+    ** look-ahead token iLookAhead.
+    */
+    static YYACTIONTYPE yy_find_shift_action(
+        YYCODETYPE iLookAhead,    /* The look-ahead token */
+        YYACTIONTYPE stateno      /* Current state number */
+    ) {
+#ifndef YYDENSE
+        int i;
+#endif
+
+        if (stateno > YY_MAX_SHIFT) return stateno;
+        assert(stateno <= YY_SHIFT_COUNT);
+#if defined(YYCOVERAGE)
+        yycoverage[stateno][iLookAhead] = 1;
+#endif
+#ifdef YYDENSE
+        assert(iLookAhead < YYNTOKEN);
+        return yy_dense_action[stateno][iLookAhead];
+#else
+        do {
+            i = yy_shift_ofst[stateno];
+            assert(i >= 0);
+            assert(i <= YY_ACTTAB_COUNT);
+            assert(i + YYNTOKEN <= (int)YY_NLOOKAHEAD);
+            assert(iLookAhead != YYNOCODE);
+            assert(iLookAhead < YYNTOKEN);
+            i += iLookAhead;
+            assert(i < (int)YY_NLOOKAHEAD);
+            if (yy_lookahead[i] != iLookAhead) {
+#ifdef YYFALLBACK
+                YYCODETYPE iFallback;            /* Fallback token */
+                assert(iLookAhead < sizeof(yyFallback) / sizeof(yyFallback[0]));
+                iFallback = yyFallback[iLookAhead];
+                if (iFallback != 0) {
+#ifndef NDEBUG
+                    if (yyTraceFILE) {
+                        fprintf(yyTraceFILE, "%sFALLBACK %s => %s\n",
+                            yyTracePrompt, yyTokenName[iLookAhead], yyTokenName[iFallback]);
+                    }
+#endif
+                    assert(yyFallback[iFallback] == 0); /* Fallback loop must terminate */
+                    iLookAhead = iFallback;
+                    continue;
+                }
+#endif
+#ifdef YYWILDCARD
+                {
+                    int j = i - iLookAhead + YYWILDCARD;
+                    assert(j < (int)(sizeof(yy_lookahead) / sizeof(yy_lookahead[0])));
+                    if (yy_lookahead[j] == YYWILDCARD && iLookAhead > 0) {
+#ifndef NDEBUG
+                        if (yyTraceFILE) {
+                            fprintf(yyTraceFILE, "%sWILDCARD %s => %s\n",
+                                yyTracePrompt, yyTokenName[iLookAhead],
+                                yyTokenName[YYWILDCARD]);
+                        }
+#endif /* NDEBUG */
+                        return yy_action[j];
+                    }
+                }
+#endif /* YYWILDCARD */
+                return yy_default[stateno];
+            }
+            else {
+                assert(i >= 0 && i < (int)(sizeof(yy_action) / sizeof(yy_action[0])));
+                return yy_action[i];
+            }
+        } while (1);
+#endif /* YYDENSE */
+    }
+
+    /*
+    ** Find the appropriate action for a parser given the non-terminal
+    ** look-ahead token iLookAhead.
+    */
+    static YYACTIONTYPE yy_find_reduce_action(
+        YYACTIONTYPE stateno,     /* Current state number */
+        YYCODETYPE iLookAhead     /* The look-ahead token */
+    ) {
+#ifndef YYDENSE
+        int i;
+#endif
+#ifdef YYERRORSYMBOL
+        if (stateno > YY_REDUCE_COUNT) {
+            return yy_default[stateno];
+        }
+#else
+        assert(stateno <= YY_REDUCE_COUNT);
+#endif
+#ifdef YYDENSE
+        assert(iLookAhead >= YYNTOKEN && iLookAhead < YYNOCODE);
+        return yy_dense_goto[stateno][iLookAhead - YYNTOKEN];
+#else
+        i = yy_reduce_ofst[stateno];
+        assert(iLookAhead != YYNOCODE);
+        i += iLookAhead;
+#ifdef YYERRORSYMBOL
+        if (i < 0 || i >= YY_ACTTAB_COUNT || yy_lookahead[i] != iLookAhead) {
+            return yy_default[stateno];
+        }
+#else
+        assert(i >= 0 && i < YY_ACTTAB_COUNT);
+        assert(yy_lookahead[i] == iLookAhead);
+#endif
+        return yy_action[i];
+#endif /* YYDENSE */
+    }
+
+    /*
+    ** The following routine is called if the stack overflows.
+    */
+    void yyStackOverflow() {
+#ifndef NDEBUG
+        if (yyTraceFILE) {
+            fprintf(yyTraceFILE, "%sStack Overflow!\n", yyTracePrompt);
+        }
+#endif
+        while (yytos > yystack) yy_pop_parser_stack();
+        /* Here code is inserted which will execute if the parser
+        ** stack every overflows */
+        /******** Begin %stack_overflow code ******************************************/
+%%
+        /******** End %stack_overflow code ********************************************/
+    }
+
+    /*
+    ** Print tracing information for a SHIFT action
+    */
+    void yyTraceShift(int yyNewState, const char* zTag) {
+#ifndef NDEBUG
+        if (yyTraceFILE) {
+            if (yyNewState < YYNSTATE) {
+                fprintf(yyTraceFILE, "%s%s '%s', go to state %d\n",
+                    yyTracePrompt, zTag, yyTokenName[yytos->major],
+                    yyNewState);
+            }
+            else {
+                fprintf(yyTraceFILE, "%s%s '%s', pending reduce %d\n",
+                    yyTracePrompt, zTag, yyTokenName[yytos->major],
+                    yyNewState - YY_MIN_REDUCE);
+            }
+        }
+#else
+        (void)yyNewState;
+        (void)zTag;
+#endif
+    }
+
+    /*
+    ** Perform a shift action, moving the token's value onto the stack.
+    ** Return non-zero, after reporting the overflow, if there is no room
+    ** on the stack.
+    */
+    int yy_shift(
+        YYACTIONTYPE yyNewState,      /* The new state to shift in */
+        YYCODETYPE yyMajor,           /* The major token to shift in */
+        ParseTOKENTYPE&& yyMinor      /* The minor token to shift in */
+    ) {
+        yyStackEntry* yymsp;
+        yytos++;
+#ifdef YYTRACKMAXSTACKDEPTH
+        if (yyStackDepth() > yyhwm) {
+            yyhwm++;
+            assert(yyhwm == yyStackDepth());
+        }
+#endif
+#if YYSTACKDEPTH>0
+        if (yytos > yystackEnd) {
+            yytos--;
+            yyStackOverflow();
+            return 1;
+        }
+#else
+        if (yytos > yystackEnd) {
+            if (yyGrowStack()) {
+                yytos--;
+                yyStackOverflow();
+                return 1;
+            }
+        }
+#endif
+        if (yyNewState > YY_MAX_SHIFT) {
+            yyNewState += YY_MIN_REDUCE - YY_MIN_SHIFTREDUCE;
+        }
+        yymsp = yytos;
+        yymsp->stateno = yyNewState;
+        yymsp->major = yyMajor;
+        ::new ((void*)&yymsp->minor.yy0) ParseTOKENTYPE(std::move(yyMinor));
+        yyTraceShift(yyNewState, "Shift");
+        return 0;
+    }
+
+    /* For rule J, yyRuleInfoLhs[J] contains the symbol on the left-hand side
+    ** of that rule */
+    static constexpr YYCODETYPE yyRuleInfoLhs[] = {
+%%
+    };
+
+    /* For rule J, yyRuleInfoNRhs[J] contains the negative of the number
+    ** of symbols on the right-hand side of that rule. */
+    static constexpr signed char yyRuleInfoNRhs[] = {
+%%
+    };
+
+    /* Return the most symbols on the right-hand side of any rule, or 1 */
+    static constexpr int yyMaxRhs() {
+        int n = 1;
+        for (signed char yyn : yyRuleInfoNRhs) {
+            if (-yyn > n) n = -yyn;
+        }
+        return n;
+    }
+
+    /*
+    ** Run the code of rule yyruleno, the first half of a reduce.  The values
+    ** of the right-hand side are on the stack, and are replaced by the value
+    ** of the left-hand side.
+    **
+    ** The yyLookahead and yyLookaheadToken parameters provide reduce actions
+    ** access to the lookahead token (if any).  The yyLookahead will be YYNOCODE
+    ** if the lookahead token has already been consumed.
+    */
+    void yy_reduce_action(
+        unsigned int yyruleno,       /* Number of the rule by which to reduce */
+        int yyLookahead,             /* Lookahead token, or YYNOCODE if none */
+        ParseTOKENTYPE const& yyLookaheadToken  /* Value of the lookahead token */
+    ) {
+        yyStackEntry* yymsp;            /* The top of the parser's stack */
+        YYMINORTYPE yylhsminor;         /* The value of the left-hand side */
+        (void)yyLookahead;
+        (void)yyLookaheadToken;
+        yymsp = yytos;
+
+        switch (yyruleno) {
+            /* Beginning here are the reduction cases.  A typical example
+            ** follows:
+            **   case 0:
+            **  #line <lineno> <grammarfile>
+            **     { ... }           // User supplied code
+            **  #line <lineno> <thisfile>
+            **     break;
+            */
+            /********** Begin reduce actions **********************************************/
+%%
+            /********** End reduce actions ************************************************/
+        };
+    }
+
+    /*
+    ** Perform a reduce action and the shift that must immediately
+    ** follow the reduce.
+    */
+    YYACTIONTYPE yy_reduce(
+        unsigned int yyruleno,       /* Number of the rule by which to reduce */
+        int yyLookahead,             /* Lookahead token, or YYNOCODE if none */
+        ParseTOKENTYPE const& yyLookaheadToken  /* Value of the lookahead token */
+    ) {
+        int yygoto;                     /* The next state */
+        YYACTIONTYPE yyact;             /* The next action */
+        yyStackEntry* yymsp;            /* The top of the parser's stack */
+        int yysize;                     /* Amount to pop the stack */
+
+        yy_reduce_action(yyruleno, yyLookahead, yyLookaheadToken);
+        yymsp = yytos;
+        assert(yyruleno < sizeof(yyRuleInfoLhs) / sizeof(yyRuleInfoLhs[0]));
+        yygoto = yyRuleInfoLhs[yyruleno];
+        yysize = yyRuleInfoNRhs[yyruleno];
+        yyact = yy_find_reduce_action(yymsp[yysize].stateno, (YYCODETYPE)yygoto);
+
+        /* There are no SHIFTREDUCE actions on nonterminals because the table
+        ** generator has simplified them to pure REDUCE actions. */
+        assert(!(yyact > YY_MAX_SHIFT && yyact <= YY_MAX_SHIFTREDUCE));
+
+        /* It is not possible for a REDUCE to be followed by an error */
+        assert(yyact != YY_ERROR_ACTION);
+
+        yymsp += yysize + 1;
+        yytos = yymsp;
+        yymsp->stateno = (YYACTIONTYPE)yyact;
+        yymsp->major = (YYCODETYPE)yygoto;
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+        /* The value is moved by its type, so major must be set first */
+        if (yymsp < yystackLow) yyShrinkStack();
+#endif
+        yyTraceShift(yyact, "... then shift");
+        return yyact;
+    }
+
+#ifndef YYNOERRORRECOVERY
+    /*
+    ** The following code executes when the parse fails
+    */
+    void yy_parse_failed() {
+#ifndef NDEBUG
+        if (yyTraceFILE) {
+            fprintf(yyTraceFILE, "%sFail!\n", yyTracePrompt);
+        }
+#endif
+        while (yytos > yystack) yy_pop_parser_stack();
+        /* Here code is inserted which will be executed whenever the
+        ** parser fails */
+        /************ Begin %parse_failure code ***************************************/
+%%
+        /************ End %parse_failure code *****************************************/
+    }
+#endif /* YYNOERRORRECOVERY */
+
+    /*
+    ** The following code executes when a syntax error first occurs.
+    */
+    void yy_syntax_error(
+        int yymajor,                   /* The major type of the error token */
+        ParseTOKENTYPE const& yyminor  /* The minor type of the error token */
+    ) {
+        (void)yymajor;
+        (void)yyminor;
+#define TOKEN yyminor
+        /************ Begin %syntax_error code ****************************************/
+%%
+        /************ End %syntax_error code ******************************************/
+    }
+
+    /*
+    ** The following is executed when the parser accepts
+    */
+    void yy_accept() {
+#ifndef NDEBUG
+        if (yyTraceFILE) {
+            fprintf(yyTraceFILE, "%sAccept!\n", yyTracePrompt);
+        }
+#endif
+#ifndef YYNOERRORRECOVERY
+        yyerrcnt = -1;
+#endif
+        assert(yytos == yystack);
+        /* Here code is inserted which will be executed whenever the
+        ** parser accepts */
+        /*********** Begin %parse_accept code *****************************************/
+%%
+        /*********** End %parse_accept code *******************************************/
+    }
+
+    /*
+    ** Make sure there is room on the stack for the left-hand side of a rule
+    ** with an empty right-hand side.  Return non-zero, after reporting the
+    ** overflow, if there is not.
+    */
+    int yy_reduce_room() {
+#ifdef YYTRACKMAXSTACKDEPTH
+        if (yyStackDepth() > yyhwm) {
+            yyhwm++;
+            assert(yyhwm == yyStackDepth());
+        }
+#endif
+#if YYSTACKDEPTH>0
+        if (yytos >= yystackEnd) {
+            yyStackOverflow();
+            return 1;
+        }
+#else
+        if (yytos >= yystackEnd) {
+            if (yyGrowStack()) {
+                yyStackOverflow();
+                return 1;
+            }
+        }
+#endif
+        return 0;
+    }
+
+    /* Process a single token for parse() and parseBatch().  Return true if
+    ** the token made the parser accept its input, hit a syntax error or
+    ** overflow the stack.
+    */
+    YYINLINE int yy_parse_token(
+        int yymajor,                 /* The major token code number */
+        ParseTOKENTYPE& yyminor      /* The value for the token */
+    ) {
+        YYACTIONTYPE yyact;   /* The parser action. */
+        int yystop = 0;       /* True once the token has hit an error or overflow */
+#if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
+        int yyendofinput;     /* True if we are at the end of input */
+#endif
+#ifdef YYERRORSYMBOL
+        int yyerrorhit = 0;   /* True if yymajor has invoked an error */
+#endif
+
+        assert(yytos != 0);
+#if !defined(YYERRORSYMBOL) && !defined(YYNOERRORRECOVERY)
+        yyendofinput = (yymajor == 0);
+#endif
+
+        yyact = yytos->stateno;
+#ifndef NDEBUG
+        if (yyTraceFILE) {
+            if (yyact < YY_MIN_REDUCE) {
+                fprintf(yyTraceFILE, "%sInput '%s' in state %d\n",
+                    yyTracePrompt, yyTokenName[yymajor], yyact);
+            }
+            else {
+                fprintf(yyTraceFILE, "%sInput '%s' with pending reduce %d\n",
+                    yyTracePrompt, yyTokenName[yymajor], yyact - YY_MIN_REDUCE);
+            }
+        }
+#endif
+
+        while (1) { /* Exit by "break" */
+            assert(yytos >= yystack);
+            assert(yyact == yytos->stateno);
+            yyact = yy_find_shift_action((YYCODETYPE)yymajor, yyact);
+            if (yyact >= YY_MIN_REDUCE) {
+                unsigned int yyruleno = yyact - YY_MIN_REDUCE; /* Reduce by this rule */
+                assert(yyruleno < (int)(sizeof(yyRuleName) / sizeof(yyRuleName[0])));
+#ifndef NDEBUG
+                if (yyTraceFILE) {
+                    int yysize = yyRuleInfoNRhs[yyruleno];
+                    if (yysize) {
+                        fprintf(yyTraceFILE, "%sReduce %d [%s]%s, pop back to state %d.\n",
+                            yyTracePrompt,
+                            yyruleno, yyRuleName[yyruleno],
+                            yyruleno < YYNRULE_WITH_ACTION ? "" : " without external action",
+                            yytos[yysize].stateno);
+                    }
+                    else {
+                        fprintf(yyTraceFILE, "%sReduce %d [%s]%s.\n",
+                            yyTracePrompt, yyruleno, yyRuleName[yyruleno],
+                            yyruleno < YYNRULE_WITH_ACTION ? "" : " without external action");
+                    }
+                }
+#endif /* NDEBUG */
+
+                /* Check that the stack is large enough to grow by a single entry
+                ** if the RHS of the rule is empty.  This ensures that there is room
+                ** enough on the stack to push the LHS value */
+                if (yyRuleInfoNRhs[yyruleno] == 0 && yy_reduce_room()) {
+                    yystop = 1;
+                    break;
+                }
+                yyact = yy_reduce(yyruleno, yymajor, yyminor);
+            }
+            else if (yyact <= YY_MAX_SHIFTREDUCE) {
+                yystop = yy_shift(yyact, (YYCODETYPE)yymajor, std::move(yyminor));
+#ifndef YYNOERRORRECOVERY
+                yyerrcnt--;
+#endif
+                break;
+            }
+            else if (yyact == YY_ACCEPT_ACTION) {
+                yytos--;
+                yy_accept();
+                return 1;
+            }
+            else {
+                assert(yyact == YY_ERROR_ACTION);
+                yystop = 1;
+#ifdef YYERRORSYMBOL
+                int yymx;
+#endif
+#ifndef NDEBUG
+                if (yyTraceFILE) {
+                    fprintf(yyTraceFILE, "%sSyntax Error!\n", yyTracePrompt);
+                }
+#endif
+#ifdef YYERRORSYMBOL
+                /* A syntax error has occurred.  The response is the same as
+                ** in lempar.c, except that the error symbol is given a copy
+                ** of the token's value, as the token itself is tried again.
+                */
+                if (yyerrcnt < 0) {
+                    yy_syntax_error(yymajor, yyminor);
+                }
+                yymx = yytos->major;
+                if (yymx == YYERRORSYMBOL || yyerrorhit) {
+#ifndef NDEBUG
+                    if (yyTraceFILE) {
+                        fprintf(yyTraceFILE, "%sDiscard input token %s\n",
+                            yyTracePrompt, yyTokenName[yymajor]);
+                    }
+#endif
+                    yy_discard((YYCODETYPE)yymajor, yyminor);
+                    yymajor = YYNOCODE;
+                }
+                else {
+                    while (yytos >= yystack
+                        && (yyact = yy_find_reduce_action(
+                            yytos->stateno,
+                            YYERRORSYMBOL)) > YY_MAX_SHIFTREDUCE
+                        ) {
+                        yy_pop_parser_stack();
+                    }
+                    if (yytos < yystack || yymajor == 0) {
+                        yy_discard((YYCODETYPE)yymajor, yyminor);
+                        yy_parse_failed();
+#ifndef YYNOERRORRECOVERY
+                        yyerrcnt = -1;
+#endif
+                        yymajor = YYNOCODE;
+                    }
+                    else if (yymx != YYERRORSYMBOL) {
+                        yy_shift(yyact, YYERRORSYMBOL, ParseTOKENTYPE(yyminor));
+                    }
+                }
+                yyerrcnt = 3;
+                yyerrorhit = 1;
+                if (yymajor == YYNOCODE) break;
+                yyact = yytos->stateno;
+#elif defined(YYNOERRORRECOVERY)
+                /* Report the error and carry on as if nothing had happened */
+                yy_syntax_error(yymajor, yyminor);
+                yy_discard((YYCODETYPE)yymajor, yyminor);
+                break;
+#else  /* YYERRORSYMBOL is not defined */
+                /* Report the error, throw away the token and fail the parse
+                ** if it was the end of input */
+                if (yyerrcnt <= 0) {
+                    yy_syntax_error(yymajor, yyminor);
+                }
+                yyerrcnt = 3;
+                yy_discard((YYCODETYPE)yymajor, yyminor);
+                if (yyendofinput) {
+                    yy_parse_failed();
+#ifndef YYNOERRORRECOVERY
+                    yyerrcnt = -1;
+#endif
+                }
+                break;
+#endif
+            }
+        }
+#ifndef NDEBUG
+        if (yyTraceFILE) {
+            yyStackEntry* i;
+            char cDiv = '[';
+            fprintf(yyTraceFILE, "%sReturn. Stack=", yyTracePrompt);
+#if YYSTACKDEPTH<=0 && defined(YYSTACKSEGMENTS)
+            /* Skip the entries at the top of each segment below this one,
+            ** which have moved up to the next */
+            for (int iSeg = 0; iSeg < yystkseg; iSeg++) {
+                yyStackEntry* pSeg = yystkmem[iSeg];
+                yyStackEntry* pEnd = &pSeg[yystksz[iSeg] - yyMaxRhs()];
+                for (i = &pSeg[iSeg == 0]; i < pEnd; i++) {
+                    fprintf(yyTraceFILE, "%c%s", cDiv, yyTokenName[i->major]);
+                    cDiv = ' ';
+                }
+            }
+            i = &yystack[yystkseg == 0];
+#else
+            i = &yystack[1];
+#endif
+            for (; i <= yytos; i++) {
+                fprintf(yyTraceFILE, "%c%s", cDiv, yyTokenName[i->major]);
+                cDiv = ' ';
+            }
+            fprintf(yyTraceFILE, "]\n");
+        }
+#endif
+        return yystop;
+    }
+};
+
+/* Leave nothing but the token codes, ParseTOKENTYPE and ParseMINORTYPE
+** defined for the code that includes this file */
+#undef YYCODETYPE
+#undef YYNOCODE
+#undef YYACTIONTYPE
+#undef YYWILDCARD
+#undef YYMINORTYPE
+#undef YYSTACKDEPTH
+#undef YYSTACKINIT
+#undef YYNSTACKSEG
+#undef ParseARG_SDECL
+#undef ParseARG_PDECL
+#undef ParseARG_STORE
+#undef ParseCTX_TYPE
+#undef ParseCTX_SDECL
+#undef ParseCTX_CDECL
+#undef ParseCTX_STORE
+#undef YYERRORSYMBOL
+#undef YYERRSYMDT
+#undef YYFALLBACK
+#undef YYNSTATE
+#undef YYNRULE
+#undef YYNRULE_WITH_ACTION
+#undef YYNTOKEN
+#undef YY_MAX_SHIFT
+#undef YY_MIN_SHIFTREDUCE
+#undef YY_MAX_SHIFTREDUCE
+#undef YY_ERROR_ACTION
+#undef YY_ACCEPT_ACTION
+#undef YY_NO_ACTION
+#undef YY_MIN_REDUCE
+#undef YY_MAX_REDUCE
+#undef YYDENSE
+#undef YY_ACTTAB_COUNT
+#undef YY_SHIFT_COUNT
+#undef YY_SHIFT_MIN
+#undef YY_SHIFT_MAX
+#undef YY_REDUCE_COUNT
+#undef YY_REDUCE_MIN
+#undef YY_REDUCE_MAX
+#undef YY_NLOOKAHEAD
+#undef YYINLINE
+#undef TOKEN
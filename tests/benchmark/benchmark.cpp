@@ -0,0 +1,461 @@
+/*
+** Generator benchmark: runs lemon.cpp and lemon_original.c side by side
+** on sqlite_parse.y and a family of synthetic grammars of growing size.
+** With --deep-orig and --deep-cpp it also times the parsers that each
+** generator makes from deep.y, on inputs nested a million deep and on
+** many shallow ones, each with a fresh parser.  --deep-segments adds the
+** lemon.cpp parser built with YYSTACKSEGMENTS, which is only reported.
+**
+** Each generator is run several times per grammar in a scratch directory.
+** Wall time and peak RSS come from wait4(); lemon.cpp additionally writes
+** its per-phase timings with -J, so those are reported too.  The original
+** has no such switch and only gets a total.
+**
+** Regressions are flagged (and, unless --report-only is given, the exit
+** status is non-zero) when:
+**
+**   o  lemon.cpp, or its deep.y parser, is slower than lemon_original.c
+**      or its parser by more than the threshold on any grammar, or
+**   o  a --baseline file from an earlier --save is given and a total
+**      time or peak RSS grew by more than the threshold.
+**
+** Comparisons use the fastest of the runs, which is the least noisy figure
+** on a shared machine; the median is printed alongside for information.
+** Differences under the noise floor (--floor, in microseconds) are never
+** counted as regressions, so tiny grammars do not flap.
+**
+** Linux only: it needs fork/exec and wait4().
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace fs = std::filesystem;
+
+/* The phase names written by lemon.cpp -J, in the order they run */
+static const char* const phaseNames[] = {
+    "Parse",          "FindFirstSets", "FindStates",  "FindLinks",
+    "FindFollowSets", "FindActions",   "CompressTables", "ResortStates",
+    "ReportOutput",   "ReportTable",   "ReportHeader",
+};
+constexpr int nphase = sizeof(phaseNames) / sizeof(phaseNames[0]);
+
+struct options {
+    std::string cpp;             /* Path to the lemon.cpp binary */
+    std::string orig;            /* Path to the lemon_original.c binary */
+    std::string sqlite;          /* sqlite_parse.y */
+    std::string lempar;          /* lempar.c, needed by the original */
+    std::string deepOrig;        /* deep.y parser from lemon_original.c */
+    std::string deepCpp;         /* deep.y parser from lemon.cpp */
+    std::string deepSegments;    /* The same, with YYSTACKSEGMENTS */
+    std::string baseline;        /* Results to compare against, if any */
+    std::string save;            /* Where to write this run's results */
+    std::vector<int> scales{25, 100, 400}; /* Blocks per synthetic grammar */
+    /* Nesting depth and number of inputs of each deep.y case */
+    std::vector<std::pair<int, int>> deep{{1000000, 10}, {100, 20000}, {5, 200000}};
+    int runs = 5;                /* Runs per generator per grammar */
+    double threshold = 0.10;     /* Allowed slowdown as a fraction */
+    long floor = 2000;           /* Noise floor in microseconds */
+    bool reportOnly = false;     /* Exit with 0 even if there are regressions */
+};
+
+/* One run of one generator */
+struct sample {
+    long wallUsec;               /* Wall clock time of the whole process */
+    long rssKb;                  /* Peak resident set size */
+    long phaseUsec[nphase];      /* From -J; zero for the original */
+};
+
+/* All runs of one generator on one grammar */
+struct result {
+    std::string grammar;
+    std::string who;             /* "cpp" or "orig" */
+    std::vector<sample> runs;
+
+    long best() const
+    {
+        long b = runs[0].wallUsec;
+        for (const auto& s : runs) b = std::min(b, s.wallUsec);
+        return b;
+    }
+    long median() const
+    {
+        std::vector<long> v;
+        for (const auto& s : runs) v.push_back(s.wallUsec);
+        std::sort(v.begin(), v.end());
+        return v[v.size() / 2];
+    }
+    long rss() const
+    {
+        long b = runs[0].rssKb;
+        for (const auto& s : runs) b = std::min(b, s.rssKb);
+        return b;
+    }
+    long phaseMedian(int i) const
+    {
+        std::vector<long> v;
+        for (const auto& s : runs) v.push_back(s.phaseUsec[i]);
+        std::sort(v.begin(), v.end());
+        return v[v.size() / 2];
+    }
+};
+
+static void usage(const char* argv0)
+{
+    fprintf(stderr,
+        "Usage: %s --cpp BIN --orig BIN --sqlite FILE --lempar FILE [options]\n"
+        "  --runs N          runs per generator per grammar (default 5)\n"
+        "  --scales A,B,...  synthetic grammar sizes in blocks (default 25,100,400)\n"
+        "  --deep-orig BIN   deep.y parser made by the original\n"
+        "  --deep-cpp BIN    deep.y parser made by lemon.cpp\n"
+        "  --deep-segments BIN  the same, with YYSTACKSEGMENTS\n"
+        "  --quick           same as --runs 3 --scales 25,100, with smaller deep cases\n"
+        "  --threshold PCT   allowed slowdown in percent (default 10)\n"
+        "  --floor USEC      ignore differences below this (default 2000)\n"
+        "  --baseline FILE   compare against results saved earlier\n"
+        "  --save FILE       save this run's results\n"
+        "  --report-only     print regressions without failing\n",
+        argv0);
+    exit(2);
+}
+
+static std::vector<int> parse_scales(const char* z)
+{
+    std::vector<int> v;
+    std::stringstream ss(z);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (!item.empty()) v.push_back(atoi(item.c_str()));
+    }
+    return v;
+}
+
+static options parse_args(int argc, char** argv)
+{
+    options o;
+    for (int i = 1; i < argc; i++) {
+        std::string a = argv[i];
+        auto next = [&]() -> const char* {
+            if (i + 1 >= argc) usage(argv[0]);
+            return argv[++i];
+        };
+        if (a == "--cpp") o.cpp = next();
+        else if (a == "--orig") o.orig = next();
+        else if (a == "--sqlite") o.sqlite = next();
+        else if (a == "--lempar") o.lempar = next();
+        else if (a == "--deep-orig") o.deepOrig = next();
+        else if (a == "--deep-cpp") o.deepCpp = next();
+        else if (a == "--deep-segments") o.deepSegments = next();
+        else if (a == "--baseline") o.baseline = next();
+        else if (a == "--save") o.save = next();
+        else if (a == "--runs") o.runs = atoi(next());
+        else if (a == "--scales") o.scales = parse_scales(next());
+        else if (a == "--threshold") o.threshold = atof(next()) / 100.0;
+        else if (a == "--floor") o.floor = atol(next());
+        else if (a == "--report-only") o.reportOnly = true;
+        else if (a == "--quick") {
+            o.runs = 3;
+            o.scales = {25, 100};
+            o.deep = {{100000, 3}, {100, 2000}};
+        }
+        else usage(argv[0]);
+    }
+    if (o.cpp.empty() || o.orig.empty() || o.sqlite.empty() || o.lempar.empty() || o.runs < 1
+        || o.deepOrig.empty() != o.deepCpp.empty() || (o.deepCpp.empty() && !o.deepSegments.empty())) {
+        usage(argv[0]);
+    }
+    for (std::string* z : {&o.cpp, &o.orig, &o.deepOrig, &o.deepCpp, &o.deepSegments}) {
+        if (!z->empty()) *z = fs::absolute(*z).string();
+    }
+    return o;
+}
+
+/*
+** Write a conflict-free grammar made of nblock independent expression
+** sub-languages.  State count grows linearly with nblock (about ten
+** states per block) and every rule carries an action, so both the LALR
+** construction and the report writers get a proportional amount of work.
+*/
+static void make_synthetic(const fs::path& file, int nblock)
+{
+    std::ofstream out(file);
+    out << "%include {\n#include <stdio.h>\n}\n"
+           "%token_type {int}\n"
+           "prog ::= stmts.\n"
+           "stmts ::= stmts stmt.\n"
+           "stmts ::= .\n";
+    for (int i = 0; i < nblock; i++) {
+        out << "stmt ::= KW" << i << " expr" << i << "(A) SEMI. { printf(\"%d\\n\", A); }\n"
+            << "expr" << i << "(A) ::= expr" << i << "(B) PLUS" << i << " term" << i << "(C). { A = B + C; }\n"
+            << "expr" << i << "(A) ::= expr" << i << "(B) MINUS term" << i << "(C). { A = B - C; }\n"
+            << "expr" << i << "(A) ::= term" << i << "(B). { A = B; }\n"
+            << "term" << i << "(A) ::= term" << i << "(B) STAR" << i << " factor" << i << "(C). { A = B * C; }\n"
+            << "term" << i << " ::= factor" << i << ".\n"
+            << "factor" << i << "(A) ::= ID(B). { A = B; }\n"
+            << "factor" << i << "(A) ::= LP" << i << " expr" << i << "(B) RP. { A = B; }\n";
+    }
+}
+
+/* Pull the "phase_usec" object out of a -J file */
+static void read_phases(const fs::path& file, long* phaseUsec)
+{
+    std::ifstream in(file);
+    std::string line;
+    bool inPhases = false;
+    while (std::getline(in, line)) {
+        if (line.find("\"phase_usec\"") != std::string::npos) {
+            inPhases = true;
+            continue;
+        }
+        if (!inPhases) continue;
+        if (line.find('}') != std::string::npos) break;
+        for (int i = 0; i < nphase; i++) {
+            std::string key = std::string("\"") + phaseNames[i] + "\":";
+            auto pos = line.find(key);
+            if (pos != std::string::npos) phaseUsec[i] = atol(line.c_str() + pos + key.size());
+        }
+    }
+}
+
+/*
+** Run argv in directory dir with output discarded.  Fills in the wall time
+** and peak RSS of the child.  Returns the exit status, or -1 if the child
+** could not be started or did not exit normally.
+*/
+static int run_child(const fs::path& dir, const std::vector<std::string>& args, sample& s)
+{
+    std::vector<char*> argv;
+    for (const auto& a : args) argv.push_back(const_cast<char*>(a.c_str()));
+    argv.push_back(nullptr);
+
+    auto t0 = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0) return -1;
+    if (pid == 0) {
+        int fd = open("/dev/null", O_WRONLY);
+        if (fd >= 0) {
+            dup2(fd, 1);
+            dup2(fd, 2);
+            close(fd);
+        }
+        if (chdir(dir.c_str()) != 0) _exit(127);
+        execv(argv[0], argv.data());
+        _exit(127);
+    }
+    int status = 0;
+    struct rusage ru;
+    if (wait4(pid, &status, 0, &ru) < 0) return -1;
+    auto t1 = std::chrono::steady_clock::now();
+    s.wallUsec = (long)std::chrono::duration_cast<std::chrono::microseconds>(t1 - t0).count();
+    s.rssKb = ru.ru_maxrss;
+    if (!WIFEXITED(status)) return -1;
+    return WEXITSTATUS(status);
+}
+
+/*
+** Benchmark one generator on one grammar.  The outputs of the previous run
+** are deleted first: lemon.cpp skips writing files whose text has not
+** changed, and leaving them around would let it off the output work that
+** the original always does.
+*/
+static bool bench(const options& o, const fs::path& dir, const fs::path& grammar, const std::string& who,
+                  result& r)
+{
+    fs::path work = dir / who;
+    fs::create_directories(work);
+    fs::copy_file(grammar, work / grammar.filename(), fs::copy_options::overwrite_existing);
+    fs::copy_file(o.lempar, work / "lempar.c", fs::copy_options::overwrite_existing);
+
+    std::string stem = grammar.stem().string();
+    std::vector<std::string> args;
+    if (who == "cpp") {
+        args = {o.cpp, "-Jbench.json", grammar.filename().string()};
+    }
+    else {
+        args = {o.orig, grammar.filename().string()};
+    }
+
+    r.grammar = grammar.filename().string();
+    r.who = who;
+    for (int i = 0; i < o.runs; i++) {
+        for (const char* ext : {".c", ".h", ".out"}) fs::remove(work / (stem + ext));
+        fs::remove(work / "bench.json");
+
+        sample s{};
+        int rc = run_child(work, args, s);
+        if (rc != 0) {
+            fprintf(stderr, "%s on %s failed (status %d)\n", args[0].c_str(), r.grammar.c_str(), rc);
+            return false;
+        }
+        if (who == "cpp") read_phases(work / "bench.json", s.phaseUsec);
+        r.runs.push_back(s);
+    }
+    return true;
+}
+
+/*
+** Benchmark the deep.y parser bin on count inputs nested depth deep.  The
+** process makes a fresh parser for each, so the time includes setting up
+** and freeing the stack as well as growing it.
+*/
+static bool bench_deep(const options& o, const fs::path& dir, const std::string& bin, const std::string& who,
+                       int depth, int count, result& r)
+{
+    std::vector<std::string> args{bin, std::to_string(depth), std::to_string(count)};
+
+    r.grammar = "deep" + std::to_string(depth) + "x" + std::to_string(count);
+    r.who = who;
+    for (int i = 0; i < o.runs; i++) {
+        sample s{};
+        int rc = run_child(dir, args, s);
+        if (rc != 0) {
+            fprintf(stderr, "%s on %s failed (status %d)\n", bin.c_str(), r.grammar.c_str(), rc);
+            return false;
+        }
+        r.runs.push_back(s);
+    }
+    return true;
+}
+
+static void print_result(const result& cpp, const result& orig)
+{
+    printf("\n%s  (%zu runs)\n", cpp.grammar.c_str(), cpp.runs.size());
+    printf("  %-14s %10s %10s %10s\n", "", "best ms", "median ms", "rss KB");
+    printf("  %-14s %10.2f %10.2f %10ld\n", "lemon_original", orig.best() / 1e3, orig.median() / 1e3,
+           orig.rss());
+    printf("  %-14s %10.2f %10.2f %10ld\n", "lemon_cpp", cpp.best() / 1e3, cpp.median() / 1e3, cpp.rss());
+    printf("  lemon_cpp phases (median ms):\n");
+    for (int i = 0; i < nphase; i++) {
+        printf("    %-16s %8.2f\n", phaseNames[i], cpp.phaseMedian(i) / 1e3);
+    }
+}
+
+/* The results of the deep.y parsers on one case, the original's first */
+static void print_deep(const std::vector<result>& rs)
+{
+    printf("\n%s  (%zu runs)\n", rs[0].grammar.c_str(), rs[0].runs.size());
+    printf("  %-14s %10s %10s %10s\n", "", "best ms", "median ms", "rss KB");
+    for (const auto& r : rs) {
+        const char* zWho = r.who == "orig" ? "lemon_original" : r.who == "cpp" ? "lemon_cpp" : "segments";
+        printf("  %-14s %10.2f %10.2f %10ld\n", zWho, r.best() / 1e3, r.median() / 1e3, r.rss());
+    }
+}
+
+/* Results are saved as "grammar who best_usec rss_kb" lines */
+static void save_results(const std::string& file, const std::vector<result>& all)
+{
+    std::ofstream out(file);
+    for (const auto& r : all) out << r.grammar << ' ' << r.who << ' ' << r.best() << ' ' << r.rss() << '\n';
+    printf("\nResults saved to %s\n", file.c_str());
+}
+
+static std::map<std::string, std::pair<long, long>> load_baseline(const std::string& file)
+{
+    std::map<std::string, std::pair<long, long>> m;
+    std::ifstream in(file);
+    if (!in) {
+        fprintf(stderr, "Can't open baseline \"%s\".\n", file.c_str());
+        return m;
+    }
+    std::string grammar, who;
+    long usec, rss;
+    while (in >> grammar >> who >> usec >> rss) m[grammar + ' ' + who] = {usec, rss};
+    return m;
+}
+
+/* True if now is worse than before by more than the threshold and the floor */
+static bool regressed(const options& o, long now, long before, long floor)
+{
+    return now - before > floor && now > before * (1.0 + o.threshold);
+}
+
+int main(int argc, char** argv)
+{
+    options o = parse_args(argc, argv);
+
+    fs::path dir = fs::temp_directory_path() / ("lemon_bench_" + std::to_string(getpid()));
+    fs::create_directories(dir);
+
+    std::vector<fs::path> grammars{fs::absolute(o.sqlite)};
+    for (int n : o.scales) {
+        fs::path g = dir / ("synth" + std::to_string(n) + ".y");
+        make_synthetic(g, n);
+        grammars.push_back(g);
+    }
+
+    std::vector<result> all;
+    int nregress = 0;
+    bool ok = true;
+    for (const auto& g : grammars) {
+        result cpp, orig;
+        if (!bench(o, dir, g, "orig", orig) || !bench(o, dir, g, "cpp", cpp)) {
+            ok = false;
+            break;
+        }
+        print_result(cpp, orig);
+        if (regressed(o, cpp.best(), orig.best(), o.floor)) {
+            printf("  REGRESSION: lemon_cpp is %.0f%% slower than lemon_original\n",
+                   100.0 * (cpp.best() - orig.best()) / orig.best());
+            nregress++;
+        }
+        all.push_back(orig);
+        all.push_back(cpp);
+    }
+    for (const auto& c : o.deep) {
+        if (!ok || o.deepCpp.empty()) break;
+        std::vector<result> rs(o.deepSegments.empty() ? 2 : 3);
+        if (!bench_deep(o, dir, o.deepOrig, "orig", c.first, c.second, rs[0])
+            || !bench_deep(o, dir, o.deepCpp, "cpp", c.first, c.second, rs[1])
+            || (rs.size() == 3 && !bench_deep(o, dir, o.deepSegments, "segments", c.first, c.second, rs[2]))) {
+            ok = false;
+            break;
+        }
+        print_deep(rs);
+        if (regressed(o, rs[1].best(), rs[0].best(), o.floor)) {
+            printf("  REGRESSION: the lemon_cpp parser is %.0f%% slower than the lemon_original one\n",
+                   100.0 * (rs[1].best() - rs[0].best()) / rs[0].best());
+            nregress++;
+        }
+        all.insert(all.end(), rs.begin(), rs.end());
+    }
+    fs::remove_all(dir);
+    if (!ok) return 2;
+
+    if (!o.baseline.empty()) {
+        auto base = load_baseline(o.baseline);
+        printf("\nCompared with %s:\n", o.baseline.c_str());
+        for (const auto& r : all) {
+            auto it = base.find(r.grammar + ' ' + r.who);
+            if (it == base.end()) continue;
+            long usec = it->second.first, rss = it->second.second;
+            printf("  %-16s %-5s %+6.1f%% time %+6.1f%% rss\n", r.grammar.c_str(), r.who.c_str(),
+                   100.0 * (r.best() - usec) / usec, 100.0 * (r.rss() - rss) / rss);
+            if (regressed(o, r.best(), usec, o.floor)) {
+                printf("  REGRESSION: %s %s time\n", r.grammar.c_str(), r.who.c_str());
+                nregress++;
+            }
+            /* RSS is in KB; allow a page-sized wobble */
+            if (regressed(o, r.rss(), rss, 64)) {
+                printf("  REGRESSION: %s %s peak RSS\n", r.grammar.c_str(), r.who.c_str());
+                nregress++;
+            }
+        }
+    }
+
+    if (!o.save.empty()) save_results(o.save, all);
+    printf("\n%d regression%s\n", nregress, nregress == 1 ? "" : "s");
+    return nregress && !o.reportOnly ? 1 : 0;
+}
@@ -0,0 +1,19 @@
+/*
+** A grammar for timing the generated parsers rather than the generators.
+** Every LP stays on the stack until its RP, so an input nested n deep
+** takes the stack n entries deep.
+*/
+%include {
+#include <assert.h>
+#include <stdlib.h>
+}
+
+%name Deep
+%token_prefix TK_
+%token_type {int}
+%extra_argument {int* pDepth}
+%stack_size 0
+
+input ::= expr(A).                { *pDepth = A; }
+expr(A) ::= LP expr(B) RP.        { A = B + 1; }
+expr(A) ::= ID.                   { A = 0; }
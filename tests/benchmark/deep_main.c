@@ -0,0 +1,40 @@
+/*
+** Driver of the deep.y parser for lemon_benchmark.  It makes a fresh
+** parser for each of count inputs, nests an identifier in depth
+** parentheses and checks that the parser counted them all.
+**
+** Usage: deep DEPTH COUNT
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include "deep.h"
+
+void* DeepAlloc(void* (*mallocProc)(size_t));
+void DeepFree(void* p, void (*freeProc)(void*));
+void Deep(void* p, int major, int minor, int* pDepth);
+
+int main(int argc, char** argv)
+{
+    int depth, count, n, i;
+
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s DEPTH COUNT\n", argv[0]);
+        return 2;
+    }
+    depth = atoi(argv[1]);
+    count = atoi(argv[2]);
+    for (n = 0; n < count; n++) {
+        void* p = DeepAlloc(malloc);
+        int result = -1;
+        for (i = 0; i < depth; i++) Deep(p, TK_LP, 0, &result);
+        Deep(p, TK_ID, 0, &result);
+        for (i = 0; i < depth; i++) Deep(p, TK_RP, 0, &result);
+        Deep(p, 0, 0, &result);
+        DeepFree(p, free);
+        if (result != depth) {
+            fprintf(stderr, "Parsed %d deep, not %d\n", result, depth);
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+** Tests of the automaton cache (lemon.cpp -K) on sqlite_parse.y.
+**
+** Each case runs lemon_cpp with -K in a scratch directory under the
+** current one and compares the .c, .h and .out files with those of a run
+** without -K on the same grammar in the same place, which must be
+** byte-identical.  A run without -K neither reads nor writes the cache.  Whether the automaton came from
+** the cache is read from the "configs" counter of -J, which is zero when
+** no configurations were built.  The cases are:
+**
+**   o  a cold run, which has no .lcache and must write one,
+**   o  a warm run, which must use it,
+**   o  an edit to the code of an action only, which must still use it,
+**   o  a change of precedence, which must not,
+**   o  a truncated and a corrupted .lcache, which must be rejected and
+**      then replaced.
+**
+** The exit status is the number of failed checks.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <string>
+
+namespace fs = std::filesystem;
+
+static std::string lemonBin;     /* Path to the lemon.cpp binary */
+static int nfail = 0;            /* Number of failed checks */
+
+static void check(bool ok, const char* zCase, const char* zWhat)
+{
+    printf("%-5s %s: %s\n", ok ? "ok" : "FAIL", zCase, zWhat);
+    if (!ok) nfail++;
+}
+
+static std::string read_file(const fs::path& file)
+{
+    std::ifstream in(file, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+static void write_file(const fs::path& file, const std::string& text)
+{
+    std::ofstream out(file, std::ios::binary | std::ios::trunc);
+    out << text;
+}
+
+/* The text of the generated files of one run */
+struct outputs {
+    std::string c, h, out;
+    int configs = -1;            /* The "configs" counter of -J */
+
+    bool operator==(const outputs& o) const { return c == o.c && h == o.h && out == o.out; }
+};
+
+/*
+** Write grammar as dir/sqlite_parse.y and run lemon_cpp on it, with -K if
+** cache is set.  Return the files it generated.
+*/
+static outputs generate(const fs::path& dir, const std::string& grammar, bool cache)
+{
+    outputs r;
+    fs::path json = dir / "stats.json";
+    fs::create_directories(dir);
+    write_file(dir / "sqlite_parse.y", grammar);
+    for (const char* ext : {".c", ".h", ".out"}) fs::remove(dir / (std::string("sqlite_parse") + ext));
+    fs::remove(json);
+
+    std::string cmd = "\"" + lemonBin + "\" " + (cache ? "-K " : "") + "\"-J" + json.string() + "\" \""
+        + (dir / "sqlite_parse.y").string() + "\"";
+    if (std::system(cmd.c_str()) != 0) {
+        fprintf(stderr, "Failed: %s\n", cmd.c_str());
+        return r;
+    }
+    r.c = read_file(dir / "sqlite_parse.c");
+    r.h = read_file(dir / "sqlite_parse.h");
+    r.out = read_file(dir / "sqlite_parse.out");
+    std::string stats = read_file(json);
+    auto pos = stats.find("\"configs\":");
+    if (pos != std::string::npos) r.configs = atoi(stats.c_str() + pos + 10);
+    return r;
+}
+
+/* Replace the first "from" in text with "to" */
+static std::string edit(std::string text, const std::string& from, const std::string& to)
+{
+    auto pos = text.find(from);
+    if (pos == std::string::npos) {
+        fprintf(stderr, "\"%s\" is not in the grammar\n", from.c_str());
+        exit(2);
+    }
+    return text.replace(pos, from.size(), to);
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 3) {
+        fprintf(stderr, "Usage: %s LEMON_CPP SQLITE_PARSE_Y\n", argv[0]);
+        return 2;
+    }
+    lemonBin = fs::absolute(argv[1]).string();
+    const std::string base = read_file(argv[2]);
+    const std::string action = edit(base, "{ sqlite3FinishCoding(pParse); }",
+        "{ sqlite3FinishCoding(pParse); /* edited */ }");
+    /* The symbols keep their order, so only their precedence differs */
+    const std::string prec = edit(base, "%left STAR SLASH REM.\n%left CONCAT.",
+        "%left STAR SLASH REM CONCAT.");
+
+    fs::path dir = fs::absolute("cache_test");
+    fs::remove_all(dir);
+    fs::path lcache = dir / "sqlite_parse.lcache";
+    outputs r, want;
+
+    const outputs first = generate(dir, base, false);
+    check(!first.c.empty() && first.configs > 0, "reference", "lemon runs without -K");
+    want = first;
+
+    r = generate(dir, base, true);
+    check(r == want, "cold", "output matches a run without -K");
+    check(r.configs > 0, "cold", "automaton is built");
+    check(fs::exists(lcache), "cold", "cache is written");
+
+    r = generate(dir, base, true);
+    check(r == want, "warm", "output matches a run without -K");
+    check(r.configs == 0, "warm", "automaton comes from the cache");
+
+    want = generate(dir, action, false);
+    check(want.c != first.c, "action edit", "edit changes the parser");
+    r = generate(dir, action, true);
+    check(r == want, "action edit", "output matches a run without -K");
+    check(r.configs == 0, "action edit", "automaton comes from the cache");
+
+    want = generate(dir, prec, false);
+    check(want.c != first.c, "precedence", "edit changes the parser");
+    r = generate(dir, prec, true);
+    check(r == want, "precedence", "output matches a run without -K");
+    check(r.configs > 0, "precedence", "cache is not used");
+
+    /* Save a good cache of the base grammar, then damage it */
+    want = first;
+    generate(dir, base, true);
+    const std::string good = read_file(lcache);
+    std::string corrupt = good;
+    corrupt[corrupt.size() / 2] ^= 0x40;
+    const struct {
+        const char* zCase;
+        std::string text;
+    } damaged[] = {
+        {"truncated", good.substr(0, good.size() / 2)},
+        {"header only", good.substr(0, 32)},
+        {"corrupted", corrupt},
+    };
+    for (const auto& d : damaged) {
+        write_file(lcache, d.text);
+        r = generate(dir, base, true);
+        check(r == want, d.zCase, "output matches a run without -K");
+        check(r.configs > 0, d.zCase, "cache is rejected");
+        check(read_file(lcache) == good, d.zCase, "cache is written again");
+    }
+
+    fs::remove_all(dir);
+    printf("%d failure%s\n", nfail, nfail == 1 ? "" : "s");
+    return nfail;
+}
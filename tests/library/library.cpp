@@ -0,0 +1,110 @@
+/*
+** Tests of lemon::Generator, the library interface of lemon.cpp.
+**
+** Two Generators run at once in this process, on two threads, with
+** Options::inMemory set: one on sqlite_parse.y, and one on calc.y with
+** the options of "-X".  Neither may write a file.  Then lemon_cpp is run
+** on the same grammars with the same options, and every file that it
+** writes must be in outputs() under its name, with the same text.
+**
+** The exit status is the number of failed checks.
+*/
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <thread>
+#include "lemon.h"
+
+namespace fs = std::filesystem;
+
+static int nfail = 0;            /* Number of failed checks */
+
+static void check(bool ok, const std::string& zCase, const char* zWhat)
+{
+    printf("%-5s %s: %s\n", ok ? "ok" : "FAIL", zCase.c_str(), zWhat);
+    if (!ok) nfail++;
+}
+
+static std::string read_file(const fs::path& file)
+{
+    std::ifstream in(file, std::ios::binary);
+    std::stringstream ss;
+    ss << in.rdbuf();
+    return ss.str();
+}
+
+/* One grammar, and the options it is generated with */
+struct job {
+    fs::path grammar;            /* The grammar */
+    fs::path dir;                /* Where its files go */
+    bool cplusplus;              /* As with -X */
+    int errors = -1;             /* Errors seen by the Generator */
+    std::map<std::string, std::string> outputs;  /* Its outputs() */
+};
+
+/* Run every phase of a Generator on the grammar of j */
+static void generate(job& j)
+{
+    lemon::Generator::Options opt;
+    opt.outputDir = j.dir.string();
+    opt.cplusplus = j.cplusplus;
+    opt.inMemory = true;
+    lemon::Generator gen(opt);
+    j.errors = gen.parse(j.grammar.string().c_str());
+    if (j.errors) return;
+    gen.analyse();
+    gen.compress();
+    j.errors = gen.emit();
+    j.outputs = gen.outputs();
+}
+
+int main(int argc, char** argv)
+{
+    if (argc != 4) {
+        fprintf(stderr, "Usage: %s LEMON_CPP SQLITE_PARSE_Y CALC_Y\n", argv[0]);
+        return 2;
+    }
+    const std::string lemonBin = fs::absolute(argv[1]).string();
+    fs::path root = fs::absolute("library_test");
+    fs::remove_all(root);
+    job jobs[] = {
+        { fs::absolute(argv[2]), root / "sqlite", false },
+        { fs::absolute(argv[3]), root / "calc", true },
+    };
+    for (job& j : jobs) fs::create_directories(j.dir);
+
+    std::thread other(generate, std::ref(jobs[1]));
+    generate(jobs[0]);
+    other.join();
+
+    for (job& j : jobs) {
+        const std::string name = j.grammar.filename().string();
+        check(j.errors == 0, name, "the Generator reports no errors");
+        check(fs::is_empty(j.dir), name, "Options::inMemory writes no files");
+
+        std::string cmd = "\"" + lemonBin + "\" " + (j.cplusplus ? "-X " : "") + "\"-d"
+            + j.dir.string() + "\" \"" + j.grammar.string() + "\"";
+        if (std::system(cmd.c_str()) != 0) {
+            check(false, name, "lemon_cpp runs");
+            continue;
+        }
+        int nfile = 0;
+        bool same = true;
+        for (const auto& entry : fs::directory_iterator(j.dir)) {
+            auto it = j.outputs.find((j.dir / entry.path().filename()).string());
+            if (it == j.outputs.end() || it->second != read_file(entry.path())) {
+                printf("      %s differs\n", entry.path().filename().string().c_str());
+                same = false;
+            }
+            nfile++;
+        }
+        check(nfile >= 3 && (size_t)nfile == j.outputs.size(), name,
+            "outputs() holds each file that lemon_cpp writes");
+        check(same, name, "outputs() has the text of each file");
+    }
+    return nfail;
+}
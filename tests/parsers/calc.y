@@ -0,0 +1,66 @@
+/*
+** The grammar of the generated-parser tests.  It is small enough for
+** dense tables and uses precedence, empty rules, a fallback, error
+** recovery, destructors and a dynamic stack.  Every action records the
+** rule it reduces, so that the drivers print the exact sequence of
+** reduces.
+*/
+%include {
+#include <stdlib.h>    /* For the malloc() of the dynamic stack */
+#include "calctest.h"
+
+/* Record the reduce of the current rule */
+#define RULE calc_event(pRes, 'r', (int)yyruleno)
+
+/* Keep values small so that arithmetic never overflows */
+#define CALC_MOD(X) ((X) % 10007)
+}
+
+%name Calc
+%token_prefix TK_
+%token_type {int}
+%extra_argument {CalcResult* pRes}
+%stack_size 0
+
+%token_destructor { calc_event(pRes, 't', $$); }
+%destructor expr { calc_event(pRes, 'd', $$); }
+
+%syntax_error { calc_event(pRes, 's', yymajor); }
+%parse_failure { calc_event(pRes, 'f', 0); }
+%parse_accept { calc_event(pRes, 'a', 0); }
+%stack_overflow { calc_event(pRes, 'o', 0); }
+
+%fallback ID LET.
+
+%nonassoc EQ LT.
+%left PLUS MINUS.
+%left TIMES DIVIDE.
+%right POW.
+%right NOT.
+
+program ::= stmts.                          { RULE; }
+stmts ::= .                                 { RULE; }
+stmts ::= stmts stmt.                       { RULE; }
+stmt ::= expr(A) SEMI.                      { RULE; calc_event(pRes, 'v', A); }
+stmt ::= LET ID(N) ASSIGN expr(A) SEMI.     { RULE; calc_event(pRes, 'v', N * 10007 + A); }
+stmt ::= error SEMI.                        { RULE; }
+stmt ::= SEMI.                              { RULE; }
+
+expr(A) ::= expr(B) PLUS expr(C).           { RULE; A = CALC_MOD(B + C); }
+expr(A) ::= expr(B) MINUS expr(C).          { RULE; A = CALC_MOD(B - C); }
+expr(A) ::= expr(B) TIMES expr(C).          { RULE; A = CALC_MOD(B * C); }
+expr(A) ::= expr(B) DIVIDE expr(C).         { RULE; A = C ? B / C : 0; }
+expr(A) ::= expr(B) POW expr(C).            { RULE; A = CALC_MOD(B * B + C); }
+expr(A) ::= expr(B) EQ expr(C).             { RULE; A = B == C; }
+expr(A) ::= expr(B) LT expr(C).             { RULE; A = B < C; }
+expr(A) ::= MINUS expr(B). [NOT]            { RULE; A = -B; }
+expr(A) ::= NOT expr(B).                    { RULE; A = !B; }
+expr(A) ::= LP expr(B) RP.                  { RULE; A = B; }
+expr(A) ::= NUM(X).                         { RULE; A = X; }
+expr(A) ::= ID(X).                          { RULE; A = X; }
+expr(A) ::= ID(F) LP args(N) RP.            { RULE; A = F * 100 + N; }
+
+args(A) ::= .                               { RULE; A = 0; }
+args(A) ::= arglist(B).                     { RULE; A = B; }
+arglist(A) ::= expr.                        { RULE; A = 1; }
+arglist(A) ::= arglist(B) COMMA expr.       { RULE; A = B + 1; }
@@ -0,0 +1,27 @@
+/*
+** The %extra_argument of calc.y, through which the parser reports what
+** it does to the driver.
+*/
+#ifndef CALCTEST_H
+#define CALCTEST_H
+#include <stdio.h>
+
+typedef struct CalcResult CalcResult;
+struct CalcResult {
+    FILE* out;                   /* Events are written here, unless NULL */
+    unsigned long long hash;     /* FNV-1a hash of the events so far */
+    int nEvent;                  /* Number of events so far */
+    int nStop;                   /* Accepts and overflows, which end a batch */
+};
+
+/* Record one event: a reduce, an error, a destructor call, ... */
+static inline void calc_event(CalcResult* pRes, char kind, int value)
+{
+    pRes->hash = (pRes->hash ^ (unsigned char)kind) * 1099511628211ULL;
+    pRes->hash = (pRes->hash ^ (unsigned)value) * 1099511628211ULL;
+    pRes->nEvent++;
+    if (kind == 'a' || kind == 'o') pRes->nStop++;
+    if (pRes->out) fprintf(pRes->out, " %c%d", kind, value);
+}
+
+#endif /* CALCTEST_H */
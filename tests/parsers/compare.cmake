@@ -0,0 +1,48 @@
+# Run the driver of a parser and of the reference parser and fail unless
+# they print the same.
+#
+#   cmake -DEXPECTED=driver -DACTUAL=driver -P compare.cmake
+
+foreach(var EXPECTED ACTUAL)
+    if(NOT DEFINED ${var})
+        message(FATAL_ERROR "compare.cmake: ${var} is not set")
+    endif()
+    execute_process(COMMAND ${${var}} RESULT_VARIABLE rc OUTPUT_VARIABLE ${var}_out)
+    if(NOT rc EQUAL 0)
+        message(FATAL_ERROR "${${var}} failed: ${rc}")
+    endif()
+endforeach()
+
+if(EXPECTED_out STREQUAL ACTUAL_out)
+    return()
+endif()
+
+# Find the first line that differs.  The outputs agree on their first lo
+# characters and not on their first hi + 1.
+string(LENGTH "${EXPECTED_out}" lo)
+string(LENGTH "${ACTUAL_out}" hi)
+if(hi LESS lo)
+    set(lo ${hi})
+endif()
+set(hi ${lo})
+set(lo 0)
+while(lo LESS hi)
+    math(EXPR mid "(${lo} + ${hi} + 1) / 2")
+    string(SUBSTRING "${EXPECTED_out}" 0 ${mid} want)
+    string(SUBSTRING "${ACTUAL_out}" 0 ${mid} got)
+    if(want STREQUAL got)
+        set(lo ${mid})
+    else()
+        math(EXPR hi "${mid} - 1")
+    endif()
+endwhile()
+string(SUBSTRING "${EXPECTED_out}" 0 ${lo} want)
+string(FIND "${want}" "\n" start REVERSE)
+math(EXPR start "${start} + 1")
+foreach(var EXPECTED ACTUAL)
+    string(SUBSTRING "${${var}_out}" ${start} -1 line)
+    string(FIND "${line}" "\n" end)
+    string(SUBSTRING "${line}" 0 ${end} ${var}_line)
+endforeach()
+message(FATAL_ERROR "Expected\n  ${EXPECTED_line}\nbut got\n  ${ACTUAL_line}\n"
+    "Give both drivers \"-v N\" to see the events of the first N streams.")
@@ -0,0 +1,204 @@
+/*
+** Driver of the generated-parser tests.  It feeds a parser made from
+** calc.y a fixed series of pseudo-random token streams and prints what
+** the parser does with each one: the rules it reduces, the values of the
+** statements, the syntax errors and the values it destroys.  However the
+** parser was generated, it must print exactly what a parser from
+** lemon_original does.  Each stream gets a line with the number of
+** events and a hash of them, or with -v, the events themselves.
+**
+** The streams are mostly well-formed, with a few tokens replaced at
+** random and some statements nested deeply enough to grow the stack
+** many times, or to need several of its segments with YYSTACKSEGMENTS.
+** Some parsers reserve stack space first and some are freed before the
+** end of their input.
+**
+** Compile with CALC_BATCH to give each stream to CalcBatch() in as few
+** calls as it allows, or as C++ with CALC_HPP to use the parser class of
+** "lemon -X".  A batch must stop after a token that makes the parser
+** accept or overflow its stack.  Compile with YYSTACKDEPTH set to give
+** the parser a stack of fixed size, which the deep statements overflow.
+** Compile with CALC_RESERVE if the C parser has CalcReserve(), which the
+** reference parser of lempar_base.c does not.
+**
+** Usage: driver [-v] [NSTREAM]
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef CALC_HPP
+# include "calc.hpp"
+#else
+# include "calc.h"
+# include "calctest.h"
+void* CalcAlloc(void* (*)(size_t));
+void CalcFree(void*, void (*)(void*));
+void Calc(void*, int, int, CalcResult*);
+size_t CalcBatch(void*, const int*, const int*, size_t, CalcResult*);
+int CalcReserve(void*, int);
+#endif
+
+#define CALC_MAXTOKEN 10000
+
+static unsigned long long seed;     /* State of the random number generator */
+static int nToken;                  /* Number of tokens in the stream */
+static int aMajor[CALC_MAXTOKEN];   /* Their token codes */
+static int aMinor[CALC_MAXTOKEN];   /* Their values */
+
+/* Return a pseudo-random number less than n */
+static int rnd(int n)
+{
+    seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+    return (int)((seed >> 33) % (unsigned)n);
+}
+
+/* Append a token to the stream */
+static void token(int major, int minor)
+{
+    if (nToken < CALC_MAXTOKEN) {
+        aMajor[nToken] = major;
+        aMinor[nToken] = minor;
+        nToken++;
+    }
+}
+
+/* Append an expression at most depth levels deep */
+static void expr(int depth)
+{
+    static const int aBinary[] = {
+        TK_PLUS, TK_MINUS, TK_TIMES, TK_DIVIDE, TK_POW, TK_EQ, TK_LT
+    };
+    int i, n;
+    switch (depth > 0 ? rnd(8) : rnd(2)) {
+    case 0:
+        token(TK_NUM, rnd(10));
+        break;
+    case 1:
+        token(TK_ID, 1 + rnd(5));
+        break;
+    case 2:
+        expr(depth - 1);
+        token(aBinary[rnd(7)], 0);
+        expr(depth - 1);
+        break;
+    case 3:
+        token(TK_MINUS, 0);
+        expr(depth - 1);
+        break;
+    case 4:
+        token(TK_NOT, 0);
+        expr(depth - 1);
+        break;
+    case 5:
+    case 6:
+        token(TK_LP, 0);
+        expr(depth - 1);
+        token(TK_RP, 0);
+        break;
+    default:
+        token(TK_ID, 1 + rnd(5));
+        token(TK_LP, 0);
+        n = rnd(4);
+        for (i = 0; i < n; i++) {
+            if (i > 0) token(TK_COMMA, 0);
+            expr(depth - 1);
+        }
+        token(TK_RP, 0);
+        break;
+    }
+}
+
+/* Fill aMajor[] and aMinor[] with stream number iStream */
+static void make_stream(int iStream)
+{
+    static const int aAll[] = {
+        TK_EQ, TK_LT, TK_PLUS, TK_MINUS, TK_TIMES, TK_DIVIDE, TK_POW, TK_NOT,
+        TK_SEMI, TK_LET, TK_ID, TK_ASSIGN, TK_LP, TK_RP, TK_NUM, TK_COMMA
+    };
+    int i, j, n, nDeep;
+    seed = (unsigned long long)iStream * 0x9E3779B97F4A7C15ULL;
+    nToken = 0;
+    n = rnd(6);
+    for (i = 0; i < n; i++) {
+        switch (rnd(6)) {
+        case 0:
+            token(TK_LET, 0);
+            token(TK_ID, 1 + rnd(5));
+            token(TK_ASSIGN, 0);
+            expr(4);
+            break;
+        case 1:                  /* An empty statement */
+            break;
+        case 2:                  /* Deep enough to grow the stack */
+            nDeep = rnd(1000);
+            for (j = 0; j < nDeep; j++) token(TK_LP, 0);
+            expr(2);
+            for (j = 0; j < nDeep; j++) token(TK_RP, 0);
+            break;
+        default:
+            expr(4);
+            break;
+        }
+        token(TK_SEMI, 0);
+    }
+    n = rnd(2) ? 0 : rnd(4);
+    for (i = 0; i < n && nToken > 0; i++) {
+        aMajor[rnd(nToken)] = aAll[rnd(sizeof(aAll) / sizeof(aAll[0]))];
+    }
+}
+
+int main(int argc, char** argv)
+{
+    int verbose = argc > 1 && argv[1][0] == '-' && argv[1][1] == 'v';
+    int nStream = argc > 1 + verbose ? atoi(argv[1 + verbose]) : 20000;
+    CalcResult res = { verbose ? stdout : NULL, 0, 0, 0 };
+    int iStream, i;
+#ifdef CALC_BATCH
+    int nStop;
+#endif
+
+    for (iStream = 0; iStream < nStream; iStream++) {
+        make_stream(iStream);
+        res.hash = 14695981039346656037ULL;
+        res.nEvent = 0;
+        printf("%d:", iStream);
+        {
+#ifdef CALC_HPP
+            CalcParser<> parser;
+            if (rnd(4) == 0) parser.reserve(rnd(2000));
+# ifdef CALC_BATCH
+            for (i = 0; i < nToken; ) {
+                nStop = res.nStop;
+                i += (int)parser.parseBatch(&aMajor[i], &aMinor[i], nToken - i, &res);
+                if (res.nStop > nStop + 1) printf(" batch ran past a stop");
+            }
+# else
+            for (i = 0; i < nToken; i++) parser.parse(aMajor[i], aMinor[i], &res);
+# endif
+            if (rnd(8) != 0) parser.parse(0, 0, &res);
+#else
+            void* pParser = CalcAlloc(malloc);
+            if (rnd(4) == 0) {
+                int nReserve = rnd(2000);  /* Drawn either way, for the rnd(8) below */
+# ifdef CALC_RESERVE
+                CalcReserve(pParser, nReserve);
+# else
+                (void)nReserve;
+# endif
+            }
+# ifdef CALC_BATCH
+            for (i = 0; i < nToken; ) {
+                nStop = res.nStop;
+                i += (int)CalcBatch(pParser, &aMajor[i], &aMinor[i], nToken - i, &res);
+                if (res.nStop > nStop + 1) printf(" batch ran past a stop");
+            }
+# else
+            for (i = 0; i < nToken; i++) Calc(pParser, aMajor[i], aMinor[i], &res);
+# endif
+            if (rnd(8) != 0) Calc(pParser, 0, 0, &res);
+            CalcFree(pParser, free);
+#endif
+        }
+        printf(" %d %016llx\n", res.nEvent, res.hash);
+    }
+    return 0;
+}
@@ -0,0 +1,3 @@
+/* The driver, compiled as C++ for the parser class of "lemon -X" */
+#define CALC_HPP 1
+#include "driver.c"
@@ -0,0 +1,49 @@
+/*
+** Driver of the nest.y parser.  Each input nests an identifier in depth
+** parentheses, which grows the stack many times, or with YYSTACKSEGMENTS
+** runs it across many segment boundaries and back, and the result must
+** spell the input back out.  Every depth is
+** parsed with and without reserve(), and some parsers are abandoned
+** halfway so that the destructor releases a deep stack.
+**
+** Usage: nest
+*/
+#include <stdio.h>
+#include <string>
+#include "nest.hpp"
+
+/* Parse depth parentheses around an identifier.  Stop after nToken
+** tokens if nToken is not negative. */
+static std::string parse_nested(int depth, int nReserve, int nToken)
+{
+    std::string out;
+    NestParser<> parser;
+    if (nReserve > 0) parser.reserve(nReserve);
+    int n = 0;
+    for (int i = 0; i < depth && n != nToken; i++, n++) parser.parse(TK_LP, 0, &out);
+    if (n != nToken) parser.parse(TK_ID, depth, &out), n++;
+    for (int i = 0; i < depth && n != nToken; i++, n++) parser.parse(TK_RP, 0, &out);
+    if (n != nToken) parser.parse(0, 0, &out);
+    return out;
+}
+
+int main()
+{
+    static const int aDepth[] = { 0, 1, 2, 3, 7, 8, 9, 63, 64, 65, 300, 1000, 5000 };
+    int nFail = 0;
+    for (int depth : aDepth) {
+        std::string want = std::string(depth, '(') + "identifier-" + std::to_string(depth)
+            + std::string(depth, ')');
+        for (int nReserve : { 0, depth + 8, 2 * depth + 8 }) {
+            std::string got = parse_nested(depth, nReserve, -1);
+            if (got != want) {
+                printf("depth %d, reserve %d: got \"%.40s\"\n", depth, nReserve, got.c_str());
+                nFail++;
+            }
+            parse_nested(depth, nReserve, depth);
+            parse_nested(depth, nReserve, depth + 1 + depth / 2);
+        }
+    }
+    printf("%d failures\n", nFail);
+    return nFail != 0;
+}
@@ -0,0 +1,26 @@
+/*
+** A grammar for the -X parser whose nonterminal values are std::string,
+** so that a value is only valid while the entry that holds it records
+** its type.  Deep nesting moves those values to a larger stack, or
+** between stack segments, as the stack grows and shrinks.
+*/
+%include {
+#include <string>
+}
+
+%name Nest
+%token_prefix TK_
+%token_type {int}
+%extra_argument {std::string* pOut}
+%stack_size 0
+
+%type expr {std::string}
+%type list {std::string}
+
+program ::= list(A).                    { *pOut = A; }
+
+list(A) ::= expr(B).                    { A = B; }
+list(A) ::= list(B) COMMA expr(C).      { A = B + "," + C; }
+
+expr(A) ::= LP list(B) RP.              { A = "(" + B + ")"; }
+expr(A) ::= ID(X).                      { A = "identifier-" + std::to_string(X); }